@@ -2,6 +2,7 @@
 #include "uzel/msg.h"
 #include "uzel/dbg.h"
 #include <uzel/netclient.h>
+#include <uzel/typedmsg.h>
 
 #include <boost/log/trivial.hpp>
 #include <memory>
@@ -15,6 +16,24 @@ const int generic_errorcode = 200;
 namespace io = boost::asio;
 const int send_s = 2;
 
+struct Ping
+{
+  static constexpr std::string_view cname{"ping"};
+  std::uint64_t serial{0};
+
+  template<typename Self, typename Visitor>
+  static void fields(Self &self, Visitor &&visit)
+  {
+    visit("serial", self.serial);
+  }
+};
+
+  /** echoed ping */
+struct Pong : Ping
+{
+  static constexpr std::string_view cname{"pong"};
+};
+
 class NetPrinter : public uzel::NetClient
 {
 public:
@@ -24,8 +43,8 @@ public:
       s_authSuccess.connect([&](){
         BOOST_LOG_TRIVIAL(debug) << DBGOUT << "auth is fired, calling sendMsg()";
       sendMsg();});
-      netctx()->dispatcher()->registerHandler("pong", [](const uzel::Msg& msg){
-        std::cout << "Got pong with serial " << msg.pbody().get<unsigned>("serial", 0) << "\n";
+      netctx()->dispatcher()->registerHandler<Pong>([](const Pong &pong){
+        std::cout << "Got pong with serial " << pong.serial << "\n";
       });
     }
 
@@ -35,15 +54,13 @@ public:
     m_sendTimer.expires_after(io::chrono::seconds(send_s));
     m_sendTimer.async_wait([this](const boost::system::error_code&  /*ec*/){sendMsg();});
 
-    uzel::Msg::ptree msgbody;
-    msgbody.put("serial", m_serial);
-    send(std::make_shared<uzel::Msg>(m_addrto, "ping", std::move(msgbody)));
+    send(m_addrto, Ping{m_serial});
     m_serial++;
   }
 private:
   boost::asio::steady_timer m_sendTimer;
   uzel::Addr m_addrto;
-  size_t m_serial{0};
+  std::uint64_t m_serial{0};
 };
 
 
@@ -1,12 +1,16 @@
 #include "netserver.h"
 
 #include <uzel/dbg.h>
+#include <uzel/uconfig.h>
 
 #include <boost/log/trivial.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/support/date_time.hpp>
 #include <boost/log/expressions.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
 
 const int generic_errorcode = 200;
 
@@ -32,18 +36,58 @@ void init_logging_with_flush()
 }
 
 
+  /** thread-per-core server: every shard runs own io_context on own thread */
+void runShards(unsigned short port, unsigned count)
+{
+  ShardSet shards(count);
+  std::vector<std::unique_ptr<boost::asio::io_context>> contexts;
+  std::vector<std::unique_ptr<NetServer>> servers;
+  for(unsigned i = 0; i < count; ++i) {
+    contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+    servers.push_back(std::make_unique<NetServer>(*contexts.back(), port, shards, i));
+  }
+  BOOST_LOG_TRIVIAL(info) << "running " << count << " shards";
+
+  std::vector<std::thread> pool;
+  pool.reserve(count - 1);
+  for(unsigned i = 1; i < count; ++i) {
+    pool.emplace_back([&shards, i]() { shards.run(i); });
+  }
+  shards.run(0);
+  for(auto &&thread : pool) {
+    thread.join();
+  }
+}
+
+
 int main(int argc, char* argv[])
 {
 //  init_logging_with_flush();
 
   try
   {
-    boost::asio::io_context io_context;
+    const unsigned short port = 32300;
+    const auto shards = uzel::UConfigS::getUConfig().shards();
+    if(shards > 1) {
+      runShards(port, shards);
+      return 0;
+    }
+
+    const auto threads = uzel::UConfigS::getUConfig().threads();
+    boost::asio::io_context io_context(static_cast<int>(threads));
 
       //NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
-    const NetServer server(io_context, 32300);
+    const NetServer server(io_context, port, threads);
 
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for(unsigned i = 1; i < threads; ++i) {
+      pool.emplace_back([&io_context]() { io_context.run(); });
+    }
     io_context.run();
+    for(auto &&thread : pool) {
+      thread.join();
+    }
   }
   catch (const std::exception& ex)
   {
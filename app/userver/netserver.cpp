@@ -14,19 +14,67 @@ using boost::asio::ip::tcp;
 namespace io = boost::asio;
 namespace sys = boost::system;
 
-NetServer::NetServer(io::io_context& io_context, unsigned short port)
-  : m_netctx(std::make_shared<uzel::NetAppContext>(io_context)),
-    m_acceptor(io_context, tcp::endpoint(tcp::v6(), port)),
+namespace
+{
+    /** the shards listen on the same port, the kernel spreads the connections over them */
+  tcp::acceptor makeAcceptor(io::io_context &io_context, unsigned short port, bool reusePort)
+  {
+    const tcp::endpoint endpoint(tcp::v6(), port);
+    if(!reusePort) {
+      return {io_context, endpoint};
+    }
+    tcp::acceptor acceptor(io_context);
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(tcp::acceptor::reuse_address(true));
+    acceptor.set_option(io::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+    acceptor.bind(endpoint);
+    acceptor.listen();
+    return acceptor;
+  }
+}
+
+
+NetServer::NetServer(io::io_context& io_context, unsigned short port, unsigned threads)
+  : NetServer(io_context, port, threads, nullptr, 0)
+{
+}
+
+
+NetServer::NetServer(io::io_context& io_context, unsigned short port, ShardSet &shards, unsigned shard)
+  : NetServer(io_context, port, 1, &shards, shard)
+{
+}
+
+
+NetServer::NetServer(io::io_context& io_context, unsigned short port, unsigned threads, ShardSet *shards, unsigned shard)
+  : m_netctx(std::make_shared<uzel::NetAppContext>(io_context, threads)),
+    m_acceptor(makeAcceptor(io_context, port, shards != nullptr)),
+    m_shards(shards),
+    m_shard(shard),
     m_outman(m_netctx, m_ipToSession,
              [this](const std::string &node)->std::optional<bool> {
-               auto nodeit = m_nodeToSession.find(node);
-               if(nodeit == m_nodeToSession.end()) {
+               if(m_shards && m_shards->home(node) != m_shard) {
+                   // the channel is on another shard
+                 return m_shards->remoteNodes().find(node);
+               }
+               auto rem = m_nodeToSession.find(node);
+               if(!rem) {
                  return {};
                }
-               return nodeit->second.connected();
+               return (*rem)->connected();
              },
              port, 2)
 {
+  if(m_shards) {
+    m_shards->attach(m_shard, *this, io_context);
+  }
+  for(auto &&[cname, prio] : uzel::UConfigS::getUConfig().cnamePriority()) {
+    m_cnamePriority.emplace(uzel::Atom::intern(cname), prio);
+  }
+  for(auto &&[cname, ttl] : uzel::UConfigS::getUConfig().cnameTtl()) {
+    m_cnameTtl.emplace(uzel::Atom::intern(cname), ttl);
+  }
+
     // install handle for priority message
   m_priorityH = m_netctx->dispatcher()->registerHandlerScoped("priority", [this](const uzel::Msg &msg){ handlePriorityMsg(msg); });
 
@@ -41,6 +89,8 @@ NetServer::NetServer(io::io_context& io_context, unsigned short port)
   auto to_connect_to = uzel::UConfigS::getUConfig().remotes();
   for(auto && rhost : to_connect_to)
   {
+      // every shard connects to the hosts it is home of
+    if(m_shards && m_shards->home(rhost) != m_shard) continue;
     m_outman.startConnecting(rhost);
   }
 
@@ -55,16 +105,44 @@ NetServer::NetServer(io::io_context& io_context, unsigned short port)
 
 void NetServer::handlePriorityMsg(const uzel::Msg& msg)
 {
-  auto remoteIt = m_nodeToSession.find(msg.from().node());
-  if(remoteIt == m_nodeToSession.end()) {
+    // the session may be accepted by another shard than the home of its node
+  if(m_shards && forward(m_shards->home(msg.from().node()), Route::priority, std::make_shared<uzel::Msg>(msg))) {
     return;
   }
-  remoteIt->second.handlePriorityMsg(msg);
+  assignLane(msg);
+}
+
+
+void NetServer::assignLane(const uzel::Msg &msg)
+{
+  auto rem = m_nodeToSession.find(msg.from().node());
+  if(!rem) {
+    return;
+  }
+  (*rem)->handlePriorityMsg(msg);
 }
 
 
 void NetServer::handleAny(uzel::Msg::shr_t msg)
 {
+  if(msg->fromLocal()) {
+    if(msg->hdr().deadline == 0 && !m_cnameTtl.empty()) {
+      auto ttl = m_cnameTtl.find(msg->hdr().cname);
+      if(ttl != m_cnameTtl.end()) {
+        msg->setTtl(ttl->second);
+      }
+    }
+    if(msg->hdr().priority == +uzel::Priority::undefined && !m_cnamePriority.empty()) {
+      auto prio = m_cnamePriority.find(msg->hdr().cname);
+      if(prio != m_cnamePriority.end()) {
+        msg->setPriority(prio->second);
+      }
+    }
+  }
+  if(msg->expired()) {
+    m_netctx->msgExpired(msg->dest());
+    return;
+  }
   switch(msg->destType())
   {
     case uzel::Msg::DestType::service: {
@@ -98,17 +176,38 @@ void NetServer::handleServiceMsg(uzel::Msg::shr_t  /*msg*/)
 
 void NetServer::handleLocalMsg(uzel::Msg::shr_t msg)
 {
-  auto lit = m_locals.find(msg->dest().app());
-  if(lit != m_locals.end()) {
-    lit->second->putOutQueue(msg);
+  if(m_shards) {
+    auto owner = m_shards->localApps().find(msg->dest().app());
+    if(!owner) {
+      return;
+    }
+    if(forward(*owner, Route::local, msg)) {
+      return;
+    }
+  }
+  putLocal(msg);
+}
+
+void NetServer::putLocal(const uzel::Msg::shr_t &msg)
+{
+  if(auto local = m_locals.find(msg->dest().app())) {
+    (*local)->putOutQueue(msg);
   }
 }
 
 void NetServer::handleLocalBroadcastMsg(uzel::Msg::shr_t msg)
 {
-  std::ranges::for_each(m_locals,
-                        [&msg](auto &sp){
-                          sp.second->putOutQueue(msg);
+  for(unsigned shard = 0; m_shards && shard < m_shards->size(); ++shard) {
+    forward(shard, Route::localBroadcast, msg);
+  }
+  broadcastLocals(msg);
+}
+
+void NetServer::broadcastLocals(const uzel::Msg::shr_t &msg)
+{
+  std::ranges::for_each(m_locals.values(),
+                        [&msg](auto &ss){
+                          ss->putOutQueue(msg);
                         });
 
 }
@@ -116,8 +215,16 @@ void NetServer::handleLocalBroadcastMsg(uzel::Msg::shr_t msg)
 
 void NetServer::handleBroadcastMsg(uzel::Msg::shr_t msg)
 {
-  std::ranges::for_each(m_nodeToSession,
-           [&msg](auto &sp) { sp.second.send(msg); });
+  for(unsigned shard = 0; m_shards && shard < m_shards->size(); ++shard) {
+    forward(shard, Route::broadcast, msg);
+  }
+  broadcastRemotes(msg);
+}
+
+void NetServer::broadcastRemotes(const uzel::Msg::shr_t &msg)
+{
+  std::ranges::for_each(m_nodeToSession.values(),
+           [&msg](auto &rem) { rem->send(msg); });
 }
 
 
@@ -134,18 +241,73 @@ void NetServer::handleRemoteMsg(uzel::Msg::shr_t msg)
     BOOST_LOG_TRIVIAL(error) << "Can not find route to '" << target << "', message is dropped";
     return;
   }
+  if(m_shards && forward(m_shards->home(*viaNode), Route::remote, msg)) {
+    return;
+  }
+
+  findAddRemote(*viaNode)->send(msg);
+}
 
-  auto &remote = findAddRemote(*viaNode);
-  remote.send(msg);
+
+void NetServer::deliver(Letter letter)
+{
+  switch(letter.route)
+  {
+    case Route::local:
+      putLocal(letter.msg);
+      break;
+    case Route::localBroadcast:
+      broadcastLocals(letter.msg);
+      break;
+    case Route::remote:
+      handleRemoteMsg(letter.msg);
+      break;
+    case Route::broadcast:
+      broadcastRemotes(letter.msg);
+      break;
+    case Route::attach:
+      findAddRemote(letter.session->peerNode())->addSession(letter.session);
+      break;
+    case Route::priority:
+      assignLane(*letter.msg);
+      break;
+    case Route::takeOver:
+      takeOverLocal(letter.session);
+      break;
+    case Route::work:
+        // the shard runs one thread, it is on the executor of everything here
+      letter.work();
+      break;
+  }
+}
+
+
+bool NetServer::forward(unsigned shard, Route route, const uzel::Msg::shr_t &msg)
+{
+  if(!m_shards || shard == m_shard) {
+    return false;
+  }
+  m_shards->send(m_shard, shard, Letter{route, msg});
+  return true;
 }
 
 
 void NetServer::onSessionCreated(uzel::session::shr_t newSession)
 {
-  m_ipToSession[newSession->remoteIp()].insert(newSession);
-  BOOST_LOG_TRIVIAL(debug) << "inserted session '"<< newSession << "' into m_ipToSession, m_ipToSession.size: " << m_ipToSession.size() << ",  m_ipToSession[" <<  newSession->remoteIp() << "].size(): " << m_ipToSession[newSession->remoteIp()].size();
+  const auto count = m_ipToSession.update(newSession->remoteIp(), [&newSession](auto &sessions) {
+    sessions.insert(newSession);
+    return sessions.size();
+  });
+  BOOST_LOG_TRIVIAL(debug) << "inserted session '"<< newSession << "' into m_ipToSession, m_ipToSession[" <<  newSession->remoteIp() << "].size(): " << count;
   newSession->s_closed.connect([&, newSession](){ onSessionClosed(newSession);});
   newSession->s_auth.connect([&](uzel::session::shr_t ss){ auth(ss); });
+  newSession->s_highWatermark.connect([ss = newSession.get()]() {
+    BOOST_LOG_TRIVIAL(warning) << "out queue of session '" << ss << "' to " << ss->remoteIp() << " reached high watermark ("
+                               << ss->outQueue().size() << " messages, " << ss->outQueue().bytes() << " bytes)";
+  });
+  newSession->s_lowWatermark.connect([ss = newSession.get()]() {
+    BOOST_LOG_TRIVIAL(info) << "out queue of session '" << ss << "' to " << ss->remoteIp() << " drained";
+  });
 //  newSession->s_dispatch.connect([&](uzel::Msg::shr_t msg, uzel::session::shr_t ss){ dispatch(msg,ss);});
 }
 
@@ -153,7 +315,9 @@ void NetServer::onSessionCreated(uzel::session::shr_t newSession)
 
 void NetServer::do_accept()
 {
+    // every session gets own strand, so they run on all threads
   m_acceptor.async_accept(
+    m_netctx->makeStrand(),
     [this](sys::error_code ec, tcp::socket socket)
       {
         if (!ec) {
@@ -161,7 +325,10 @@ void NetServer::do_accept()
           auto unauth = std::make_shared<uzel::session>(m_netctx, std::move(socket), uzel::Direction::incoming, raddr);
           BOOST_LOG_TRIVIAL(debug) << "session '"<<unauth << "' created incoming";
           onSessionCreated(unauth);
-          if(m_ipToSession[raddr].size() > MaxConnectionsWithAddr) {
+          const auto count = m_ipToSession.read(raddr, [](const auto *sessions) {
+            return sessions == nullptr ? 0 : sessions->size();
+          });
+          if(count > MaxConnectionsWithAddr) {
             unauth->gracefullClose("connection refused: too many connections");
             BOOST_LOG_TRIVIAL(warning) << "refused connection from "  << raddr << ", too many connections...";
           } else {
@@ -175,7 +342,7 @@ void NetServer::do_accept()
 
 void NetServer::onSessionClosed(uzel::session::shr_t ss)
 {
-  m_ipToSession[ss->remoteIp()].erase(ss);
+  m_ipToSession.update(ss->remoteIp(), [&ss](auto &sessions) { sessions.erase(ss); });
 }
 
 
@@ -192,24 +359,32 @@ std::optional<std::string> NetServer::route(const std::string & target) const
 }
 
 
-uzel::remote &NetServer::findAddRemote(const std::string &node)
+std::shared_ptr<uzel::remote> NetServer::findAddRemote(const std::string &node)
 {
-  auto remoteIt = m_nodeToSession.find(node);
-  if(remoteIt == m_nodeToSession.end())
-  {
+  return m_nodeToSession.findOrAdd(node, [&]() {
     BOOST_LOG_TRIVIAL(info) << "created new remote channel for node " << node;
-    remoteIt = m_nodeToSession.insert({node, uzel::remote(m_netctx, node)}).first;
-  } else {
-    BOOST_LOG_TRIVIAL(info) << "found existing remote channel for node " << node;
-  }
-  return remoteIt->second;
+    if(!m_shards) {
+      return std::make_shared<uzel::remote>(m_netctx, node);
+    }
+      // its lanes may be sessions of other shards, the work for them goes by letters
+    auto rem = std::make_shared<uzel::remote>(m_netctx, node, [shards = m_shards](const auto &executor, auto work) {
+      shards->dispatch(executor, std::move(work));
+    });
+    m_shards->remoteNodes().exchange(node, false);
+    rem->s_connected.connect([shards = m_shards, node](bool connected) { shards->remoteNodes().exchange(node, connected); });
+    return rem;
+  });
 }
 
 
 void NetServer::addAuthSessionToRemote(const std::string &rnode, uzel::session::shr_t ss)
 {
-  auto &remote = findAddRemote(rnode);
-  remote.addSession(ss);
+    // the channel lives on the home shard, the session stays with the one which accepted it
+  if(m_shards && m_shards->home(rnode) != m_shard) {
+    m_shards->send(m_shard, m_shards->home(rnode), Letter{Route::attach, {}, ss, {}});
+    return;
+  }
+  findAddRemote(rnode)->addSession(ss);
 }
 
 void NetServer::auth(uzel::session::shr_t ss)
@@ -219,13 +394,35 @@ void NetServer::auth(uzel::session::shr_t ss)
       // if local app allows multiple instances, it should add pid to
       // the appname during auth, something like "usender:1251"
       // currently only single-instance applications are allowed
-    auto ssIt = m_locals.find(ss->peerApp());
-    if(ssIt != m_locals.end()) {
-      ss->takeOverMessages(*(ssIt->second));
+    if(m_shards) {
+      auto oldShard = m_shards->localApps().exchange(ss->peerApp(), m_shard);
+      if(oldShard && *oldShard != m_shard) {
+          // reconnected to another shard, the messages queued for the app move here
+        m_shards->send(m_shard, *oldShard, Letter{Route::takeOver, {}, ss, {}});
+      }
+    }
+    if(auto old = m_locals.exchange(ss->peerApp(), ss)) {
+      ss->takeOverMessages(**old);
     }
-    m_locals[ss->peerApp()] = ss;
   } else {
     auto rnode = ss->peerNode();
     addAuthSessionToRemote(rnode, ss);
   }
 }
+
+
+void NetServer::takeOverLocal(const uzel::session::shr_t &ss)
+{
+    // the app may be back here already
+  if(m_shards->localApps().find(ss->peerApp()) == m_shard) {
+    return;
+  }
+  auto old = m_locals.erase(ss->peerApp());
+  if(!old) {
+    return;
+  }
+    // the old session runs on this thread, the new one gets its messages by a letter back
+  m_shards->dispatch(ss->executor(), [ss, msgs = (*old)->outQueue().take_all()]() mutable {
+    ss->takeOverMessages(std::move(msgs));
+  });
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "remote.h"
+#include "shards.h"
 #include <uzel/OutgoingManager.h>
 
 #include <uzel/aresolver.h>
@@ -9,7 +10,9 @@
 #include <uzel/netappcontext.h>
 
 #include <boost/asio.hpp>
-#include <map>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
 
 
 namespace uzel
@@ -18,15 +21,35 @@ namespace uzel
 }
 
 
-/** @brief tcp server */
+/**
+ * @brief tcp server
+ *
+ * Sessions and remotes run on own strands of the io_context threads,
+ * routing (handleAny) runs on the dispatcher strand, the maps shared
+ * between them are Registry.
+ *
+ * As a shard of ShardSet it keeps only the local apps it accepted and
+ * the remote nodes it is home of, other messages are passed to the
+ * shard owning the destination. A session authenticated by a remote
+ * node of another shard stays here and is attached to the channel there
+ * by a letter, the channel drives it by letters too.
+ * */
 class NetServer
 {
 public:
     /**
      * @brief server app ctor
      * @param io_context boost::asio io context
-     * @param port TCP port to accept connections */
-  NetServer(boost::asio::io_context& io_context, unsigned short port);
+     * @param port TCP port to accept connections
+     * @param threads number of threads running io_context */
+  NetServer(boost::asio::io_context& io_context, unsigned short port, unsigned threads = 1);
+    /**
+     * @brief shard of the thread-per-core server
+     * @param io_context run by one thread
+     * @param port TCP port shared by all shards
+     * @param shards the shard is attached to
+     * @param shard index of the shard */
+  NetServer(boost::asio::io_context& io_context, unsigned short port, ShardSet &shards, unsigned shard);
   NetServer() = delete;
   NetServer(const NetServer&) = delete;
   NetServer& operator=(const NetServer&) = delete;
@@ -35,7 +58,11 @@ public:
   virtual ~NetServer() = default;
 
   void auth(uzel::session::shr_t ss);
+    /** handle the letter from another shard, on the thread of this one */
+  void deliver(Letter letter);
 private:
+  NetServer(boost::asio::io_context& io_context, unsigned short port, unsigned threads, ShardSet *shards, unsigned shard);
+
   void do_accept();
   void handlePriorityMsg(const uzel::Msg &msg);
 
@@ -45,13 +72,25 @@ private:
   void handleRemoteMsg(uzel::Msg::shr_t msg);
   void handleBroadcastMsg(uzel::Msg::shr_t msg);
   void handleLocalBroadcastMsg(uzel::Msg::shr_t msg);
+    /** to the local app on this shard */
+  void putLocal(const uzel::Msg::shr_t &msg);
+    /** to the local apps on this shard */
+  void broadcastLocals(const uzel::Msg::shr_t &msg);
+    /** to the remote nodes of this shard */
+  void broadcastRemotes(const uzel::Msg::shr_t &msg);
+    /** @return false if the shard is this one (or not sharded), the message is not sent then */
+  bool forward(unsigned shard, Route route, const uzel::Msg::shr_t &msg);
+    /** assign the lane of the session the priority message came from, on the home shard */
+  void assignLane(const uzel::Msg &msg);
+    /** the local app reconnected as ss to another shard: move the messages queued here to it */
+  void takeOverLocal(const uzel::session::shr_t &ss);
 
   void connectResolved( boost::system::error_code ec,  boost::asio::ip::tcp::resolver::results_type rezit, const std::string &hname);
   void reconnectAfterDelay(const std::string &hname);
     /**
      *  find channel to remote node, if it does not exist, then create a new one
      *  */
-  uzel::remote &findAddRemote(const std::string &node);
+  std::shared_ptr<uzel::remote> findAddRemote(const std::string &node);
   std::optional<std::string> route(const std::string &target) const;
 
     /** add authenticated session to remote channel */
@@ -64,9 +103,13 @@ private:
   uzel::NetAppContext::shr_t m_netctx;
   uzel::IpToSession m_ipToSession;
   boost::asio::ip::tcp::acceptor m_acceptor;
-  std::map<std::string, uzel::session::shr_t> m_locals;
+  uzel::Registry<std::string, uzel::session::shr_t> m_locals;
   uzel::NodeToSession m_nodeToSession; ///<! map nodes to sessions
+  ShardSet *m_shards; ///<! not sharded if null
+  unsigned m_shard;
   uzel::OutgoingManager m_outman;
+  std::unordered_map<uzel::Atom, uzel::Priority> m_cnamePriority; ///<! lane of messages from local apps without priority
+  std::unordered_map<uzel::Atom, std::chrono::milliseconds> m_cnameTtl; ///<! TTL of messages from local apps without deadline
   uzel::MsgDispatcher::ScopedConnection m_priorityH;
   uzel::MsgDispatcher::ScopedConnection m_anyH;
 };
@@ -5,21 +5,64 @@
 
 #include <boost/log/trivial.hpp>
 #include <stdexcept>
+#include <utility>
 
 namespace uzel
 {
+  namespace
+  {
+      /** nobody drains the queue of a disconnected remote, so producers can not wait for it */
+    QueueLimits remoteQueueLimits()
+    {
+      auto limits = UConfigS::getUConfig().queueLimits();
+      if(limits.policy == +OverflowPolicy::block) {
+        limits.policy = OverflowPolicy::dropOldest;
+      }
+      return limits;
+    }
+  }
 
 
-  remote::remote(NetAppContext::shr_t netctx, std::string nodename)
-    : m_netctx(std::move(netctx)), m_node(std::move(nodename))
+  remote::remote(NetAppContext::shr_t netctx, std::string nodename, Dispatch dispatch)
+    : m_netctx(std::move(netctx)),
+      m_dispatch(std::move(dispatch)),
+      m_strand(m_netctx->makeStrand()),
+      m_node(std::move(nodename)),
+      m_lanes(remoteQueueLimits(), m_netctx->timers(m_strand))
   {
+      // messages wait here while the node is down, they expire all the same
+    for(auto *queue : {&m_lanes.queue(Priority::high), &m_lanes.queue(Priority::low)}) {
+      queue->s_expired.connect([this](const Addr &dest) { m_netctx->msgExpired(dest); });
+    }
   }
 
 
   void remote::addSession(session::shr_t ss)
   {
-    ss->s_closed.connect([&, ss]() { onSessionClosed(ss);});
+    ss->s_closed.connect([this, wss = std::weak_ptr<session>(ss)]() {
+      auto ss = wss.lock();
+      if(!ss) return;
+        // emitted on the executor of the session, the queue can be taken there only
+      dispatch(m_strand, [this, ss, unsent = ss->outQueue().take_all()]() mutable {
+        onSessionClosed(ss, std::move(unsent));
+      });
+    });
+    dispatch(m_strand, [this, ss]() { assignSession(ss); });
+  }
+
 
+  void remote::dispatch(const boost::asio::any_io_executor &executor, std::function<void ()> work)
+  {
+    if(m_dispatch) {
+      m_dispatch(executor, std::move(work));
+    } else {
+      boost::asio::dispatch(executor, std::move(work));
+    }
+  }
+
+
+  void remote::assignSession(session::shr_t ss)
+  {
       // who is the boss?
     if(ss->peerNode() > uzel::UConfigS::getUConfig().nodeName()) {
       BOOST_LOG_TRIVIAL(debug) << "he is the boss, because '"
@@ -35,37 +78,40 @@ namespace uzel
       BOOST_LOG_TRIVIAL(debug) << "we are the boss, because '"
                                << uzel::UConfigS::getUConfig().nodeName()
                                << "' > '"<< ss->peerNode() << "'";
-      if(!m_sessionH)
+      auto &sessionH = m_lanes.slot(Priority::high);
+      auto &sessionL = m_lanes.slot(Priority::low);
+      auto &sessionC = m_lanes.slot(Priority::control);
+      if(!sessionH)
       {
         BOOST_LOG_TRIVIAL(debug) << "got high priority connection with '" << m_node
                                  << "' = " << ss;
-        m_sessionH = ss;
+        sessionH = ss;
           // it is not necessary both sides to have same priority on the channel
           // but let's do it
         uzel::Msg::ptree body{};
         body.add("priority", static_cast<uzel::Priority>(uzel::Priority::high));
-        ss->putOutQueue(std::make_shared<uzel::Msg>(uzel::Addr(), "priority", std::move(body)));
-        ss->takeOverMessages(m_outHighQueue);
-      } else if(!m_sessionL) {
+        onSession(ss, [ss, msg = std::make_shared<uzel::Msg>(uzel::Addr(), "priority", std::move(body))]() { ss->putOutQueue(msg); });
+        lanesChanged();
+      } else if(!sessionL) {
         BOOST_LOG_TRIVIAL(debug) << "got low priority connection with '" << m_node
                                  << "' = " << ss;
-        m_sessionL = ss;
+        sessionL = ss;
         uzel::Msg::ptree body{};
         body.add("priority", static_cast<uzel::Priority>(uzel::Priority::low));
-        ss->putOutQueue(std::make_shared<uzel::Msg>(uzel::Addr(), "priority", std::move(body)));
-        ss->takeOverMessages(m_outLowQueue);
-      } else if(!m_sessionC &&
-                m_sessionH->direction() == +Direction::incoming &&
-                m_sessionL->direction() == +Direction::incoming &&
+        onSession(ss, [ss, msg = std::make_shared<uzel::Msg>(uzel::Addr(), "priority", std::move(body))]() { ss->putOutQueue(msg); });
+        lanesChanged();
+      } else if(!sessionC &&
+                sessionH->direction() == +Direction::incoming &&
+                sessionL->direction() == +Direction::incoming &&
                 ss->direction() == +Direction::outgoing) {
-        m_sessionC = ss;
+        sessionC = ss;
         uzel::Msg::ptree body{};
         body.add("priority", static_cast<uzel::Priority>(uzel::Priority::control));
-        ss->putOutQueue(std::make_shared<uzel::Msg>(uzel::Addr(), "priority", std::move(body)));
+        onSession(ss, [ss, msg = std::make_shared<uzel::Msg>(uzel::Addr(), "priority", std::move(body))]() { ss->putOutQueue(msg); });
       } else {
         BOOST_LOG_TRIVIAL(debug) << "got too many connections with '" << m_node
                                  << "' = " << ss << ", will be closed";
-        ss->gracefullClose("duplicated connection");
+        onSession(ss, [ss]() { ss->gracefullClose("duplicated connection"); });
       }
     }
   }
@@ -73,64 +119,70 @@ namespace uzel
   void remote::handlePriorityMsg(const Msg &msg)
   {
     if (auto ss = msg.origin().lock()) {
-      size_t erased = m_sessionWaitForRemote.erase(ss);
-      if(ss == m_sessionH || ss == m_sessionL) {
-        BOOST_LOG_TRIVIAL(error) << m_node << ": attempt to reset session priority, ignoring...";
-        return;
-      }
-      auto prio = msg.pbody().get<Priority>("priority", Priority::undefined);
-      switch(prio)
+      auto prio = msg.body().get<Priority>("priority", Priority::undefined);
+      dispatch(m_strand, [this, ss, prio]() { assignPriority(ss, prio); });
+    } else {
+      BOOST_LOG_TRIVIAL(warning) << m_node << ": session is gone";
+    }
+  }
+
+
+  void remote::assignPriority(session::shr_t ss, Priority prio)
+  {
+    m_sessionWaitForRemote.erase(ss);
+    if(ss == m_lanes.slot(Priority::high) || ss == m_lanes.slot(Priority::low)) {
+      BOOST_LOG_TRIVIAL(error) << m_node << ": attempt to reset session priority, ignoring...";
+      return;
+    }
+    switch(prio)
+    {
+      case Priority::low:
       {
-        case Priority::low:
-        {
-          auto sessionToClose = m_sessionL;
-          m_sessionL = ss;
-          BOOST_LOG_TRIVIAL(debug) << m_node << ": got low priority session";
-          if(sessionToClose) {
-            sessionToClose->gracefullClose("overtaken by new connection");
-          }
-          break;
+        auto sessionToClose = std::exchange(m_lanes.slot(Priority::low), ss);
+        BOOST_LOG_TRIVIAL(debug) << m_node << ": got low priority session";
+        lanesChanged();
+        if(sessionToClose) {
+          onSession(sessionToClose, [sessionToClose]() { sessionToClose->gracefullClose("overtaken by new connection"); });
         }
-        case Priority::high:
-        {
-          auto sessionToClose = m_sessionH;
-          m_sessionH = ss;
-          BOOST_LOG_TRIVIAL(debug) << m_node << ": got high priority session";
-          if(sessionToClose) {
-            sessionToClose->gracefullClose("overtaken by new connection");
-          }
-          break;
-        }
-        case Priority::control:
-        {
-          auto sessionToClose = m_sessionC;
-          m_sessionC = ss;
-          BOOST_LOG_TRIVIAL(debug) << m_node << ": got control priority session";
-          if(sessionToClose) {
-            sessionToClose->gracefullClose("overtaken by new connection");
-          }
-          break;
+        break;
+      }
+      case Priority::high:
+      {
+        auto sessionToClose = std::exchange(m_lanes.slot(Priority::high), ss);
+        BOOST_LOG_TRIVIAL(debug) << m_node << ": got high priority session";
+        lanesChanged();
+        if(sessionToClose) {
+          onSession(sessionToClose, [sessionToClose]() { sessionToClose->gracefullClose("overtaken by new connection"); });
         }
-        default:
-        case Priority::undefined:
-        {
-          BOOST_LOG_TRIVIAL(error) << m_node << ": udefined priority from remote!";
-          ss->gracefullClose("got undefined priority from remote");
-          break;
+        break;
+      }
+      case Priority::control:
+      {
+        auto sessionToClose = std::exchange(m_lanes.slot(Priority::control), ss);
+        BOOST_LOG_TRIVIAL(debug) << m_node << ": got control priority session";
+        lanesChanged();
+        if(sessionToClose) {
+          onSession(sessionToClose, [sessionToClose]() { sessionToClose->gracefullClose("overtaken by new connection"); });
         }
+        break;
+      }
+      default:
+      case Priority::undefined:
+      {
+        BOOST_LOG_TRIVIAL(error) << m_node << ": udefined priority from remote!";
+        onSession(ss, [ss]() { ss->gracefullClose("got undefined priority from remote"); });
+        break;
       }
-    } else {
-      BOOST_LOG_TRIVIAL(warning) << m_node << ": session is gone";
     }
   }
 
 
   bool remote::connected() const
   {
-    return m_sessionH && m_sessionL;
+    return m_connected.load(std::memory_order_acquire);
   }
 
-  void remote::onSessionClosed(session::shr_t ss)
+  void remote::onSessionClosed(session::shr_t ss, std::vector<QueuedMsg> unsent)
   {
     BOOST_LOG_TRIVIAL(debug) << "error on session " << ss << ", excluding it from waiting list";
     for(auto ssi = m_sessionWaitForRemote.begin(); ssi != m_sessionWaitForRemote.end(); ++ssi)
@@ -142,20 +194,60 @@ namespace uzel
         break;
       }
     }
-    if(m_sessionH == ss) m_sessionH.reset();
-    if(m_sessionL == ss) m_sessionL.reset();
-    if(m_sessionC == ss) m_sessionC.reset();
+      // what was not sent yet (also by an overtaken lane) fails over to the lanes left
+    const auto count = m_lanes.close(ss, std::move(unsent));
+    setConnected();
+    if(count > 0) {
+      BOOST_LOG_TRIVIAL(debug) << m_node << ": " << count << " messages of the closed session " << ss << " go to another lane";
+      flushQueues();
+    }
+  }
+
+
+  void remote::flushQueues()
+  {
+    for(auto prio : {Priority::high, Priority::low}) {
+      auto ss = m_lanes.lane(prio);
+      if(!ss || m_lanes.queue(prio).empty()) continue;
+      onSession(ss, [ss, msgs = m_lanes.queue(prio).take_all()]() mutable { ss->takeOverMessages(std::move(msgs)); });
+    }
+  }
+
+
+  void remote::lanesChanged()
+  {
+    setConnected();
+    flushQueues();
+  }
+
+
+  void remote::setConnected()
+  {
+    const auto connected = m_lanes.connected();
+    if(m_connected.exchange(connected, std::memory_order_acq_rel) != connected) {
+      s_connected(connected);
+    }
   }
 
 
   void remote::send(uzel::Msg::shr_t msg)
   {
-    if(!connected())
-    {
+    dispatch(m_strand, [this, msg = std::move(msg)]() mutable { queueMsg(std::move(msg)); });
+  }
+
+
+  void remote::queueMsg(uzel::Msg::shr_t msg)
+  {
+    if(msg->expired()) {
+      m_netctx->msgExpired(msg->dest());
+      return;
+    }
+    const auto prio = msg->hdr().priority;
+    if(auto ss = m_lanes.lane(prio)) {
+      onSession(ss, [ss, msg = std::move(msg)]() { ss->putOutQueue(msg); });
+    } else if(!m_lanes.queue(prio).push(QueuedMsg(msg))) {
         // no connection
-      m_outHighQueue.emplace_back(QueuedMsg(msg));
-    } else {
-      m_sessionH->putOutQueue(msg);
+      BOOST_LOG_TRIVIAL(warning) << "queue for disconnected '" << m_node << "' is full, message to " << msg->dest() << " is dropped";
     }
   }
 
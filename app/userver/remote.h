@@ -1,22 +1,39 @@
 #include "uzel/netappcontext.h"
+#include <uzel/lanes.h>
+#include <uzel/registry.h>
 #include <uzel/session.h>
 
+#include <boost/signals2.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 #pragma once
 
 namespace uzel
 {
 
-/** incapsulates logical channel to one remote */
+/**
+ * incapsulates logical channel to one remote
+ *
+ * The lanes and queues are changed on own strand only, the public
+ * methods can be called from any thread. The work for the strand and
+ * for the sessions goes through Dispatch, so a sharded server can pass
+ * it between the shards.
+ * */
   class remote
   {
   public:
-    explicit remote(NetAppContext::shr_t netctx, std::string nodename);
+      /** run the work on the executor, boost::asio::dispatch() by default */
+    using Dispatch = std::function<void (const boost::asio::any_io_executor &executor, std::function<void ()> work)>;
+
+    explicit remote(NetAppContext::shr_t netctx, std::string nodename, Dispatch dispatch = {});
 
     remote &operator=(const remote &) = delete;
     remote(const remote &other) = delete;
-    remote(remote &&) = default;
+    remote(remote &&) = delete; // the queues can not move
     remote &operator=(remote &&) = delete;
     ~remote() = default;
 
@@ -24,22 +41,39 @@ namespace uzel
     void send(uzel::Msg::shr_t msg);
     [[nodiscard]] bool connected() const;
     void handlePriorityMsg(const uzel::Msg &msg);
+
+      // NOLINTBEGIN(misc-non-private-member-variables-in-classes,cppcoreguidelines-non-private-member-variables-in-classes)
+      /** the high and low lanes went up or down, emitted on the strand */
+    boost::signals2::signal<void (bool connected)> s_connected;
+      // NOLINTEND(misc-non-private-member-variables-in-classes,cppcoreguidelines-non-private-member-variables-in-classes)
   private:
     explicit remote(std::string &&nodeName);
 
-    void onSessionClosed(session::shr_t ss);
+    void assignSession(session::shr_t ss);
+    void assignPriority(session::shr_t ss, Priority prio);
+    void queueMsg(uzel::Msg::shr_t msg);
+      /** @param unsent messages taken from the closed session */
+    void onSessionClosed(session::shr_t ss, std::vector<QueuedMsg> unsent);
+      /** hand the waiting messages to the lanes which are up */
+    void flushQueues();
+      /** the lanes were changed: update connected() and flush the queues */
+    void lanesChanged();
+      /** update connected(), s_connected when it changes */
+    void setConnected();
+    void dispatch(const boost::asio::any_io_executor &executor, std::function<void ()> work);
+      /** work on the executor of the session */
+    void onSession(const session::shr_t &ss, std::function<void ()> work) { dispatch(ss->executor(), std::move(work)); }
 
+    NetAppContext::shr_t m_netctx;
+    Dispatch m_dispatch;
+    boost::asio::any_io_executor m_strand;
     std::string m_node; ///< remote node name - known only after authentication
     std::string m_hname; ///< remote hostname (if known) that was used to connect to
     std::string m_addr; ///< last known remote address
     std::unordered_set<session::shr_t> m_sessionWaitForRemote; ///!< keeps list of tcp sessions
-    session::shr_t m_sessionH; ///< high priority session
-    session::shr_t m_sessionL; ///< low priority session
-    session::shr_t m_sessionC; ///< control session (always outgoing), if low and high are incoming
-    MsgQueue m_outHighQueue; ///< high prirority outgoing message queue
-    MsgQueue m_outLowQueue; ///< low priority outgoing message queue
-    NetAppContext::shr_t m_netctx;
+    Lanes<session::shr_t> m_lanes; ///< sessions by priority and the queues of messages waiting for them
+    std::atomic<bool> m_connected{false}; ///< high and low lanes are up
   };
 
-  using NodeToSession = std::unordered_map<std::string, remote>;
+  using NodeToSession = Registry<std::string, std::shared_ptr<remote>>;
 }
@@ -0,0 +1,140 @@
+#include "shards.h"
+#include "netserver.h"
+
+#include <boost/log/trivial.hpp>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+namespace
+{
+    /** shard run by the calling thread */
+  thread_local std::optional<unsigned> currentShard;
+}
+
+ShardSet::ShardSet(unsigned count)
+{
+  count = std::max(1U, count);
+  for(unsigned i = 0; i < count; ++i) {
+    m_shards.push_back(std::make_unique<Shard>());
+  }
+  for(unsigned i = 0; i < count*count; ++i) {
+    m_mailboxes.push_back(std::make_unique<Mailbox>());
+  }
+}
+
+
+unsigned ShardSet::home(const std::string &node) const
+{
+  return static_cast<unsigned>(std::hash<std::string>()(node) % m_shards.size());
+}
+
+
+void ShardSet::attach(unsigned id, NetServer &server, boost::asio::io_context &ioc)
+{
+  m_shards.at(id)->server = &server;
+  m_shards[id]->ioc = &ioc;
+}
+
+
+void ShardSet::send(unsigned from, unsigned to, Letter letter)
+{
+  auto &box = mailbox(from, to);
+    // keep the order: once something waits in the backlog, the rest waits behind it
+  if(!box.backlog.empty() || !box.ring.push(letter)) {
+    box.backlog.push_back(std::move(letter));
+    if(!box.retryPending) {
+      box.retryPending = true;
+      boost::asio::post(*m_shards[from]->ioc, [this, from, to]() { retry(from, to); });
+    }
+  }
+  wake(to);
+}
+
+
+void ShardSet::dispatch(const boost::asio::any_io_executor &executor, std::function<void ()> work)
+{
+  const auto to = shardOf(executor);
+  if(!currentShard || to == size() || to == *currentShard) {
+    boost::asio::dispatch(executor, std::move(work));
+    return;
+  }
+  send(*currentShard, to, Letter{Route::work, {}, {}, std::move(work)});
+}
+
+
+unsigned ShardSet::shardOf(const boost::asio::any_io_executor &executor) const
+{
+  const auto *context = &executor.context();
+  for(unsigned id = 0; id < size(); ++id) {
+    if(static_cast<const boost::asio::execution_context *>(m_shards[id]->ioc) == context) return id;
+  }
+  return size();
+}
+
+
+void ShardSet::wake(unsigned to)
+{
+    // pairs with the fence in drain(): either it sees the letter or we see it is not woken
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto &shard = *m_shards[to];
+  if(!shard.woken.exchange(true)) {
+    boost::asio::post(*shard.ioc, [this, to]() { drain(to); });
+  }
+}
+
+
+void ShardSet::drain(unsigned to)
+{
+  auto &shard = *m_shards[to];
+  shard.woken.store(false);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool more{false};
+  for(unsigned from = 0; from < size(); ++from) {
+    if(from == to) continue;
+    auto &ring = mailbox(from, to).ring;
+      // at most one ring full at once, so a busy sender does not starve the rest
+    for(std::size_t n = 0; n < ring.capacity(); ++n) {
+      auto letter = ring.pop();
+      if(!letter) break;
+      shard.server->deliver(std::move(*letter));
+      more = more || n + 1 == ring.capacity();
+    }
+  }
+  if(more) {
+    wake(to);
+  }
+}
+
+
+void ShardSet::retry(unsigned from, unsigned to)
+{
+  auto &box = mailbox(from, to);
+  box.retryPending = false;
+  while(!box.backlog.empty() && box.ring.push(box.backlog.front())) {
+    box.backlog.pop_front();
+  }
+  wake(to);
+  if(!box.backlog.empty()) {
+    box.retryPending = true;
+    boost::asio::post(*m_shards[from]->ioc, [this, from, to]() { retry(from, to); });
+  }
+}
+
+
+void ShardSet::run(unsigned id)
+{
+  const auto cores = std::max(1U, std::thread::hardware_concurrency());
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(id % cores, &cpus);
+  if(const int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus); err != 0) {
+    BOOST_LOG_TRIVIAL(warning) << "can not pin shard " << id << " to core " << id % cores << ": " << std::strerror(err);
+  }
+  currentShard = id;
+  m_shards.at(id)->ioc->run();
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <uzel/msg.h>
+#include <uzel/registry.h>
+#include <uzel/spscqueue.h>
+
+#include <boost/asio.hpp>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class NetServer;
+
+namespace uzel
+{
+  class session;
+}
+
+  /** what the shard receiving a message from another shard does with it */
+enum class Route : std::uint8_t
+{
+  local,          //!< to the local app connected to that shard
+  localBroadcast, //!< to the local apps connected to that shard
+  remote,         //!< to the remote node that shard owns
+  broadcast,      //!< to the remote nodes that shard owns
+  attach,         //!< the session, authenticated by a remote node that shard owns, becomes a lane of its channel
+  priority,       //!< the priority message assigns the lane of its session on the channel that shard owns
+  takeOver,       //!< the local app reconnected as the session to the sender, the messages queued for it go there
+  work            //!< run the work on that shard (see ShardSet::dispatch())
+};
+
+  /** message (or other thing) passed between the shards */
+struct Letter
+{
+  Route route;
+  uzel::Msg::shr_t msg;
+  std::shared_ptr<uzel::session> session; //!< attach, takeOver
+  std::function<void ()> work;
+};
+
+
+/**
+ * Shards of the thread-per-core userver.
+ *
+ * Every shard is a NetServer with own io_context run by one thread, own
+ * acceptor (the port is shared with SO_REUSEPORT), sessions and
+ * dispatcher. The routing tables are partitioned: a local app belongs to
+ * the shard which accepted it (see localApps()), a remote node to the
+ * shard given by home(). Messages for another shard go through the
+ * mailbox of that pair of shards, a lock-free SpscQueue; the receiving
+ * io_context is woken once per batch, not per message.
+ *
+ * Shards share nothing but the mailboxes and the directories here: a
+ * shard changes the objects of another one (the channel to a remote
+ * node, the sessions of its lanes, the local apps) only by a letter.
+ * */
+class ShardSet
+{
+public:
+  explicit ShardSet(unsigned count);
+
+  ShardSet(const ShardSet &) = delete;
+  ShardSet(ShardSet &&) = delete;
+  ShardSet &operator=(const ShardSet &) = delete;
+  ShardSet &operator=(ShardSet &&) = delete;
+  ~ShardSet() = default;
+
+  [[nodiscard]] unsigned size() const { return static_cast<unsigned>(m_shards.size()); }
+    /** shard owning the channel to the remote node (or host to connect to) */
+  [[nodiscard]] unsigned home(const std::string &node) const;
+
+    /** the server of shard id, all shards must be attached before any runs */
+  void attach(unsigned id, NetServer &server, boost::asio::io_context &ioc);
+    /** shard each local app is connected to */
+  [[nodiscard]] uzel::Registry<std::string, unsigned> &localApps() { return m_localApps; }
+    /** remote nodes with a channel, whether their high and low lanes are up; written by the home shard */
+  [[nodiscard]] uzel::Registry<std::string, bool> &remoteNodes() { return m_remoteNodes; }
+
+    /** called on shard from: NetServer::deliver() the letter on shard to */
+  void send(unsigned from, unsigned to, Letter letter);
+    /**
+     * run work on the thread of the shard running executor: right away
+     * if it is the calling one, otherwise as a letter from the calling
+     * shard (or posted when not called by a shard)
+     * */
+  void dispatch(const boost::asio::any_io_executor &executor, std::function<void ()> work);
+    /** run shard id on the calling thread, pinned to a core */
+  void run(unsigned id);
+
+private:
+  static constexpr std::size_t MailboxSize = 4096;
+
+  struct Mailbox
+  {
+    uzel::SpscQueue<Letter> ring{MailboxSize};
+    std::deque<Letter> backlog; //!< did not fit into the ring, touched by the sender only
+    bool retryPending{false};   //!< the sender will move the backlog to the ring
+  };
+
+  struct Shard
+  {
+    NetServer *server{nullptr};
+    boost::asio::io_context *ioc{nullptr};
+    std::atomic<bool> woken{false}; //!< drain() is posted already
+  };
+
+  [[nodiscard]] Mailbox &mailbox(unsigned from, unsigned to) { return *m_mailboxes[from*size() + to]; }
+    /** shard running the executor, size() if none */
+  [[nodiscard]] unsigned shardOf(const boost::asio::any_io_executor &executor) const;
+    /** post drain() to shard to, unless it is pending already */
+  void wake(unsigned to);
+    /** deliver the letters sent to shard to, on its thread */
+  void drain(unsigned to);
+    /** move the backlog of the mailbox to the ring, on the thread of shard from */
+  void retry(unsigned from, unsigned to);
+
+  std::vector<std::unique_ptr<Shard>> m_shards;
+  std::vector<std::unique_ptr<Mailbox>> m_mailboxes; //!< from*size() + to
+  uzel::Registry<std::string, unsigned> m_localApps;
+  uzel::Registry<std::string, bool> m_remoteNodes;
+};
@@ -96,7 +96,9 @@ namespace uzel {
     BOOST_LOG_TRIVIAL(debug) << DBGOUT << " resolving " << rh->hostname() << "...";
     m_netctx->aresolver().async_resolve<tcp>(rh->hostname(), rh->service(),
                                              [this, rh](const sys::error_code ec, const tcp::resolver::results_type resit){
-                                               connectResolved(ec,resit,rh);
+                                               boost::asio::dispatch(m_strand, [this, rh, ec, resit]() {
+                                                 connectResolved(ec, resit, rh);
+                                               });
                                              });
   }
 
@@ -154,14 +156,16 @@ namespace uzel {
     size_t unauthsessions{0};
     size_t sessionsToCreate{0};
 
-    auto ipit = m_ipToSession.find(rezit->endpoint().address());
+    std::vector<session::shr_t> ipSessions = m_ipToSession.read(rezit->endpoint().address(), [](const auto *found) {
+      return found == nullptr ? std::vector<session::shr_t>{} : std::vector<session::shr_t>(found->begin(), found->end());
+    });
 
-    if(ipit == m_ipToSession.end()|| ipit->second.empty()) {
+    if(ipSessions.empty()) {
       BOOST_LOG_TRIVIAL(debug) << "there are no sessions for IP '"<< rezit->endpoint()
                                << ", will create "<< rh->wantedConnections()<< " connections";
       sessionsToCreate = rh->wantedConnections();
     } else {
-      for(auto && sit : ipit->second) {
+      for(auto && sit : ipSessions) {
         BOOST_LOG_TRIVIAL(debug) << "found session "<< sit << " for IP '"<< rezit->endpoint();
         if(sit->direction() == +uzel::Direction::outgoing) {
           BOOST_LOG_TRIVIAL(debug) << "it is outgoing";
@@ -218,15 +222,18 @@ namespace uzel {
     rh->setStatus(HostStatus::connecting);
     while(sessionsToCreate != 0)
     {
-      tcp::socket sock{m_netctx->iocontext()};
+      tcp::socket sock{m_netctx->makeStrand()};
       auto unauth = std::make_shared<uzel::session>(m_netctx, std::move(sock), uzel::Direction::outgoing, rezit->endpoint().address(), rh->hostname());
       BOOST_LOG_TRIVIAL(debug) << "session '"<<unauth << "' created outgoing";
       s_sessionCreated(unauth);
 
-      unauth->s_closed.connect([&,rh]() {
-        rh->setStatus(HostStatus::closed);
-          // poke, so we will try to reconnect if necessary
-        poke();
+      unauth->s_closed.connect([this, rh]() {
+          // emitted on the executor of the session
+        boost::asio::dispatch(m_strand, [this, rh]() {
+          rh->setStatus(HostStatus::closed);
+            // poke, so we will try to reconnect if necessary
+          poke();
+        });
       });
 
         // follwoing not needed, as session::s_closed() will be fired:
@@ -1,53 +1,95 @@
 #pragma once
 
+#include "linescan.h"
+
+#include <algorithm>
+#include <cstddef>
 #include <optional>
 #include <string_view>
-#include <string>
+#include <vector>
 
 
 /**
- * @brief Аккумулятор строк.
- * Аккумулятор строк получает на вход поток символов поблочно и
- * разделяет его на отдельные строки (команды), разделённые с помощью
- * перевода строки
+ * @brief Разделитель строк.
+ * Получает на вход поток символов поблочно и разделяет его на
+ * отдельные строки (команды), разделённые с помощью перевода строки.
+ *
+ * Строки не копируются, возвращаются ссылки на входной блок. Поэтому
+ * незаконченная строка не накапливается внутри: вызывающий должен
+ * сохранить необработанный остаток (rest()) и передать его в начале
+ * следующего блока. Уже просканированная часть остатка повторно не
+ * сканируется.
+ *
+ * Переводы строк ищутся векторным сканером (uzel::linescan) сразу для
+ * целого куска блока (до ScanBlock байт), а не по одной строке.
  * */
 class AccuLine
 {
 public:
-    /** Запомнить для обработки очередной блок символов */
+    /** сколько байт сканировать за один проход */
+  static constexpr std::size_t ScanBlock = 64UL*1024;
+
+    /**
+     * Запомнить для обработки очередной блок символов.
+     * Блок должен начинаться с остатка предыдущего блока (rest()).
+     * */
   void addNewInput(const std::string_view &inputstr)
   {
-    m_curline = inputstr;
+    m_input = inputstr;
+    m_pos = 0;
+    m_scanned = std::min(m_carry, m_input.size());
+    m_eols.clear();
+    m_nextEol = 0;
   }
 
     /**
      * Получить следующую комнду.
-     * Остаток неполной команды без завершающего перевода строки
-     * записывается в m_cmd
-     * @return строка или пустое значение, если больше полных строк нет
+     * @return строка без перевода строки (ссылка на входной блок) или
+     * пустое значение, если больше полных строк нет
      * */
-  std::optional<std::string> getNextCmd()
+  std::optional<std::string_view> getNextCmd()
   {
-    if(m_curline.empty()) return {};
-    bool complete{true};
-    auto eolpos = m_curline.find_first_of('\n');
-    std::string_view newcmd;
-    if(eolpos == std::string::npos) {
-      newcmd = m_curline;
-      m_curline.remove_prefix(m_curline.length());
-      complete = false;
-    } else {
-      newcmd = m_curline.substr(0, eolpos);
-      m_curline.remove_prefix(eolpos+1);
+    if(m_nextEol == m_eols.size() && !scanMore()) {
+      m_carry = m_input.size() - m_pos;
+      return {};
     }
-    m_cmd += newcmd;
-    if(!complete) return {};
-    std::string cmd = m_cmd;
-    m_cmd.clear();
+    const auto eolpos = m_eols[m_nextEol++];
+    auto cmd = m_input.substr(m_pos, eolpos - m_pos);
+    m_pos = eolpos + 1;
+    m_carry = 0;
     return cmd;
   }
 
+    /** @return true если нет остатка незаконченной команды */
+  [[nodiscard]] bool idle() const { return m_carry == 0; }
+
+    /** @return необработанный остаток текущего блока */
+  [[nodiscard]] std::string_view rest() const { return m_input.substr(m_pos); }
+
+    /** забыть остаток, следующий блок начинается с новой строки */
+  void reset() { m_carry = 0; }
+
 private:
-  std::string m_cmd; ///!< остаток незаконченной команды из предыдущего блока
-  std::string_view m_curline; ///!< текущий блок (уменьшается по мере обработки)
+    /**
+     * Найти переводы строк в следующем куске блока
+     * @return false если блок просканирован до конца и строк больше нет
+     * */
+  bool scanMore()
+  {
+    m_eols.clear();
+    m_nextEol = 0;
+    while(m_eols.empty() && m_scanned < m_input.size()) {
+      const auto len = std::min(ScanBlock, m_input.size() - m_scanned);
+      uzel::linescan::findAll(m_input.substr(m_scanned, len), m_scanned, m_eols);
+      m_scanned += len;
+    }
+    return !m_eols.empty();
+  }
+
+  std::string_view m_input; ///!< текущий блок
+  std::size_t m_pos{0}; ///!< начало необработанной части текущего блока
+  std::size_t m_scanned{0}; ///!< сколько байт блока уже просканировано
+  std::size_t m_carry{0}; ///!< длина незаконченной строки в конце блока (уже просканирована)
+  std::vector<std::size_t> m_eols; ///!< найденные, но ещё не выданные переводы строк
+  std::size_t m_nextEol{0}; ///!< индекс следующего перевода строки в m_eols
 };
@@ -1,11 +1,10 @@
 #include "addr.h"
 
 #include <string>
-#include <utility>
 
 namespace uzel {
-  Addr::Addr(std::string appname, std::string nodename)
-    : m_appname(std::move(appname)), m_nodename(std::move(nodename))
+  Addr::Addr(const std::string &appname, const std::string &nodename)
+    : m_appname(appname), m_nodename(nodename)
   {
   }
 
@@ -21,7 +20,7 @@ namespace uzel {
   }
 
   std::ostream &operator<<(std::ostream &os, const Addr &addr) {
-    if (addr.m_appname.empty() && addr.m_nodename.empty()) {
+    if (addr.empty()) {
       os << "<>";
       return os;
     }
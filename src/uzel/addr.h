@@ -1,5 +1,7 @@
 #pragma once
 
+#include "atom.h"
+
 #include <ostream>
 #include <string>
 
@@ -10,18 +12,22 @@ namespace uzel
   {
   public:
     Addr() = default;
-    Addr(std::string appname, std::string nodename);
+    Addr(const std::string &appname, const std::string &nodename);
+    Addr(Atom appname, Atom nodename) : m_appname(appname), m_nodename(nodename) {}
       /** Same as above, but address in one string
        * @param fulladdr <appname>[@<nodename>]
        */
     explicit Addr(const std::string &fulladdr);
-    [[nodiscard]] const std::string& app() const {return m_appname;}
-    [[nodiscard]] const std::string& node() const {return m_nodename;}
+    [[nodiscard]] const std::string& app() const {return m_appname.str();}
+    [[nodiscard]] const std::string& node() const {return m_nodename.str();}
+    [[nodiscard]] Atom appAtom() const {return m_appname;}
+    [[nodiscard]] Atom nodeAtom() const {return m_nodename;}
+    [[nodiscard]] bool empty() const {return m_appname.empty() && m_nodename.empty();}
     friend std::ostream& operator<<(std::ostream& os, const Addr& addr);
   private:
     Addr(const std::string &fulladdr, size_t atpos);
-    std::string m_appname;
-    std::string m_nodename;
+    Atom m_appname;
+    Atom m_nodename;
   };
 
   std::ostream &operator<<(std::ostream &os, const Addr &addr);
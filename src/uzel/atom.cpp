@@ -0,0 +1,120 @@
+#include "atom.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace uzel
+{
+  namespace
+  {
+      /**
+       * process-wide intern table, id 0 is the empty string
+       *
+       * Entries are appended to fixed size chunks which never move, a
+       * chunk is published with release, so str() reads without a lock.
+       * */
+    class AtomTable
+    {
+    public:
+      static constexpr std::uint32_t ChunkSize = 1024;
+      static constexpr std::uint32_t MaxChunks = 64;
+      static constexpr std::uint32_t MaxAtoms = ChunkSize*MaxChunks;
+
+      AtomTable() { append(""); }
+
+        /** @return the id of str or 0 if it is not interned */
+      std::uint32_t find(std::string_view str)
+      {
+        if(str.empty()) return 0;
+        const std::shared_lock lock(m_mutex);
+        auto it = m_ids.find(str);
+        return it == m_ids.end() ? 0 : it->second;
+      }
+
+        /** @return the id of str or 0 if the table is full */
+      std::uint32_t intern(std::string_view str)
+      {
+        if(str.empty()) return 0;
+        if(auto id = find(str)) return id;
+        const std::unique_lock lock(m_mutex);
+        if(auto it = m_ids.find(str); it != m_ids.end()) {
+          return it->second;
+        }
+        if(m_size == MaxAtoms) return 0;
+        return append(str);
+      }
+
+      const Atom::Entry &entry(std::uint32_t id) const
+      {
+          // the id was handed out after its entry was written
+        return m_published[id / ChunkSize].load(std::memory_order_acquire)[id % ChunkSize];
+      }
+
+    private:
+      std::uint32_t append(std::string_view str)
+      {
+        const auto id = m_size;
+        if(id % ChunkSize == 0) {
+          m_chunks.push_back(std::make_unique<Atom::Entry[]>(ChunkSize));
+          m_published[id / ChunkSize].store(m_chunks.back().get(), std::memory_order_release);
+        }
+        auto &stored = m_chunks.back()[id % ChunkSize];
+        stored.str = str;
+        stored.hash = std::hash<std::string_view>()(str);
+        m_ids.emplace(stored.str, id);
+        ++m_size;
+        return id;
+      }
+
+      std::shared_mutex m_mutex;
+      std::vector<std::unique_ptr<Atom::Entry[]>> m_chunks;
+      std::array<std::atomic<Atom::Entry *>, MaxChunks> m_published{};
+      std::uint32_t m_size{0};
+      std::unordered_map<std::string_view, std::uint32_t> m_ids;
+    };
+
+    AtomTable &table()
+    {
+      static AtomTable atoms;
+      return atoms;
+    }
+  }
+
+
+  Atom::Atom(std::string_view str)
+    : m_id(table().find(str))
+  {
+    if(m_id == 0 && !str.empty()) {
+      m_own = std::make_shared<const Entry>(Entry{std::string(str), std::hash<std::string_view>()(str)});
+    }
+  }
+
+  Atom Atom::intern(std::string_view str)
+  {
+    Atom atom;
+    atom.m_id = table().intern(str);
+    if(atom.m_id == 0 && !str.empty()) {
+      return Atom(str);
+    }
+    return atom;
+  }
+
+  const std::string &Atom::str() const
+  {
+    return m_own ? m_own->str : table().entry(m_id).str;
+  }
+
+  std::size_t Atom::hash() const
+  {
+    return m_own ? m_own->hash : table().entry(m_id).hash;
+  }
+
+  bool Atom::equalStr(const Atom &lhs, const Atom &rhs)
+  {
+    return lhs.hash() == rhs.hash() && lhs.str() == rhs.str();
+  }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace uzel
+{
+    /**
+     * Interned string.
+     *
+     * Node names, app names and cnames are taken from a small set, so
+     * they are stored once in the process-wide table and referred to
+     * by a 32 bit id. Comparing interned atoms is comparing integers,
+     * copying one never allocates. Interned strings are never released,
+     * so str() references stay valid.
+     *
+     * Only intern() adds to the table: configured names, registered
+     * handlers and authenticated peers. An atom constructed from a
+     * string which is not interned keeps its own copy, so names a peer
+     * makes up do not grow the table. Such atoms compare by string.
+     * */
+  class Atom
+  {
+  public:
+      /** empty string */
+    Atom() = default;
+      /** the interned string or an own copy of it, never adds to the table */
+    explicit Atom(std::string_view str);
+      /** add str to the table, an own copy if the table is full */
+    static Atom intern(std::string_view str);
+
+    [[nodiscard]] const std::string &str() const;
+    [[nodiscard]] std::size_t hash() const;
+    [[nodiscard]] bool interned() const { return !m_own; }
+    [[nodiscard]] bool empty() const { return m_id == 0 && !m_own; }
+
+    friend bool operator==(const Atom &lhs, const Atom &rhs)
+    {
+      if(!lhs.m_own && !rhs.m_own) return lhs.m_id == rhs.m_id;
+      return equalStr(lhs, rhs);
+    }
+    friend bool operator!=(const Atom &lhs, const Atom &rhs) { return !(lhs == rhs); }
+
+      /** interned string or own copy */
+    struct Entry
+    {
+      std::string str;
+      std::size_t hash{0};
+    };
+
+  private:
+    static bool equalStr(const Atom &lhs, const Atom &rhs);
+
+    std::uint32_t m_id{0};
+    std::shared_ptr<const Entry> m_own; //!< not interned
+  };
+
+  inline std::ostream &operator<<(std::ostream &os, const Atom &atom) { return os << atom.str(); }
+}
+
+template<>
+struct std::hash<uzel::Atom>
+{
+  std::size_t operator()(const uzel::Atom &atom) const noexcept { return atom.hash(); }
+};
@@ -0,0 +1,103 @@
+#include "attachment.h"
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+namespace uzel
+{
+  namespace
+  {
+    std::runtime_error sysError(const std::string &what, const std::string &path)
+    {
+      return std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+    }
+
+      /** last path component, so the sender can not choose the directory */
+    std::string baseName(const std::string &name)
+    {
+      auto base = boost::filesystem::path(name).filename().string();
+      if(base.empty() || base == "." || base == "..") return "attachment";
+      return base;
+    }
+  }
+
+
+  Attachment::Attachment(int fd, std::string path, std::string name, std::uint64_t size, bool temporary)
+    : m_fd(fd), m_path(std::move(path)), m_name(std::move(name)), m_size(size), m_temporary(temporary)
+  {
+  }
+
+
+  Attachment::~Attachment()
+  {
+    ::close(m_fd);
+    if(m_temporary) {
+      ::unlink(m_path.c_str());
+    }
+  }
+
+
+  Attachment::shr_t Attachment::open(const std::string &path)
+  {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC); //NOLINT(cppcoreguidelines-pro-type-vararg)
+    if(fd < 0) {
+      throw sysError("can not open attachment", path);
+    }
+    struct stat st{};
+    if(::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      ::close(fd);
+      throw std::runtime_error("attachment '" + path + "' is not a regular file");
+    }
+    return shr_t(new Attachment(fd, path, baseName(path), static_cast<std::uint64_t>(st.st_size), false));
+  }
+
+
+  Attachment::shr_t Attachment::spool(const std::string &spoolDir, const std::string &name, std::uint64_t size)
+  {
+    static std::atomic<std::uint64_t> counter{0};
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(spoolDir, ec);
+    if(ec) {
+      throw std::runtime_error("can not create spool directory '" + spoolDir + "': " + ec.message());
+    }
+    struct statvfs fs{};
+    if(::statvfs(spoolDir.c_str(), &fs) != 0) {
+      throw sysError("can not check free space of spool directory", spoolDir);
+    }
+    if(static_cast<std::uint64_t>(fs.f_bavail) < size / fs.f_frsize + 1) {
+      throw std::runtime_error("no room for attachment of " + std::to_string(size) + " bytes in '" + spoolDir + "'");
+    }
+    auto base = baseName(name);
+    const auto path = (boost::filesystem::path(spoolDir) /
+                       (std::to_string(::getpid()) + "-" + std::to_string(++counter) + "-" + base)).string();
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600); //NOLINT(cppcoreguidelines-pro-type-vararg)
+    if(fd < 0) {
+      throw sysError("can not create attachment", path);
+    }
+    return shr_t(new Attachment(fd, path, std::move(base), size, true));
+  }
+
+
+  void Attachment::moveTo(const std::string &path)
+  {
+    boost::system::error_code ec;
+    boost::filesystem::rename(m_path, path, ec);
+    if(ec) {
+        // other file system
+      boost::filesystem::copy_file(m_path, path, ec);
+      if(ec) {
+        throw std::runtime_error("can not move attachment to '" + path + "': " + ec.message());
+      }
+      ::unlink(m_path.c_str());
+    }
+    m_path = path;
+    m_temporary = false;
+  }
+}
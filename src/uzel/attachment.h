@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace uzel
+{
+    /**
+     * File attached to a message.
+     *
+     * The file is sent right after the message frame (see
+     * frame::Attached) from the page cache with sendfile() and is
+     * received with splice() into a file in the spool directory, so
+     * its content never passes through user space buffers. The file
+     * is shared by all copies of the message (forwarding, broadcast),
+     * each session keeps its own position in it.
+     *
+     * Received files are removed when the last message referring to
+     * them is destroyed, unless the handler moved them away with
+     * moveTo().
+     * */
+  class Attachment
+  {
+  public:
+    using shr_t = std::shared_ptr<Attachment>;
+
+      /**
+       * open file to send
+       * @throw std::runtime_error if the file can not be opened
+       * */
+    [[nodiscard]] static shr_t open(const std::string &path);
+
+      /**
+       * create new file in the spool directory to receive into
+       * @param name file name given by the sender, only the last path component is used
+       * @param size expected size of the file
+       * @throw std::runtime_error if the file can not be created or
+       * there is no room for it in the spool directory
+       * */
+    [[nodiscard]] static shr_t spool(const std::string &spoolDir, const std::string &name, std::uint64_t size);
+
+    Attachment(const Attachment &) = delete;
+    Attachment(Attachment &&) = delete;
+    Attachment &operator=(const Attachment &) = delete;
+    Attachment &operator=(Attachment &&) = delete;
+    ~Attachment();
+
+    [[nodiscard]] const std::string &path() const { return m_path; }
+      /** file name without directory, as sent to the peer */
+    [[nodiscard]] const std::string &name() const { return m_name; }
+    [[nodiscard]] std::uint64_t size() const { return m_size; }
+    [[nodiscard]] int fd() const { return m_fd; }
+
+      /**
+       * move the received file out of the spool directory, so it is
+       * kept after the message is destroyed
+       * @throw std::runtime_error if the file can not be moved
+       * */
+    void moveTo(const std::string &path);
+
+  private:
+    Attachment(int fd, std::string path, std::string name, std::uint64_t size, bool temporary);
+
+    int m_fd;
+    std::string m_path;
+    std::string m_name;
+    std::uint64_t m_size;
+    bool m_temporary; //!< spooled file, removed in destructor
+  };
+}
@@ -0,0 +1,512 @@
+#include "binbody.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace uzel::binbody
+{
+  namespace
+  {
+      /** protects stack from too deeply nested input, the same as for json */
+    constexpr std::size_t MaxDepth = 512;
+
+    template<typename Buf>
+    void putBE(Buf &out, std::uint64_t val, std::size_t bytes)
+    {
+      for(std::size_t ii = bytes; ii > 0; --ii) {
+        out.push_back(static_cast<char>((val >> (8 * (ii - 1))) & 0xFFU));
+      }
+    }
+
+    template<typename Buf>
+    void putBytes(Buf &out, std::string_view str)
+    {
+      out.insert(out.end(), str.begin(), str.end());
+    }
+
+      /** @return true if the double can be sent as float without loss */
+    bool fitsFloat(double val)
+    {
+      if(std::isnan(val)) return true;
+      if(std::abs(val) > std::numeric_limits<float>::max()) return std::isinf(val);
+      return static_cast<double>(static_cast<float>(val)) == val;
+    }
+
+    std::uint32_t floatBits(float val)
+    {
+      std::uint32_t bits{0};
+      std::memcpy(&bits, &val, sizeof(bits));
+      return bits;
+    }
+
+    std::uint64_t doubleBits(double val)
+    {
+      std::uint64_t bits{0};
+      std::memcpy(&bits, &val, sizeof(bits));
+      return bits;
+    }
+
+
+    template<typename Buf>
+    class MsgpackWriter
+    {
+    public:
+      explicit MsgpackWriter(Buf &out) : m_out(out) {}
+
+      void value(const JValue &val)
+      {
+        switch(val.kind()) {
+        case JValue::Kind::null: put(0xC0); break;
+        case JValue::Kind::boolean: put(val.asBool() ? 0xC3 : 0xC2); break;
+        case JValue::Kind::integer: integer(val.asInt()); break;
+        case JValue::Kind::real: real(val.asDouble()); break;
+        case JValue::Kind::string: string(val.asString()); break;
+        case JValue::Kind::array:
+          header(val.array().size(), 0x90, 0xDC);
+          for(auto &&item : val.array()) value(item);
+          break;
+        case JValue::Kind::object:
+          header(val.object().size(), 0x80, 0xDE);
+          for(auto &&member : val.object()) {
+            string(member.first);
+            value(member.second);
+          }
+          break;
+        }
+      }
+
+    private:
+      void put(unsigned byte) { m_out.push_back(static_cast<char>(byte)); }
+
+      void integer(std::int64_t val)
+      {
+        if(val >= 0) {
+          const auto uval = static_cast<std::uint64_t>(val);
+          if(uval < 0x80) put(static_cast<unsigned>(uval));
+          else if(uval <= 0xFF) { put(0xCC); putBE(m_out, uval, 1); }
+          else if(uval <= 0xFFFF) { put(0xCD); putBE(m_out, uval, 2); }
+          else if(uval <= 0xFFFFFFFF) { put(0xCE); putBE(m_out, uval, 4); }
+          else { put(0xCF); putBE(m_out, uval, 8); }
+          return;
+        }
+        const auto bits = static_cast<std::uint64_t>(val);
+        if(val >= -32) put(static_cast<unsigned>(bits & 0xFFU));
+        else if(val >= std::numeric_limits<std::int8_t>::min()) { put(0xD0); putBE(m_out, bits, 1); }
+        else if(val >= std::numeric_limits<std::int16_t>::min()) { put(0xD1); putBE(m_out, bits, 2); }
+        else if(val >= std::numeric_limits<std::int32_t>::min()) { put(0xD2); putBE(m_out, bits, 4); }
+        else { put(0xD3); putBE(m_out, bits, 8); }
+      }
+
+      void real(double val)
+      {
+        if(fitsFloat(val)) {
+          put(0xCA);
+          putBE(m_out, floatBits(static_cast<float>(val)), 4);
+        } else {
+          put(0xCB);
+          putBE(m_out, doubleBits(val), 8);
+        }
+      }
+
+      void string(std::string_view str)
+      {
+        const auto len = str.size();
+        if(len < 32) put(0xA0 | static_cast<unsigned>(len));
+        else if(len <= 0xFF) { put(0xD9); putBE(m_out, len, 1); }
+        else if(len <= 0xFFFF) { put(0xDA); putBE(m_out, len, 2); }
+        else { put(0xDB); putBE(m_out, len, 4); }
+        putBytes(m_out, str);
+      }
+
+        /** array or map header, 16 and 32 bit forms follow the 16 bit code */
+      void header(std::size_t len, unsigned fixCode, unsigned code16)
+      {
+        if(len < 16) put(fixCode | static_cast<unsigned>(len));
+        else if(len <= 0xFFFF) { put(code16); putBE(m_out, len, 2); }
+        else { put(code16 + 1); putBE(m_out, len, 4); }
+      }
+
+      Buf &m_out;
+    };
+
+
+    template<typename Buf>
+    class CborWriter
+    {
+    public:
+      explicit CborWriter(Buf &out) : m_out(out) {}
+
+      void value(const JValue &val)
+      {
+        switch(val.kind()) {
+        case JValue::Kind::null: put(0xF6); break;
+        case JValue::Kind::boolean: put(val.asBool() ? 0xF5 : 0xF4); break;
+        case JValue::Kind::integer: {
+          const auto ival = val.asInt();
+          if(ival >= 0) head(0, static_cast<std::uint64_t>(ival));
+          else head(1, static_cast<std::uint64_t>(-(ival + 1)));
+          break;
+        }
+        case JValue::Kind::real: {
+          const auto dval = val.asDouble();
+          if(fitsFloat(dval)) {
+            put(0xFA);
+            putBE(m_out, floatBits(static_cast<float>(dval)), 4);
+          } else {
+            put(0xFB);
+            putBE(m_out, doubleBits(dval), 8);
+          }
+          break;
+        }
+        case JValue::Kind::string: string(val.asString()); break;
+        case JValue::Kind::array:
+          head(4, val.array().size());
+          for(auto &&item : val.array()) value(item);
+          break;
+        case JValue::Kind::object:
+          head(5, val.object().size());
+          for(auto &&member : val.object()) {
+            string(member.first);
+            value(member.second);
+          }
+          break;
+        }
+      }
+
+    private:
+      void put(unsigned byte) { m_out.push_back(static_cast<char>(byte)); }
+
+      void head(unsigned major, std::uint64_t arg)
+      {
+        const unsigned type = major << 5U;
+        if(arg < 24) put(type | static_cast<unsigned>(arg));
+        else if(arg <= 0xFF) { put(type | 24U); putBE(m_out, arg, 1); }
+        else if(arg <= 0xFFFF) { put(type | 25U); putBE(m_out, arg, 2); }
+        else if(arg <= 0xFFFFFFFF) { put(type | 26U); putBE(m_out, arg, 4); }
+        else { put(type | 27U); putBE(m_out, arg, 8); }
+      }
+
+      void string(std::string_view str)
+      {
+        head(3, str.size());
+        putBytes(m_out, str);
+      }
+
+      Buf &m_out;
+    };
+
+
+      /** common input handling of both decoders */
+    class Reader
+    {
+    public:
+      explicit Reader(std::string_view data) : m_data(data) {}
+
+      [[noreturn]] void fail(const char *what) const
+      {
+        throw std::runtime_error(std::string("malformed binary body at position ") + std::to_string(m_pos) + ": " + what);
+      }
+
+      std::uint8_t byte()
+      {
+        if(m_pos == m_data.size()) fail("unexpected end");
+        return static_cast<std::uint8_t>(m_data[m_pos++]);
+      }
+
+      std::uint64_t be(std::size_t bytes)
+      {
+        if(m_data.size() - m_pos < bytes) fail("unexpected end");
+        std::uint64_t val{0};
+        for(std::size_t ii = 0; ii < bytes; ++ii) {
+          val = (val << 8U) | static_cast<std::uint8_t>(m_data[m_pos++]);
+        }
+        return val;
+      }
+
+      std::string_view bytes(std::uint64_t len)
+      {
+        if(m_data.size() - m_pos < len) fail("unexpected end");
+        auto rez = m_data.substr(m_pos, len);
+        m_pos += len;
+        return rez;
+      }
+
+        /**
+         * every element takes at least one byte, so bigger counts
+         * are malformed, check before reserving memory for them
+         * */
+      std::size_t count(std::uint64_t len) const
+      {
+        if(len > m_data.size() - m_pos) fail("length exceeds the data");
+        return static_cast<std::size_t>(len);
+      }
+
+      static float toFloat(std::uint64_t bits)
+      {
+        const auto bits32 = static_cast<std::uint32_t>(bits);
+        float val{0};
+        std::memcpy(&val, &bits32, sizeof(val));
+        return val;
+      }
+
+      static double toDouble(std::uint64_t bits)
+      {
+        double val{0};
+        std::memcpy(&val, &bits, sizeof(val));
+        return val;
+      }
+
+        /** unsigned value, too big for int64 becomes double */
+      static void setUnsigned(JValue &val, std::uint64_t uval)
+      {
+        if(uval <= static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {
+          val.setInt(static_cast<std::int64_t>(uval));
+        } else {
+          val.setReal(static_cast<double>(uval));
+        }
+      }
+
+        /** key of the map as text */
+      void key(const JValue &val, std::string &out) const
+      {
+        switch(val.kind()) {
+        case JValue::Kind::string: out = val.asString(); break;
+        case JValue::Kind::integer: out = std::to_string(val.asInt()); break;
+        default: fail("map key must be a string or an integer");
+        }
+      }
+
+      [[nodiscard]] bool atEnd() const { return m_pos == m_data.size(); }
+      [[nodiscard]] bool peekBreak() const { return m_pos < m_data.size() && static_cast<std::uint8_t>(m_data[m_pos]) == 0xFF; }
+
+    private:
+      std::string_view m_data;
+      std::size_t m_pos{0};
+    };
+
+
+    class MsgpackReader : public Reader
+    {
+    public:
+      using Reader::Reader;
+
+      void value(JValue &val, std::size_t depth)
+      {
+        if(depth > MaxDepth) fail("too deeply nested");
+        const auto code = byte();
+        if(code < 0x80) { val.setInt(code); return; }
+        if(code >= 0xE0) { val.setInt(static_cast<std::int8_t>(code)); return; }
+        if(code >= 0xA0 && code < 0xC0) { val.setString(bytes(code & 0x1FU)); return; }
+        if(code >= 0x90 && code < 0xA0) { array(val, code & 0x0FU, depth); return; }
+        if(code >= 0x80 && code < 0x90) { map(val, code & 0x0FU, depth); return; }
+        switch(code) {
+        case 0xC0: val.setNull(); return;
+        case 0xC2: val.setBool(false); return;
+        case 0xC3: val.setBool(true); return;
+        case 0xC4: case 0xD9: val.setString(bytes(be(1))); return;
+        case 0xC5: case 0xDA: val.setString(bytes(be(2))); return;
+        case 0xC6: case 0xDB: val.setString(bytes(be(4))); return;
+        case 0xCA: val.setReal(toFloat(be(4))); return;
+        case 0xCB: val.setReal(toDouble(be(8))); return;
+        case 0xCC: val.setInt(static_cast<std::int64_t>(be(1))); return;
+        case 0xCD: val.setInt(static_cast<std::int64_t>(be(2))); return;
+        case 0xCE: val.setInt(static_cast<std::int64_t>(be(4))); return;
+        case 0xCF: setUnsigned(val, be(8)); return;
+        case 0xD0: val.setInt(static_cast<std::int8_t>(be(1))); return;
+        case 0xD1: val.setInt(static_cast<std::int16_t>(be(2))); return;
+        case 0xD2: val.setInt(static_cast<std::int32_t>(be(4))); return;
+        case 0xD3: val.setInt(static_cast<std::int64_t>(be(8))); return;
+        case 0xDC: array(val, be(2), depth); return;
+        case 0xDD: array(val, be(4), depth); return;
+        case 0xDE: map(val, be(2), depth); return;
+        case 0xDF: map(val, be(4), depth); return;
+        default: fail("unsupported messagepack type");
+        }
+      }
+
+    private:
+      void array(JValue &val, std::uint64_t len, std::size_t depth)
+      {
+        auto &arr = val.makeArray();
+        arr.reserve(count(len));
+        for(std::uint64_t ii = 0; ii < len; ++ii) {
+          value(arr.emplace_back(val.resource()), depth + 1);
+        }
+      }
+
+      void map(JValue &val, std::uint64_t len, std::size_t depth)
+      {
+        auto &obj = val.makeObject();
+        obj.reserve(count(len));
+        JValue keyVal(val.resource());
+        std::string name;
+        for(std::uint64_t ii = 0; ii < len; ++ii) {
+          value(keyVal, depth + 1);
+          key(keyVal, name);
+          obj.emplace_back(std::piecewise_construct, std::forward_as_tuple(std::string_view(name)), std::forward_as_tuple(val.resource()));
+          value(obj.back().second, depth + 1);
+        }
+      }
+    };
+
+
+    class CborReader : public Reader
+    {
+    public:
+      using Reader::Reader;
+
+      void value(JValue &val, std::size_t depth)
+      {
+        if(depth > MaxDepth) fail("too deeply nested");
+        auto code = byte();
+          // tags only give meaning to the next item, it is read as is
+        while((code >> 5U) == 6) {
+          (void)argument(code & 0x1FU);
+          code = byte();
+        }
+        const unsigned major = code >> 5U;
+        const unsigned info = code & 0x1FU;
+        if(major == 7) {
+          simple(val, info);
+          return;
+        }
+        if(info == 31) {
+          if(major == 4) { array(val, {}, depth); return; }
+          if(major == 5) { map(val, {}, depth); return; }
+          fail("indefinite length strings are not supported");
+        }
+        const auto arg = argument(info);
+        switch(major) {
+        case 0: setUnsigned(val, arg); return;
+        case 1:
+          if(arg > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {
+            val.setReal(-1.0 - static_cast<double>(arg));
+          } else {
+            val.setInt(-1 - static_cast<std::int64_t>(arg));
+          }
+          return;
+        case 2: case 3: val.setString(bytes(arg)); return;
+        case 4: array(val, arg, depth); return;
+        case 5: map(val, arg, depth); return;
+        default: fail("unsupported cbor type");
+        }
+      }
+
+    private:
+      std::uint64_t argument(unsigned info)
+      {
+        if(info < 24) return info;
+        switch(info) {
+        case 24: return be(1);
+        case 25: return be(2);
+        case 26: return be(4);
+        case 27: return be(8);
+        default: fail("invalid additional information");
+        }
+      }
+
+      static double halfToDouble(std::uint64_t half)
+      {
+        const auto exp = static_cast<int>((half >> 10U) & 0x1FU);
+        const auto mant = static_cast<double>(half & 0x3FFU);
+        double val{0};
+        const int mantBits = 10;
+        const int bias = 15;
+        if(exp == 0) val = std::ldexp(mant, 1 - bias - mantBits);
+        else if(exp == 0x1F) val = mant == 0 ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+        else val = std::ldexp(mant + 1024, exp - bias - mantBits);
+        return (half & 0x8000U) != 0 ? -val : val;
+      }
+
+      void simple(JValue &val, unsigned info)
+      {
+        switch(info) {
+        case 20: val.setBool(false); return;
+        case 21: val.setBool(true); return;
+        case 22: case 23: val.setNull(); return; // null, undefined
+        case 25: val.setReal(halfToDouble(be(2))); return;
+        case 26: val.setReal(toFloat(be(4))); return;
+        case 27: val.setReal(toDouble(be(8))); return;
+        default: fail("unsupported cbor simple value");
+        }
+      }
+
+        /** @param len nothing for indefinite length, terminated by the break code */
+      void array(JValue &val, std::optional<std::uint64_t> len, std::size_t depth)
+      {
+        auto &arr = val.makeArray();
+        if(len) arr.reserve(count(*len));
+        for(std::uint64_t ii = 0; len ? ii < *len : !breakAfter(); ++ii) {
+          value(arr.emplace_back(val.resource()), depth + 1);
+        }
+      }
+
+      void map(JValue &val, std::optional<std::uint64_t> len, std::size_t depth)
+      {
+        auto &obj = val.makeObject();
+        if(len) obj.reserve(count(*len));
+        JValue keyVal(val.resource());
+        std::string name;
+        for(std::uint64_t ii = 0; len ? ii < *len : !breakAfter(); ++ii) {
+          value(keyVal, depth + 1);
+          key(keyVal, name);
+          obj.emplace_back(std::piecewise_construct, std::forward_as_tuple(std::string_view(name)), std::forward_as_tuple(val.resource()));
+          value(obj.back().second, depth + 1);
+        }
+      }
+
+        /** consume the break code of indefinite length item if it is next */
+      bool breakAfter()
+      {
+        if(!peekBreak()) return false;
+        (void)byte();
+        return true;
+      }
+    };
+  }
+
+
+  template<typename Buf>
+  void write(ContentType ct, const JValue &val, Buf &out)
+  {
+    switch(ct) {
+    case ContentType::msgpack: MsgpackWriter<Buf>(out).value(val); return;
+    case ContentType::cbor: CborWriter<Buf>(out).value(val); return;
+    default: throw std::runtime_error(std::string("not a binary content type: ") + ct._to_string());
+    }
+  }
+
+
+  JDoc::shr_t parse(ContentType ct, std::string_view data)
+  {
+      // the tree is several times bigger than the compact binary data
+    const std::size_t growth = 4;
+    auto doc = std::make_shared<JDoc>(std::max<std::size_t>(1024, growth * data.size()));
+    switch(ct) {
+    case ContentType::msgpack: {
+      MsgpackReader reader(data);
+      reader.value(doc->root(), 0);
+      if(!reader.atEnd()) reader.fail("unexpected data after the value");
+      break;
+    }
+    case ContentType::cbor: {
+      CborReader reader(data);
+      reader.value(doc->root(), 0);
+      if(!reader.atEnd()) reader.fail("unexpected data after the value");
+      break;
+    }
+    default: throw std::runtime_error(std::string("not a binary content type: ") + ct._to_string());
+    }
+    return doc;
+  }
+
+
+  template void write(ContentType ct, const JValue &val, std::string &out);
+  template void write(ContentType ct, const JValue &val, std::vector<char> &out);
+}
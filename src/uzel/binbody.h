@@ -0,0 +1,34 @@
+#pragma once
+
+#include "enum.h"
+#include "jvalue.h"
+
+#include <cstdint>
+#include <string_view>
+
+namespace uzel
+{
+    /** encoding of the message body, kept in the header flags (see frame::ContentTypeMask) */
+  BETTER_ENUM(ContentType, uint8_t, json = 0, msgpack, cbor); //NOLINT
+
+    /**
+     * Binary body encodings: MessagePack and CBOR.
+     *
+     * Both are converted from and to JValue, so handlers see the same
+     * body whatever encoding the sender chose. Integers and floats are
+     * written with the smallest size that keeps the value: doubles
+     * exactly representable as float take 5 bytes. Binary strings are
+     * read as strings, integer map keys become their decimal text and
+     * CBOR tags are ignored. MessagePack extension types and CBOR
+     * indefinite length strings are refused.
+     * */
+  namespace binbody
+  {
+      /** append body encoded with ct (msgpack or cbor) to out (std::string or std::vector<char>) */
+    template<typename Buf>
+    void write(ContentType ct, const JValue &val, Buf &out);
+
+      /** @throw std::runtime_error on malformed data */
+    [[nodiscard]] JDoc::shr_t parse(ContentType ct, std::string_view data);
+  }
+}
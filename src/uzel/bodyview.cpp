@@ -0,0 +1,64 @@
+#include "bodyview.h"
+#include "msg.h"
+#include "jsoncursor.h"
+
+namespace uzel
+{
+  const BodyView::ptree &BodyView::tree() const
+  {
+    return m_msg.pbody();
+  }
+
+
+  std::optional<std::string> BodyView::find(const std::string &path) const
+  {
+    if(const auto *jbody = m_msg.jsonBody()) {
+      const auto *val = jbody->findPath(path);
+      if(val == nullptr) return {};
+      return val->text();
+    }
+    const auto *raw = m_msg.rawBody();
+    if(raw != nullptr && m_msg.contentType() != +ContentType::json) {
+      const auto *val = m_msg.jbody().findPath(path);
+      if(val == nullptr) return {};
+      return val->text();
+    }
+    if(raw == nullptr) {
+      auto child = m_msg.pbody().get_child_optional(path);
+      if(!child) return {};
+      return child->data();
+    }
+    return lookup(raw->view(), path);
+  }
+
+
+  std::optional<std::string> BodyView::lookup(std::string_view json, const std::string &path)
+  {
+    JsonCursor cur(json);
+    std::string_view rest(path);
+    while(true) {
+      const auto dot = rest.find('.');
+      const auto key = rest.substr(0, dot);
+      if(cur.peek() != '{') return {};
+      cur.expect('{');
+      bool found{false};
+      if(!cur.consume('}')) {
+        do {
+          if(cur.string() == key) {
+            cur.expect(':');
+            found = true;
+            break;
+          }
+          cur.expect(':');
+          cur.skipValue();
+        } while(cur.consume(','));
+      }
+      if(!found) return {};
+      if(dot == std::string_view::npos) break;
+      rest.remove_prefix(dot + 1);
+    }
+    const char first = cur.peek();
+    if(first == '{' || first == '[') return std::string();
+    return cur.text();
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <boost/property_tree/ptree.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace uzel
+{
+  class Msg;
+
+    /**
+     * Read access to the message body by path without parsing it.
+     *
+     * If the body is not parsed yet, get() scans the received json
+     * only as far as needed to find the value, skipping not
+     * interesting fields, and nothing is stored. Once the whole body
+     * was parsed (see tree(), Msg::pbody() and Msg::jbody()), the
+     * parsed body is used. Paths and value conversions are the same as for
+     * boost::property_tree::ptree::get().
+     * */
+  class BodyView
+  {
+  public:
+    using ptree = boost::property_tree::ptree;
+
+    explicit BodyView(const Msg &msg) : m_msg(msg) {}
+
+      /** @throw boost::property_tree::ptree_bad_path if there is no such value */
+    template<typename T>
+    [[nodiscard]] T get(const std::string &path) const
+    {
+      auto val = find(path);
+      if(!val) {
+        BOOST_PROPERTY_TREE_THROW(boost::property_tree::ptree_bad_path("No such node", ptree::path_type(path)));
+      }
+      return ptree(std::move(*val)).get_value<T>();
+    }
+
+    template<typename T>
+    [[nodiscard]] T get(const std::string &path, const T &defval) const
+    {
+      return get_optional<T>(path).value_or(defval);
+    }
+
+    template<typename T>
+    [[nodiscard]] std::optional<T> get_optional(const std::string &path) const
+    {
+      auto val = find(path);
+      if(!val) return {};
+      auto rez = ptree(std::move(*val)).get_value_optional<T>();
+      if(!rez) return {};
+      return *rez;
+    }
+
+      /** whole body, parses it if needed */
+    [[nodiscard]] const ptree &tree() const;
+
+      /**
+       * find value at the path in json text, scanning it only up to the value
+       * @return value as text, empty string for objects and arrays
+       * */
+    [[nodiscard]] static std::optional<std::string> lookup(std::string_view json, const std::string &path);
+
+  private:
+      /** @return value at the path as text, empty string for objects and arrays */
+    [[nodiscard]] std::optional<std::string> find(const std::string &path) const;
+
+    const Msg &m_msg;
+  };
+}
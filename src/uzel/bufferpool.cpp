@@ -0,0 +1,65 @@
+#include "bufferpool.h"
+
+#include <bit>
+
+namespace uzel
+{
+  BufferPool::BufferPool(std::size_t maxCached)
+    : m_maxCached(maxCached)
+  {
+  }
+
+
+  std::size_t BufferPool::classSize(std::size_t size)
+  {
+    return size <= MinClass ? MinClass : std::bit_ceil(size);
+  }
+
+
+  std::size_t BufferPool::classIndex(std::size_t classSize)
+  {
+    return static_cast<std::size_t>(std::countr_zero(classSize) - std::countr_zero(MinClass));
+  }
+
+
+  BufferPool::buffer_t BufferPool::take(std::size_t size)
+  {
+    const auto csize = classSize(size);
+    if(csize > MaxClass) {
+      return std::make_unique<std::vector<char>>(size);
+    }
+    {
+      const std::lock_guard<std::mutex> lock(m_mutex);
+      auto &free = m_free.at(classIndex(csize));
+      if(!free.empty()) {
+        auto buf = std::move(free.back());
+        free.pop_back();
+        m_cached -= csize;
+        return buf;
+      }
+    }
+    return std::make_unique<std::vector<char>>(csize);
+  }
+
+
+  void BufferPool::give(buffer_t buf)
+  {
+    const auto size = buf->size();
+    if(size < MinClass || size > MaxClass || classSize(size) != size) {
+      return;
+    }
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_cached + size > m_maxCached) {
+      return;
+    }
+    m_free.at(classIndex(size)).push_back(std::move(buf));
+    m_cached += size;
+  }
+
+
+  std::size_t BufferPool::cached() const
+  {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cached;
+  }
+}
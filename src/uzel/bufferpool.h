@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Pool of receive buffers in power of two size classes.
+     *
+     * Sessions take their receive segments (see RecvBuffer) from the
+     * pool and return them when the last message referring to them is
+     * gone, so idle sessions hold no buffers and busy ones reuse
+     * already touched memory. At most maxCached bytes are kept for
+     * reuse, buffers above MaxClass are not pooled. Buffers can be
+     * returned from any thread.
+     * */
+  class BufferPool
+  {
+  public:
+    using shr_t = std::shared_ptr<BufferPool>;
+    using buffer_t = std::unique_ptr<std::vector<char>>;
+
+    static constexpr std::size_t MinClass = 4UL*1024;
+    static constexpr std::size_t MaxClass = 1024UL*1024;
+
+    explicit BufferPool(std::size_t maxCached = 32UL*1024*1024);
+
+      /** @return buffer of at least size bytes, its size is rounded up to the size class */
+    [[nodiscard]] buffer_t take(std::size_t size);
+      /** return buffer taken by take() */
+    void give(buffer_t buf);
+
+      /** bytes kept for reuse */
+    [[nodiscard]] std::size_t cached() const;
+
+      /** @return size class for the size */
+    [[nodiscard]] static std::size_t classSize(std::size_t size);
+
+  private:
+    static constexpr std::size_t ClassCount = 9; //!< MinClass..MaxClass
+
+    [[nodiscard]] static std::size_t classIndex(std::size_t classSize);
+
+    const std::size_t m_maxCached;
+    mutable std::mutex m_mutex;
+    std::size_t m_cached{0};                           //!< guarded by m_mutex
+    std::array<std::vector<buffer_t>, ClassCount> m_free; //!< guarded by m_mutex
+  };
+}
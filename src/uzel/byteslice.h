@@ -0,0 +1,76 @@
+#pragma once
+
+#include <boost/container/small_vector.hpp>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Immutable view into a shared byte buffer.
+     *
+     * Copying the slice or taking a sub-slice never copies the bytes,
+     * the underlying buffer is kept alive as long as any slice refers
+     * to it. Used to pass received and encoded messages around
+     * without copying them.
+     * */
+  class ByteSlice
+  {
+  public:
+    ByteSlice() = default;
+
+      /** take ownership of the vector */
+    explicit ByteSlice(std::vector<char> &&data)
+    {
+      auto owner = std::make_shared<const std::vector<char>>(std::move(data));
+      m_size = owner->size();
+      m_data = std::shared_ptr<const char>(owner, owner->data());
+    }
+
+      /**
+       * @param data pointer to the first byte, sharing ownership with
+       *   the buffer (see std::shared_ptr aliasing constructor)
+       * @param size number of bytes */
+    ByteSlice(std::shared_ptr<const char> data, std::size_t size)
+      : m_data(std::move(data)), m_size(size)
+    {
+    }
+
+    [[nodiscard]] const char *data() const { return m_data.get(); }
+    [[nodiscard]] std::size_t size() const { return m_size; }
+    [[nodiscard]] bool empty() const { return m_size == 0; }
+    [[nodiscard]] std::string_view view() const { return {m_data.get(), m_size}; }
+
+      /** @return slice of the same buffer, throws if out of range */
+    [[nodiscard]] ByteSlice sub(std::size_t offset, std::size_t size) const
+    {
+      if(offset > m_size || size > m_size - offset) {
+        throw std::out_of_range("ByteSlice::sub() out of range");
+      }
+      //NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      return {std::shared_ptr<const char>(m_data, m_data.get() + offset), size};
+    }
+
+  private:
+    std::shared_ptr<const char> m_data;
+    std::size_t m_size{0};
+  };
+
+    /**
+     * Message serialized as a sequence of slices, written with one
+     * gather write, so big bodies are not copied to prepend a header.
+     * */
+  using ByteSlices = boost::container::small_vector<ByteSlice, 3>;
+
+  inline std::size_t totalSize(const ByteSlices &slices)
+  {
+    std::size_t size{0};
+    for(auto &&slice : slices) {
+      size += slice.size();
+    }
+    return size;
+  }
+}
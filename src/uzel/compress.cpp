@@ -0,0 +1,83 @@
+#include "compress.h"
+
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+namespace uzel::compress
+{
+  namespace io = boost::iostreams;
+
+  namespace
+  {
+    void checkCodec(Compression codec)
+    {
+      if(codec != +Compression::zlib) {
+        throw std::runtime_error(std::string("unsupported compression ") + codec._to_string());
+      }
+    }
+
+      /** appends to the vector, stops as soon as the limit is exceeded, so the sender is not trusted */
+    struct LimitedSink
+    {
+      using char_type = char;
+      using category = io::sink_tag;
+
+      std::streamsize write(const char *str, std::streamsize len)
+      {
+        const auto size = static_cast<std::size_t>(len);
+        if(out->size() + size > maxSize) {
+          *overflow = true; // the exception may be swallowed when the stream is closed
+          throw std::runtime_error("decompressed message body exceeds " + std::to_string(maxSize) + " bytes");
+        }
+        out->insert(out->end(), str, std::next(str, len));
+        return len;
+      }
+
+      std::vector<char> *out;
+      std::size_t maxSize;
+      bool *overflow;
+    };
+  }
+
+
+  std::vector<char> deflate(Compression codec, std::string_view data)
+  {
+    checkCodec(codec);
+    std::vector<char> out;
+    out.reserve(data.size() / 2);
+    io::filtering_ostream os;
+    os.push(io::zlib_compressor(io::zlib::default_compression));
+    os.push(io::back_inserter(out));
+    os.write(data.data(), static_cast<std::streamsize>(data.size()));
+    os.reset(); // flushes the compressor
+    return out;
+  }
+
+
+  std::vector<char> inflate(Compression codec, std::string_view data, std::size_t maxSize)
+  {
+    checkCodec(codec);
+    std::vector<char> out;
+    out.reserve(data.size() * 3);
+    bool overflow{false};
+    try {
+      io::filtering_ostreambuf buf;
+      buf.push(io::zlib_decompressor());
+      buf.push(LimitedSink{&out, maxSize, &overflow});
+      io::copy(io::array_source(data.data(), data.size()), buf);
+    }
+    catch(const io::zlib_error &ex) {
+      throw std::runtime_error(std::string("can not decompress message body: ") + ex.what());
+    }
+    if(overflow) {
+      throw std::runtime_error("decompressed message body exceeds " + std::to_string(maxSize) + " bytes");
+    }
+    return out;
+  }
+}
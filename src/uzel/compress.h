@@ -0,0 +1,58 @@
+#pragma once
+
+#include "enum.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace uzel
+{
+    /** body compression of binary frames, see frame::Compressed */
+  BETTER_ENUM(Compression, uint8_t, none = 0, zlib); //NOLINT
+
+    /**
+     * Message body compression.
+     *
+     * Bodies are compressed one by one, so every frame can be
+     * decompressed, forwarded or dropped on its own. The codec is
+     * negotiated per session: each side announces in the auth message
+     * what it can decompress and compresses outgoing bodies only if
+     * the peer announced it.
+     * */
+  namespace compress
+  {
+      /** compressed body bigger than that is refused by inflate() */
+    constexpr std::size_t MaxInflatedSize = 256UL*1024*1024;
+
+      /** @return compressed data */
+    [[nodiscard]] std::vector<char> deflate(Compression codec, std::string_view data);
+
+      /**
+       * @return decompressed data
+       * @throw std::runtime_error if data is corrupted or inflates to more than maxSize
+       * */
+    [[nodiscard]] std::vector<char> inflate(Compression codec, std::string_view data, std::size_t maxSize = MaxInflatedSize);
+
+      /** counters of compressed messages of one direction */
+    struct Stats
+    {
+      std::uint64_t messages{0}; //!< compressed messages
+      std::uint64_t rawBytes{0}; //!< their bodies before compression
+      std::uint64_t packedBytes{0}; //!< and after
+
+      void add(std::size_t raw, std::size_t packed)
+      {
+        ++messages;
+        rawBytes += raw;
+        packedBytes += packed;
+      }
+        /** @return compressed to raw size, 1 if nothing was compressed */
+      [[nodiscard]] double ratio() const
+      {
+        return rawBytes == 0 ? 1.0 : static_cast<double>(packedBytes) / static_cast<double>(rawBytes);
+      }
+    };
+  }
+}
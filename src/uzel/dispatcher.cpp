@@ -1,6 +1,7 @@
 #include "dispatcher.h"
 #include "msg.h"
 #include <boost/log/trivial.hpp>
+#include <algorithm>
 #include <memory>
 
 namespace uzel {
@@ -19,19 +20,19 @@ namespace uzel {
 #endif
   }
 
-  MsgDispatcher::Id MsgDispatcher::nextIdOnStrand() {
-    Id id;
-    boost::asio::dispatch(m_strand, [this, &id]{ id = m_nextId++; });
-    return id;
+  MsgDispatcher::Id MsgDispatcher::nextId() {
+      // handlers are registered from any thread, the strand would run the increment later
+    return m_nextId.fetch_add(1, std::memory_order_relaxed);
   }
 
 
   MsgDispatcher::Connection MsgDispatcher::registerHandler(const std::string& cname, Handler handler)
   {
     assertShared();
-    const auto id = nextIdOnStrand();
-    boost::asio::dispatch(m_strand, [this, id, cname, handler = std::move(handler)]() mutable {
-      auto& entry = m_handlers[cname];
+    const auto id = nextId();
+    const Atom acname = Atom::intern(cname);
+    boost::asio::dispatch(m_strand, [this, id, acname, handler = std::move(handler)]() mutable {
+      auto& entry = m_handlers[acname];
       HandlerVec newv = entry ? *entry : HandlerVec{};
         // do not modify original vector, but create a new shared_ptr<HandlerVec>,
         // so that we can also register/unregister on the fly from any handler without
@@ -39,7 +40,7 @@ namespace uzel {
       newv.emplace_back(id, std::move(handler));
       entry = std::make_shared<const HandlerVec>(std::move(newv));
     });
-    return {weak_from_this(), cname, id};
+    return {weak_from_this(), acname, id};
   }
 
   MsgDispatcher::ScopedConnection MsgDispatcher::registerHandlerScoped(const std::string& cname, Handler handler)
@@ -47,16 +48,40 @@ namespace uzel {
     return ScopedConnection(registerHandler(cname, handler));
   }
 
+  MsgDispatcher::Connection MsgDispatcher::registerStreamHandler(const std::string& cname, StreamHandler handler)
+  {
+    assertShared();
+    const auto id = nextId();
+    const Atom acname = Atom::intern(cname);
+    {
+      const std::lock_guard<std::mutex> lock(m_streamMutex);
+      ++m_streamCnames[acname];
+    }
+    boost::asio::dispatch(m_strand, [this, id, acname, handler = std::move(handler)]() mutable {
+      auto& entry = m_streamHandlers[acname];
+      StreamVec newv = entry ? *entry : StreamVec{};
+      newv.emplace_back(id, std::move(handler));
+      entry = std::make_shared<const StreamVec>(std::move(newv));
+    });
+    return {weak_from_this(), acname, id};
+  }
+
+  bool MsgDispatcher::wantsStream(Atom cname) const
+  {
+    const std::lock_guard<std::mutex> lock(m_streamMutex);
+    return m_streamCnames.contains(cname);
+  }
+
   MsgDispatcher::Connection MsgDispatcher::registerAnyPost(HandlerShr handler)
   {
     assertShared();
-    const auto id = nextIdOnStrand();
+    const auto id = nextId();
     boost::asio::dispatch(m_strand, [this, id, h = std::move(handler)]() mutable {
       HandlerShrVec newv = m_anyPost ? *m_anyPost : HandlerShrVec{};
       newv.emplace_back(id, std::move(h));
       m_anyPost = std::make_shared<const HandlerShrVec>(std::move(newv));
     });
-    return {weak_from_this(), std::string{}, id};
+    return {weak_from_this(), Atom{}, id};
   }
 
   MsgDispatcher::ScopedConnection MsgDispatcher::registerAnyPostScoped(HandlerShr handler)
@@ -71,7 +96,7 @@ namespace uzel {
       // capture snapshot pointers (instead of copying) and iterate, see also
       // explanation in registerHandler()
     boost::asio::dispatch(m_strand, [self = shared_from_this(), msg = std::move(msg)]{
-      const auto cname = msg->cname();
+      const auto cname = msg->hdr().cname;
 
       BOOST_LOG_TRIVIAL(debug) << "dispatching cname '" << cname << "'";
 
@@ -101,9 +126,72 @@ namespace uzel {
     });
   }
 
-  void MsgDispatcher::disconnectImpl(const std::string& cname, Id id)
+  void MsgDispatcher::dispatchStreamBegin(Msg::shr_t msg, std::size_t bodySize)
+  {
+    boost::asio::dispatch(m_strand, [self = shared_from_this(), msg = std::move(msg), bodySize]{
+      BOOST_LOG_TRIVIAL(debug) << "streaming body of cname '" << msg->hdr().cname << "', " << bodySize << " bytes";
+      StreamVecPtr handlers;
+      if(auto it = self->m_streamHandlers.find(msg->hdr().cname); it != self->m_streamHandlers.end()) {
+        handlers = it->second;
+      }
+      if(!handlers) return; // disconnected meanwhile, the body is dropped
+      self->m_streams[msg.get()] = handlers;
+      for(const auto& kv : *handlers) {
+        try {
+          kv.second.begin(*msg, bodySize);
+        }
+        catch (const std::exception& e) { BOOST_LOG_TRIVIAL(error) << "stream handler threw: " << e.what(); }
+      }
+    });
+  }
+
+  void MsgDispatcher::dispatchStreamChunk(Msg::shr_t msg, ByteSlice chunk)
+  {
+    boost::asio::dispatch(m_strand, [self = shared_from_this(), msg = std::move(msg), chunk = std::move(chunk)]{
+      auto it = self->m_streams.find(msg.get());
+      if(it == self->m_streams.end()) return;
+      for(const auto& kv : *it->second) {
+        try {
+          kv.second.chunk(*msg, chunk);
+        }
+        catch (const std::exception& e) { BOOST_LOG_TRIVIAL(error) << "stream handler threw: " << e.what(); }
+      }
+    });
+  }
+
+  void MsgDispatcher::dispatchStreamEnd(Msg::shr_t msg, bool complete)
+  {
+    boost::asio::dispatch(m_strand, [self = shared_from_this(), msg = std::move(msg), complete]{
+      auto it = self->m_streams.find(msg.get());
+      if(it == self->m_streams.end()) return;
+      const auto handlers = it->second;
+      self->m_streams.erase(it);
+      for(const auto& kv : *handlers) {
+        try {
+          kv.second.end(*msg, complete);
+        }
+        catch (const std::exception& e) { BOOST_LOG_TRIVIAL(error) << "stream handler threw: " << e.what(); }
+      }
+    });
+  }
+
+  void MsgDispatcher::disconnectImpl(Atom cname, Id id)
   {
     boost::asio::dispatch(m_strand, [this, cname, id] {
+      if(auto sit = m_streamHandlers.find(cname); !cname.empty() && sit != m_streamHandlers.end() && sit->second &&
+         std::any_of(sit->second->begin(), sit->second->end(), [&](auto& item){ return item.first == id; })) {
+        StreamVec nv = *sit->second;
+        nv.erase(std::remove_if(nv.begin(), nv.end(),
+                                [&](auto& item){ return item.first == id; }),
+                 nv.end());
+        if (nv.empty()) m_streamHandlers.erase(sit);
+        else sit->second = std::make_shared<const StreamVec>(std::move(nv));
+        const std::lock_guard<std::mutex> lock(m_streamMutex);
+        if(auto cit = m_streamCnames.find(cname); cit != m_streamCnames.end() && --cit->second == 0) {
+          m_streamCnames.erase(cit);
+        }
+        return;
+      }
       if(!cname.empty())
       {
         auto it = m_handlers.find(cname);
@@ -1,10 +1,17 @@
 #pragma once
 
+#include "atom.h"
+#include "byteslice.h"
+#include "typedmsg.h"
+
 #include <utility> // need to be before boost/asio.hpp
 #include <boost/asio.hpp>
 #include <unordered_map>
 #include <vector>
+#include <atomic>
+#include <concepts>
 #include <functional>
+#include <mutex>
 #include <cstdint>
 #include <string>
 #include <memory>
@@ -30,6 +37,24 @@ namespace uzel {
     using HandlerShrVec     = std::vector<IHSPair>;
     using HandlerShrVecPtr  = std::shared_ptr<const HandlerShrVec>;
 
+      /**
+       * Handler of a streamed body: big bodies of messages with its
+       * cname are delivered in chunks as they are received, instead of
+       * the whole message (see InputProcessor::StreamBodySize). The
+       * message passed to the callbacks has the header only.
+       * */
+    struct StreamHandler
+    {
+      std::function<void(const Msg &msg, std::size_t bodySize)> begin;
+        /** the chunk refers to the receive buffer, keep it (not copy) if needed later */
+      std::function<void(const Msg &msg, const ByteSlice &chunk)> chunk;
+        /** complete is false if the connection was lost before the whole body was received */
+      std::function<void(const Msg &msg, bool complete)> end;
+    };
+    using IStreamPair = std::pair<Id, StreamHandler>;
+    using StreamVec    = std::vector<IStreamPair>;
+    using StreamVecPtr = std::shared_ptr<const StreamVec>;
+
 
 
     class Connection {
@@ -51,11 +76,11 @@ namespace uzel {
       friend class MsgDispatcher;
 
       Connection(std::weak_ptr<MsgDispatcher> self,
-                 std::string cname, Id id)
-        : m_self(std::move(self)), m_cname(std::move(cname)), m_id(id) {}
+                 Atom cname, Id id)
+        : m_self(std::move(self)), m_cname(cname), m_id(id) {}
 
       std::weak_ptr<MsgDispatcher> m_self;
-      std::string m_cname;
+      Atom m_cname;
       Id m_id{0};
     };
 
@@ -89,6 +114,47 @@ namespace uzel {
        * */
     ScopedConnection registerHandlerScoped(const std::string& cname, Handler handler);
 
+      /**
+       * Multicast: append a handler for the typed message T, see typedmsg.h.
+       * The body is decoded into T before calling the handler, which
+       * gets (const T&) or (const T&, const Msg&) arguments. Bodies not
+       * matching T are logged and dropped like handler exceptions.
+       * @return Connection object that can be used to disconnect
+       * */
+    template<typed::Body T, typename F>
+      requires std::invocable<F&, const T&> || std::invocable<F&, const T&, const Msg&>
+    Connection registerHandler(F handler)
+    {
+      return registerHandler(std::string(T::cname), [handler = std::move(handler)](const Msg &msg) mutable {
+        const auto body = typed::decode<T>(msg);
+        if constexpr(std::invocable<F&, const T&, const Msg&>) {
+          handler(body, msg);
+        } else {
+          handler(body);
+        }
+      });
+    }
+
+      /** typed handler, see above, that will disconnect on destruction (RAII) */
+    template<typed::Body T, typename F>
+    ScopedConnection registerHandlerScoped(F handler)
+    {
+      return ScopedConnection(registerHandler<T>(std::move(handler)));
+    }
+
+      /**
+       * Multicast: append a stream handler for specific cname, see StreamHandler.
+       * Messages with smaller bodies go to the usual handlers.
+       * @return Connection object that can be used to disconnect
+       * */
+    Connection registerStreamHandler(const std::string& cname, StreamHandler handler);
+
+      /**
+       * @return true if bodies of the messages with that cname are
+       * streamed, can be called from any thread
+       * */
+    [[nodiscard]] bool wantsStream(Atom cname) const;
+
       // Any-post hook (append). Called after per-cname handlers.
     Connection registerAnyPost(HandlerShr handler);
 
@@ -98,9 +164,19 @@ namespace uzel {
       // Dispatch
     void dispatch(ShrMsg msg);
 
+      /** streamed body, called in order: begin, chunks, end (see StreamHandler) */
+    void dispatchStreamBegin(ShrMsg msg, std::size_t bodySize);
+    void dispatchStreamChunk(ShrMsg msg, ByteSlice chunk);
+    void dispatchStreamEnd(ShrMsg msg, bool complete);
+
+      /** run f after everything dispatched so far was handled */
+    void post(std::function<void()> f) {
+      boost::asio::post(m_strand, std::move(f));
+    }
+
       /** unregister all handlers for given cname */
     void unregisterAll(const std::string& cname) {
-      boost::asio::dispatch(m_strand, [this, cname]{ m_handlers.erase(cname); });
+      boost::asio::dispatch(m_strand, [this, cname = Atom(cname)]{ m_handlers.erase(cname); });
     }
     void clearAnyPost() {
       boost::asio::dispatch(m_strand, [this]{ m_anyPost.reset(); });
@@ -110,16 +186,23 @@ namespace uzel {
       return m_strand.get_inner_executor();
     }
   private:
-    Id nextIdOnStrand();
-    void disconnectImpl(const std::string& cname, Id id);
+    Id nextId();
+    void disconnectImpl(Atom cname, Id id);
 
         // members
     boost::asio::strand<boost::asio::any_io_executor> m_strand;
       // cname -> snapshot of handlers
-    std::unordered_map<std::string, HandlerVecPtr> m_handlers;
+    std::unordered_map<Atom, HandlerVecPtr> m_handlers;
       // any-post snapshot
     HandlerShrVecPtr m_anyPost;
-    Id m_nextId{1};
+    std::atomic<Id> m_nextId{1};
+      // cname -> snapshot of stream handlers
+    std::unordered_map<Atom, StreamVecPtr> m_streamHandlers;
+      // handlers of the streams in progress, taken at begin
+    std::unordered_map<const Msg*, StreamVecPtr> m_streams;
+      // cnames of m_streamHandlers for wantsStream() from other threads
+    mutable std::mutex m_streamMutex;
+    std::unordered_map<Atom, std::size_t> m_streamCnames;
   };
 
 }
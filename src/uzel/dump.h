@@ -2,13 +2,14 @@
 
 #include <boost/log/trivial.hpp>
 #include <stdexcept>
+#include <string_view>
 #include <vector>
 
 namespace uzel
 {
 
   struct dump_chars {
-    const std::vector<char>& data;
+    std::string_view data;
     const size_t maxsize;
 
     template<class OStream>
@@ -49,6 +50,7 @@ namespace uzel
   };
 
     // helper
-  inline dump_chars dump(const std::vector<char>& v, size_t maxsize = 200) { return dump_chars{.data=v, .maxsize=maxsize}; }
+  inline dump_chars dump(std::string_view v, size_t maxsize = 200) { return dump_chars{.data=v, .maxsize=maxsize}; }
+  inline dump_chars dump(const std::vector<char>& v, size_t maxsize = 200) { return dump({v.data(), v.size()}, maxsize); }
 
 }
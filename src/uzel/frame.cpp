@@ -0,0 +1,260 @@
+#include "frame.h"
+#include "viewbuf.h"
+#include "jsonwriter.h"
+
+#include <boost/property_tree/json_parser.hpp>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace uzel::frame
+{
+  namespace
+  {
+    void putU16(std::vector<char> &out, std::uint16_t val)
+    {
+      out.push_back(static_cast<char>(val & 0xFFU));
+      out.push_back(static_cast<char>((val >> 8U) & 0xFFU));
+    }
+
+    void putU32(std::vector<char> &out, std::uint32_t val)
+    {
+      putU16(out, static_cast<std::uint16_t>(val & 0xFFFFU));
+      putU16(out, static_cast<std::uint16_t>(val >> 16U));
+    }
+
+    void setU32(std::vector<char> &out, std::size_t pos, std::uint32_t val)
+    {
+      for(std::size_t ii = 0; ii < sizeof(val); ++ii) {
+        out[pos + ii] = static_cast<char>((val >> (8U * ii)) & 0xFFU);
+      }
+    }
+
+    std::uint16_t getU16(std::string_view data, std::size_t pos)
+    {
+      return static_cast<std::uint16_t>(static_cast<std::uint8_t>(data[pos]) |
+                                        (static_cast<std::uint8_t>(data[pos+1]) << 8U));
+    }
+
+    std::uint32_t getU32(std::string_view data, std::size_t pos)
+    {
+      return getU16(data, pos) | (static_cast<std::uint32_t>(getU16(data, pos+2)) << 16U);
+    }
+
+    void putField(std::vector<char> &out, Tag tag, std::string_view value)
+    {
+      if(value.empty()) return;
+      if(value.size() > std::numeric_limits<std::uint16_t>::max()) {
+        throw std::runtime_error("header field is too long for binary frame");
+      }
+      out.push_back(static_cast<char>(tag));
+      putU16(out, static_cast<std::uint16_t>(value.size()));
+      out.insert(out.end(), value.begin(), value.end());
+    }
+
+      /** field with the header fields without own tag as compact json */
+    void putExt(std::vector<char> &out, const ptree &ext)
+    {
+      if(ext.empty()) return;
+      out.push_back(static_cast<char>(Tag::ext));
+      const auto lenPos = out.size();
+      putU16(out, 0);
+      jsonwriter::writePtree(out, ext);
+      const auto len = out.size() - lenPos - 2;
+      if(len > std::numeric_limits<std::uint16_t>::max()) {
+        throw std::runtime_error("header field is too long for binary frame");
+      }
+      out[lenPos] = static_cast<char>(len & 0xFFU);
+      out[lenPos + 1] = static_cast<char>((len >> 8U) & 0xFFU);
+    }
+  }
+
+
+  std::optional<Prefix> parsePrefix(std::string_view data)
+  {
+    if(data.size() < PrefixSize) return {};
+    if(!isBinary(data[0])) {
+      throw std::runtime_error("not a binary frame");
+    }
+    if(static_cast<std::uint8_t>(data[1]) != Version) {
+      throw std::runtime_error("unsupported binary frame version " + std::to_string(static_cast<std::uint8_t>(data[1])));
+    }
+    Prefix prefix;
+    prefix.flags    = getU16(data, 2);
+    prefix.cnameId  = getU32(data, 4);
+    prefix.routeLen = getU32(data, 8);
+    prefix.bodyLen  = getU32(data, 12);
+    if((prefix.flags & ~KnownFlags) != 0) {
+      throw std::runtime_error("unsupported binary frame flags " + std::to_string(prefix.flags));
+    }
+    if(!Compression::_from_integral_nothrow(static_cast<std::uint8_t>(prefix.flags & CompressionMask))) {
+      throw std::runtime_error("unsupported compression of binary frame " + std::to_string(prefix.flags & CompressionMask));
+    }
+    if(!ContentType::_from_integral_nothrow(static_cast<std::uint8_t>((prefix.flags & ContentTypeMask) >> ContentTypeShift))) {
+      throw std::runtime_error("unsupported content type of binary frame " + std::to_string(prefix.flags));
+    }
+    return prefix;
+  }
+
+
+  std::uint32_t cnameId(std::string_view cname)
+  {
+    if(cname.empty()) return 0;
+    const std::uint32_t fnvOffset = 2166136261U;
+    const std::uint32_t fnvPrime  = 16777619U;
+    std::uint32_t hash = fnvOffset;
+    for(const char ch : cname) {
+      hash ^= static_cast<std::uint8_t>(ch);
+      hash *= fnvPrime;
+    }
+    return (hash == 0) ? 1 : hash;
+  }
+
+
+  std::size_t beginFrame(const MsgHeader &header, std::vector<char> &out, std::size_t bodySizeHint)
+  {
+    const auto &cname = header.cname.str();
+    const std::size_t routeHint = 128;
+    const auto start = out.size();
+    out.reserve(start + PrefixSize + routeHint + bodySizeHint);
+    out.push_back(static_cast<char>(Magic));
+    out.push_back(static_cast<char>(Version));
+    putU16(out, header.flags);
+    putU32(out, cnameId(cname));
+    putU32(out, 0); // routing section length, set below
+    putU32(out, 0); // body length, set by endFrame()
+
+    putField(out, Tag::fromNode, header.from.node());
+    putField(out, Tag::fromApp,  header.from.app());
+    putField(out, Tag::toNode,   header.to.node());
+    putField(out, Tag::toApp,    header.to.app());
+    putField(out, Tag::cname,    cname);
+    if(header.priority != +Priority::undefined) {
+      const char prio = static_cast<char>(header.priority._to_integral());
+      putField(out, Tag::priority, {&prio, 1});
+    }
+    if(header.deadline != 0) {
+      std::vector<char> deadline;
+      putU32(deadline, static_cast<std::uint32_t>(static_cast<std::uint64_t>(header.deadline) & 0xFFFFFFFFU));
+      putU32(deadline, static_cast<std::uint32_t>(static_cast<std::uint64_t>(header.deadline) >> 32U));
+      putField(out, Tag::deadline, {deadline.data(), deadline.size()});
+    }
+    for(auto &&hop : header.hops) {
+      putField(out, Tag::hop, hop.str());
+    }
+    putExt(out, header.ext);
+    setU32(out, start + 8, static_cast<std::uint32_t>(out.size() - start - PrefixSize));
+    return start;
+  }
+
+
+  void endFrame(std::vector<char> &out, std::size_t start)
+  {
+    const auto routeLen = getU32({out.data(), out.size()}, start + 8);
+    const auto bodyLen = out.size() - start - PrefixSize - routeLen;
+    if(bodyLen > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::runtime_error("message body is too big for binary frame");
+    }
+    setU32(out, start + 12, static_cast<std::uint32_t>(bodyLen));
+  }
+
+
+  void encodePrefix(const MsgHeader &header, std::size_t bodyLen, std::vector<char> &out)
+  {
+    if(bodyLen > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::runtime_error("message body is too big for binary frame");
+    }
+    const auto start = beginFrame(header, out);
+    setU32(out, start + 12, static_cast<std::uint32_t>(bodyLen));
+  }
+
+
+  void encode(const MsgHeader &header, std::string_view body, std::vector<char> &out)
+  {
+    const auto start = beginFrame(header, out, body.size());
+    out.insert(out.end(), body.begin(), body.end());
+    endFrame(out, start);
+  }
+
+
+  std::vector<char> encodeAttachedSize(std::uint64_t size)
+  {
+    std::vector<char> out;
+    out.reserve(AttachedSizeLen);
+    putU32(out, static_cast<std::uint32_t>(size & 0xFFFFFFFFU));
+    putU32(out, static_cast<std::uint32_t>(size >> 32U));
+    return out;
+  }
+
+
+  std::uint64_t attachedSize(std::string_view data)
+  {
+    return getU32(data, 0) | (static_cast<std::uint64_t>(getU32(data, 4)) << 32U);
+  }
+
+
+  MsgHeader decodeHeader(const Prefix &prefix, std::string_view route)
+  {
+    MsgHeader header;
+    header.flags = prefix.flags;
+    Atom fromNode;
+    Atom fromApp;
+    Atom toNode;
+    Atom toApp;
+    const std::size_t fieldHdr = 3;
+    while(!route.empty()) {
+      if(route.size() < fieldHdr) {
+        throw std::runtime_error("truncated routing field in binary frame");
+      }
+      const auto tag = static_cast<std::uint8_t>(route[0]);
+      const std::size_t len = getU16(route, 1);
+      if(route.size() < fieldHdr + len) {
+        throw std::runtime_error("truncated routing field in binary frame");
+      }
+      const auto value = route.substr(fieldHdr, len);
+      route.remove_prefix(fieldHdr + len);
+      switch(tag)
+      {
+        case Tag::fromApp:  fromApp  = Atom(value); break;
+        case Tag::fromNode: fromNode = Atom(value); break;
+        case Tag::toApp:    toApp    = Atom(value); break;
+        case Tag::toNode:   toNode   = Atom(value); break;
+        case Tag::cname:    header.cname = Atom(value); break;
+        case Tag::hop:      header.hops.emplace_back(value); break;
+        case Tag::priority:
+        {
+          if(value.size() != 1) {
+            throw std::runtime_error("bad priority field in binary frame");
+          }
+          auto prio = Priority::_from_integral_nothrow(static_cast<std::uint8_t>(value[0]));
+          if(prio) {
+            header.priority = *prio;
+          }
+          break;
+        }
+        case Tag::deadline:
+        {
+          const std::size_t deadlineLen = 8;
+          if(value.size() != deadlineLen) {
+            throw std::runtime_error("bad deadline field in binary frame");
+          }
+          header.deadline = static_cast<std::int64_t>(getU32(value, 0) | (static_cast<std::uint64_t>(getU32(value, 4)) << 32U));
+          break;
+        }
+        case Tag::ext:
+        {
+          view_inputbuf vibuf(value);
+          std::istream iss(&vibuf);
+          boost::property_tree::read_json(iss, header.ext);
+          break;
+        }
+        default:
+            // unknown fields are skipped for forward compatibility
+          break;
+      }
+    }
+    header.from = Addr(fromApp, fromNode);
+    header.to = Addr(toApp, toNode);
+    return header;
+  }
+}
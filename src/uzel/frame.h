@@ -0,0 +1,145 @@
+#pragma once
+
+#include "binbody.h"
+#include "compress.h"
+#include "enum.h"
+#include "msgheader.h"
+
+#include <boost/property_tree/ptree.hpp>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace uzel
+{
+    /** wire format used to send messages over the session */
+  BETTER_ENUM(Framing, uint8_t, json = 0, binary); //NOLINT
+
+    /**
+     * Length-prefixed binary frames.
+     *
+     * Each frame starts with the fixed prefix (all integers are little endian):
+     *
+     *  offset size
+     *       0    1  magic (frame::Magic), can never be the first byte of a json line
+     *       1    1  version (frame::Version)
+     *       2    2  message flags (MsgHeader::flags), only KnownFlags are accepted
+     *       4    4  cname id, see cnameId()
+     *       8    4  length of the routing section
+     *      12    4  length of the body
+     *
+     * The routing section follows the prefix and consists of fields,
+     * each encoded as 1 byte tag (frame::Tag), 2 bytes length and the
+     * value. Header fields which have no own tag are stored as compact
+     * json in the Tag::ext field. The body follows the routing section
+     * and is never scanned, so it can contain new lines. If
+     * CompressionMask bits of the flags are set, the body is compressed
+     * with that Compression codec and bodyLen is its compressed size.
+     * ContentTypeMask bits tell how the body is encoded (ContentType).
+     * If the Attached flag is set, the frame is followed by the 8 bytes
+     * length of the attached file and the file content (see Attachment).
+     * */
+  namespace frame
+  {
+    using ptree = boost::property_tree::ptree;
+
+    constexpr std::uint8_t Magic = 0xFA;
+    constexpr std::uint8_t Version = 1;
+    constexpr std::size_t PrefixSize = 16;
+    constexpr std::uint16_t CompressionMask = 0x3; //!< flags bits holding Compression of the body
+    constexpr std::uint16_t ContentTypeMask = 0xC; //!< flags bits holding ContentType of the body
+    constexpr unsigned ContentTypeShift = 2;
+    constexpr std::uint16_t Attached = 0x10;       //!< the frame is followed by a file
+    constexpr std::uint16_t KnownFlags = CompressionMask | ContentTypeMask | Attached;
+    constexpr std::size_t AttachedSizeLen = 8;     //!< length of the attached file size
+
+      /** @return codec the body of the frame with these flags is compressed with */
+    [[nodiscard]] inline Compression compression(std::uint16_t flags)
+    {
+      return Compression::_from_integral(static_cast<std::uint8_t>(flags & CompressionMask));
+    }
+
+      /** @return encoding of the body of the message with these flags */
+    [[nodiscard]] inline ContentType contentType(std::uint16_t flags)
+    {
+      return ContentType::_from_integral(static_cast<std::uint8_t>((flags & ContentTypeMask) >> ContentTypeShift));
+    }
+
+      /** @return flags with the content type replaced */
+    [[nodiscard]] inline std::uint16_t withContentType(std::uint16_t flags, ContentType ct)
+    {
+      return static_cast<std::uint16_t>((flags & ~ContentTypeMask) | (ct._to_integral() << ContentTypeShift));
+    }
+
+    enum Tag : std::uint8_t
+    {
+      fromApp = 1, fromNode, toApp, toNode, cname,
+      priority, //!< 1 byte
+      hop,      //!< repeated for every hop
+      deadline, //!< 8 bytes, see MsgHeader::deadline
+      ext = 0x7F
+    };
+
+    struct Prefix
+    {
+      std::uint16_t flags{0};
+      std::uint32_t cnameId{0};
+      std::uint32_t routeLen{0};
+      std::uint32_t bodyLen{0};
+
+      [[nodiscard]] std::size_t frameSize() const { return PrefixSize + routeLen + bodyLen; }
+    };
+
+      /** @return true if a frame (or stream position) starting with that byte is a binary frame */
+    [[nodiscard]] inline bool isBinary(char firstByte) { return static_cast<std::uint8_t>(firstByte) == Magic; }
+
+      /**
+       * Parse fixed frame prefix.
+       * @return prefix or nothing if there are less than PrefixSize bytes
+       * @throw std::runtime_error if data is not a binary frame of supported version
+       * */
+    [[nodiscard]] std::optional<Prefix> parsePrefix(std::string_view data);
+
+      /** FNV-1a hash of the cname, never 0 for non-empty cname */
+    [[nodiscard]] std::uint32_t cnameId(std::string_view cname);
+
+      /**
+       * Encode message into binary frame.
+       * @param header message header
+       * @param body serialized message body
+       * @param out the frame is appended here
+       * */
+    void encode(const MsgHeader &header, std::string_view body, std::vector<char> &out);
+
+      /**
+       * Write frame prefix and routing section, so the body can be
+       * serialized directly after them. endFrame() must be called
+       * when the body is written.
+       * @param bodySizeHint expected body size to reserve space for
+       * @return position of the frame in out
+       * */
+    std::size_t beginFrame(const MsgHeader &header, std::vector<char> &out, std::size_t bodySizeHint = 0);
+
+      /** set body length of the frame started at start, the body is the rest of out */
+    void endFrame(std::vector<char> &out, std::size_t start);
+
+      /**
+       * Encode prefix and routing section of the frame for the body of
+       * known length, which is sent separately (see ByteSlices).
+       * */
+    void encodePrefix(const MsgHeader &header, std::size_t bodyLen, std::vector<char> &out);
+
+      /** encode size of the attached file, it is sent right after the frame */
+    [[nodiscard]] std::vector<char> encodeAttachedSize(std::uint64_t size);
+
+      /** @param data at least AttachedSizeLen bytes following the frame */
+    [[nodiscard]] std::uint64_t attachedSize(std::string_view data);
+
+      /**
+       * Decode prefix and routing section back into the message header
+       * @throw std::runtime_error if routing section is malformed
+       * */
+    [[nodiscard]] MsgHeader decodeHeader(const Prefix &prefix, std::string_view route);
+  }
+}
@@ -0,0 +1,135 @@
+#include "headerscan.h"
+#include "jsoncursor.h"
+#include "viewbuf.h"
+
+#define BOOST_BIND_GLOBAL_PLACEHOLDERS
+#include <boost/property_tree/json_parser.hpp>
+#include <charconv>
+#include <istream>
+#include <string>
+
+namespace uzel::headerscan
+{
+  namespace
+  {
+    using ptree = MsgHeader::ptree;
+
+      /** parse integer field, which is written by write_json as a string */
+    template<typename T>
+    std::optional<T> toInt(std::string_view str)
+    {
+      T val{};
+      const auto *end = str.data() + str.size(); //NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      auto [ptr, ec] = std::from_chars(str.data(), end, val);
+      if(ec != std::errc() || ptr != end) return {};
+      return val;
+    }
+
+    class Scanner : public JsonCursor
+    {
+    public:
+      using JsonCursor::JsonCursor;
+
+      Result run()
+      {
+        Result rez;
+        auto &hdr = rez.header;
+        expect('{');
+        if(!consume('}')) {
+          do {
+            const auto key = string();
+            expect(':');
+            if((key == "from" || key == "to") && peek() == '{') {
+              (key == "from" ? hdr.from : hdr.to) = addr(hdr.ext, key);
+            } else if(key == "cname" && peek() == '"') {
+              hdr.cname = Atom(string());
+            } else if(key == "prio") {
+              const auto val = text();
+              auto prio = toInt<std::uint16_t>(val);
+              if(prio && Priority::_is_valid(*prio)) {
+                hdr.priority = Priority::_from_integral(*prio);
+              } else {
+                hdr.ext.push_back({key, ptree(val)});
+              }
+            } else if(key == "flags") {
+              const auto val = text();
+              if(auto flags = toInt<std::uint16_t>(val)) {
+                hdr.flags = *flags;
+              } else {
+                hdr.ext.push_back({key, ptree(val)});
+              }
+            } else if(key == "dl") {
+              const auto val = text();
+              if(auto deadline = toInt<std::int64_t>(val)) {
+                hdr.deadline = *deadline;
+              } else {
+                hdr.ext.push_back({key, ptree(val)});
+              }
+            } else if(key == "hops" && peek() == '[') {
+              expect('[');
+              if(!consume(']')) {
+                do {
+                  hdr.hops.emplace_back(text());
+                } while(consume(','));
+                expect(']');
+              }
+            } else if(key == "body") {
+              skipWs();
+              const auto start = pos();
+              const auto len = skipValue().size();
+              rez.body.emplace(start, len);
+            } else {
+              parseRaw(hdr.ext, key);
+            }
+          } while(consume(','));
+          expect('}');
+        }
+        skipWs();
+        if(!atEnd()) fail("unexpected characters after the header");
+        return rez;
+      }
+
+    private:
+        /** parse value of the field without own member into the tree */
+      void parseRaw(ptree &dst, const std::string &key)
+      {
+        const auto raw = skipValue();
+        ptree child;
+        view_inputbuf vibuf(raw);
+        std::istream is(&vibuf);
+        boost::property_tree::read_json(is, child);
+        dst.push_back({key, std::move(child)});
+      }
+
+      Addr addr(ptree &ext, const std::string &key)
+      {
+        std::string app;
+        std::string node;
+        expect('{');
+        if(!consume('}')) {
+          do {
+            const auto field = string();
+            expect(':');
+            if(field == "a" && peek() == '"') {
+              app = string();
+            } else if(field == "n" && peek() == '"') {
+              node = string();
+            } else {
+              auto it = ext.find(key);
+              auto &sub = it == ext.not_found() ? ext.push_back({key, ptree()})->second : it->second;
+              parseRaw(sub, field);
+            }
+          } while(consume(','));
+          expect('}');
+        }
+        return Addr(Atom(app), Atom(node));
+      }
+    };
+  }
+
+
+  Result scan(std::string_view line)
+  {
+    return Scanner(line).run();
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "msgheader.h"
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+namespace uzel::headerscan
+{
+  struct Result
+  {
+    MsgHeader header;
+      /** offset and length of the inline "body" value in the scanned line */
+    std::optional<std::pair<std::size_t, std::size_t>> body;
+  };
+
+    /**
+     * Parse json message header line in one pass without building a
+     * property tree.
+     *
+     * Routing fields (see MsgHeader) are extracted directly, the
+     * inline body is only skipped and its position is returned, so it
+     * can be parsed later when (if) the body is needed. Only other,
+     * rare fields are parsed into MsgHeader::ext.
+     * @throw std::runtime_error if the line is not a valid json object
+     * */
+  [[nodiscard]] Result scan(std::string_view line);
+}
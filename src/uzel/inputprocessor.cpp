@@ -2,47 +2,238 @@
 #include "msg.h"
 #include "dbg.h"
 #include "session.h"
+#include "headerscan.h"
 
 #include <boost/log/trivial.hpp>
-#include <boost/property_tree/json_parser.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
 
 namespace uzel
 {
-  bool InputProcessor::processNewInput(std::string_view input, session &ss)
+  std::optional<std::size_t> InputProcessor::processNewInput(const ByteSlice &input, session &ss)
   {
-    m_acculine.addNewInput(input);
-    std::optional<std::string> line;
-    while((line = m_acculine.getNextCmd())) {
-      if(!m_header) { // parsing msg header
-        std::istringstream is(*line);
-        try {
-          m_header = Msg::ptree();
-          boost::property_tree::read_json(is, *m_header);
-          {
-            auto node = m_header->get<std::string>("from.n", "?");
-            auto appn = m_header->get<std::string>("from.a", "?");
-            BOOST_LOG_TRIVIAL(debug) << "got header of the msg from <" << appn << "@"  << node << ">: '" << *line << "'";
+    const auto view = input.view();
+    std::size_t pos = 0;
+    m_wanted = 0;
+    try {
+      while(pos < view.size()) {
+        if(m_stream) {
+          pos = continueStream(input, pos);
+          continue;
+        }
+        if(m_attachment) {
+          pos = continueAttachment(input, pos, ss);
+          if(m_attachment) break;
+          continue;
+        }
+        if(!m_header && m_acculine.idle() && frame::isBinary(view[pos])) {
+          auto prefix = frame::parsePrefix(view.substr(pos));
+          if(!prefix) {
+            m_wanted = frame::PrefixSize;
+            break;
           }
-            // body can be inside header for small messages
-          auto bodyit = m_header->find("body");
-          if(bodyit != m_header->not_found()) {
-            Msg::ptree body;
-            body.swap(bodyit->second);
-            m_header->erase("body");
-            ss.dispatchMsg(std::make_shared<Msg>(std::move(*m_header), std::move(body), ss.weak_from_this()));
-            m_header.reset();
+            // the lengths come from the peer, check them before wanted() grows the receive buffer
+          if(prefix->frameSize() > m_maxFrame) {
+            throw std::runtime_error("binary frame of " + std::to_string(prefix->frameSize()) + " bytes exceeds max_frame_bytes");
           }
+          if(view.size() - pos < prefix->frameSize()) {
+            const auto headSize = frame::PrefixSize + prefix->routeLen;
+              // compressed body can not be inflated by parts, files are received whole
+            if(!m_buffering && prefix->bodyLen >= StreamBodySize && frame::compression(prefix->flags) == +Compression::none &&
+               (prefix->flags & frame::Attached) == 0) {
+              if(view.size() - pos < headSize) {
+                m_wanted = headSize;
+                break;
+              }
+              if(beginStream(*prefix, input, pos, ss)) {
+                pos += headSize;
+                continue;
+              }
+              m_buffering = true;
+            }
+            m_wanted = prefix->frameSize();
+            break;
+          }
+          if((prefix->flags & frame::Attached) != 0) {
+            if(view.size() - pos < prefix->frameSize() + frame::AttachedSizeLen) {
+              m_wanted = prefix->frameSize() + frame::AttachedSizeLen;
+              break;
+            }
+            if(!ss.authenticated()) {
+              throw std::runtime_error("attached file before authentication");
+            }
+              // the size comes from the peer, every hop spools the whole file
+            const auto fileSize = frame::attachedSize(view.substr(pos + prefix->frameSize()));
+            if(fileSize > m_maxAttachment) {
+              throw std::runtime_error("attached file of " + std::to_string(fileSize) + " bytes exceeds max_attachment_bytes");
+            }
+            m_buffering = false;
+            beginAttachment(decodeFrame(*prefix, input.sub(pos, prefix->frameSize()), ss), fileSize);
+            pos += prefix->frameSize() + frame::AttachedSizeLen;
+            if(m_attachment->remaining == 0) {
+              attachmentReceived(0, ss);
+            }
+            continue;
+          }
+          m_buffering = false;
+          ss.dispatchMsg(decodeFrame(*prefix, input.sub(pos, prefix->frameSize()), ss));
+          pos += prefix->frameSize();
+          continue;
+        }
+        pos = processLines(input, pos, ss);
+        if(view.size() - pos > m_maxFrame) {
+          throw std::runtime_error("incomplete json message of " + std::to_string(view.size() - pos) + " bytes exceeds max_frame_bytes");
+        }
+        if(m_header || !m_acculine.idle() || pos == view.size()) break;
+      }
+    }
+    catch (const std::exception &ex) {
+      BOOST_LOG_TRIVIAL(error) << "Closing connection because can not parse received message: " << ex.what();
+      return {};
+    }
+    return pos;
+  }
+
+
+  std::size_t InputProcessor::processLines(const ByteSlice &input, std::size_t pos, session &ss)
+  {
+    const auto view = input.view();
+      // the header line waiting for the body is not consumed, lines continue after it
+    m_acculine.addNewInput(view.substr(pos + m_headerLen));
+    while(auto line = m_acculine.getNextCmd()) {
+      const auto off = static_cast<std::size_t>(line->data() - view.data());
+      const auto next = off + line->size() + 1;
+      if(!m_header) { // parsing msg header
+        std::optional<std::pair<std::size_t, std::size_t>> inlineBody;
+        try {
+          auto scanned = headerscan::scan(*line);
+          m_header = std::move(scanned.header);
+          inlineBody = scanned.body;
+          BOOST_LOG_TRIVIAL(debug) << "got header of the msg from <" << m_header->from << ">: '" << *line << "'";
         }
         catch (...) {
           BOOST_LOG_TRIVIAL(error) << "Closing connection because can not parse received json header " << *line;
-          return false;
+          throw;
         }
-        continue;
+          // body can be inside header for small messages, it is parsed only when needed
+        if(inlineBody) {
+          auto msg = std::make_shared<Msg>(std::move(*m_header), input.sub(off + inlineBody->first, inlineBody->second), ss.weak_from_this());
+          m_header.reset();
+          msg->setWire(input.sub(off, next - off), Framing::json);
+          ss.dispatchMsg(msg);
+          pos = next;
+        } else {
+          m_headerLen = next - off;
+        }
+      } else {
+          // keep header and body lines together as received,
+          // so the message can be forwarded without serializing it again
+        auto msg = std::make_shared<Msg>(std::move(*m_header), input.sub(off, line->size()), ss.weak_from_this());
+        msg->setWire(input.sub(pos, next - pos), Framing::json);
+        m_header.reset();
+        m_headerLen = 0;
+        ss.dispatchMsg(msg);
+        pos = next;
       }
-        // create msg
-      ss.dispatchMsg(std::make_shared<Msg>(std::move(*m_header), std::move(*line), ss.weak_from_this()));
-      m_header.reset();
+      if(!m_header && pos < view.size() && frame::isBinary(view[pos])) break;
     }
+    return pos;
+  }
+
+
+  bool InputProcessor::beginStream(const frame::Prefix &prefix, const ByteSlice &input, std::size_t pos, session &ss)
+  {
+    if(!ss.authenticated()) return false;
+    auto header = frame::decodeHeader(prefix, input.view().substr(pos + frame::PrefixSize, prefix.routeLen));
+    auto msg = std::make_shared<Msg>(std::move(header), ByteSlice(), ss.weak_from_this());
+    auto dispatcher = ss.dispatcher();
+    if(!msg->toMe() || !dispatcher->wantsStream(msg->hdr().cname)) return false;
+    BOOST_LOG_TRIVIAL(debug) << "streaming body of binary frame from " << msg->from() << ", body size " << prefix.bodyLen;
+    dispatcher->dispatchStreamBegin(msg, prefix.bodyLen);
+    m_stream = Stream{std::move(msg), std::move(dispatcher), prefix.bodyLen};
     return true;
   }
+
+
+  std::size_t InputProcessor::continueStream(const ByteSlice &input, std::size_t pos)
+  {
+    const auto len = std::min(m_stream->remaining, input.size() - pos);
+    if(len > 0) {
+      m_stream->dispatcher->dispatchStreamChunk(m_stream->msg, input.sub(pos, len));
+      m_stream->remaining -= len;
+    }
+    if(m_stream->remaining == 0) {
+      m_stream->dispatcher->dispatchStreamEnd(m_stream->msg, true);
+      m_stream.reset();
+    }
+    return pos + len;
+  }
+
+
+  void InputProcessor::abortStream()
+  {
+    if(!m_stream) return;
+    m_stream->dispatcher->dispatchStreamEnd(m_stream->msg, false);
+    m_stream.reset();
+  }
+
+
+  void InputProcessor::beginAttachment(Msg::shr_t msg, std::uint64_t size)
+  {
+    const auto name = msg->hdr().ext.get<std::string>("file", "");
+    BOOST_LOG_TRIVIAL(debug) << "receiving file '" << name << "' of " << size << " bytes from " << msg->from();
+    msg->attach(Attachment::spool(UConfigS::getUConfig().spoolDir(), name, size));
+    m_attachment = Incoming{std::move(msg), size};
+  }
+
+
+  std::size_t InputProcessor::continueAttachment(const ByteSlice &input, std::size_t pos, session &ss)
+  {
+    const auto len = static_cast<std::size_t>(std::min<std::uint64_t>(m_attachment->remaining, input.size() - pos));
+    const auto view = input.view().substr(pos, len);
+    std::size_t written{0};
+    while(written < len) {
+      const auto res = ::write(attachmentFd(), std::next(view.data(), static_cast<std::ptrdiff_t>(written)), len - written);
+      if(res < 0 && errno == EINTR) continue;
+      if(res <= 0) {
+        throw std::runtime_error("can not write attachment '" + m_attachment->msg->attachment()->path() + "': " + std::strerror(errno));
+      }
+      written += static_cast<std::size_t>(res);
+    }
+    attachmentReceived(len, ss);
+    return pos + len;
+  }
+
+
+  void InputProcessor::attachmentReceived(std::uint64_t len, session &ss)
+  {
+    m_attachment->remaining -= len;
+    if(m_attachment->remaining > 0) return;
+    auto msg = std::move(m_attachment->msg);
+    m_attachment.reset();
+    ss.dispatchMsg(std::move(msg));
+  }
+
+
+  Msg::shr_t InputProcessor::decodeFrame(const frame::Prefix &prefix, ByteSlice data, session &ss)
+  {
+    auto header = frame::decodeHeader(prefix, data.view().substr(frame::PrefixSize, prefix.routeLen));
+    auto body = data.sub(frame::PrefixSize + prefix.routeLen, prefix.bodyLen);
+    BOOST_LOG_TRIVIAL(debug) << "got binary frame of the msg from " << header.from << ", body size " << body.size();
+    const auto codec = frame::compression(prefix.flags);
+    if(codec == +Compression::none) {
+      auto msg = std::make_shared<Msg>(std::move(header), std::move(body), ss.weak_from_this());
+      msg->setWire(std::move(data), Framing::binary);
+      return msg;
+    }
+    ByteSlice inflated(compress::inflate(codec, body.view(), std::min(m_maxFrame, compress::MaxInflatedSize)));
+    m_inflated.add(inflated.size(), body.size());
+      // the message is plain from now on, the flags are set again when it is compressed
+    header.flags = static_cast<std::uint16_t>(header.flags & ~frame::CompressionMask);
+    auto msg = std::make_shared<Msg>(std::move(header), std::move(inflated), ss.weak_from_this());
+    msg->setCompressedWire(std::move(data), codec, prefix.bodyLen);
+    return msg;
+  }
 }
@@ -3,10 +3,14 @@
 #include "acculine.h"
 #include "addr.h"
 #include "msg.h"
+#include "frame.h"
+#include "byteslice.h"
+#include "dispatcher.h"
 
 #define BOOST_BIND_GLOBAL_PLACEHOLDERS
 #include <boost/property_tree/ptree.hpp>
 #include <boost/signals2.hpp>
+#include <limits>
 #include <string_view>
 #include <optional>
 
@@ -19,21 +23,91 @@ namespace uzel
      * and dispatch them to consumers which must be connected to the
      * s_dispatch() signal.
      *
-     * Currently only json messages are supported. Each message has
-     * message header and message body. No new lines inside
-     * the message body or message header is allowed.
+     * Two framings are supported and detected per message by the
+     * first byte: json lines and length-prefixed binary frames (see
+     * frame.h).
      *
+     * Json messages have message header and message body. No new
+     * lines inside the message body or message header is allowed.
      * Big messages can be splitted into 2 parts, separated by new
      * line, the message header and the message body. Small messages can
      * be sent in one line. Splitted messages allows to parse header
      * only, the unparsed part can be forwarded as a string to
-     * the receiver.
+     * the receiver. The header is scanned for the routing fields only
+     * (see headerscan.h), the inline body is not parsed either.
+     *
+     * Binary frames are sliced out of the stream by their length
+     * prefix without scanning, the body is always left unparsed.
+     * Compressed bodies are decompressed before dispatching, the
+     * received frame is kept to forward it compressed (see
+     * Msg::setCompressedWire()).
+     *
+     * Messages are parsed in place: bodies and received bytes of the
+     * dispatched messages are slices of the input, nothing is copied.
+     *
+     * Bodies of binary frames from StreamBodySize, which are not
+     * received completely yet, are streamed if some handler wants
+     * them (see MsgDispatcher::StreamHandler): the header is
+     * dispatched as soon as it is received and the body follows in
+     * chunks as they arrive, so the frame is never buffered whole.
+     *
+     * Files attached to binary frames (frame::Attached) are written to
+     * the spool directory: the part already read into the input is
+     * written from it, the rest is moved by the session straight from
+     * the socket (see attachmentRemaining()). The message is dispatched
+     * when the whole file is received.
      * */
   class InputProcessor
   {
   public:
-      /** process new input string */
-    bool processNewInput(std::string_view input, session &ss);
+      /**
+       * @param maxFrame bigger messages and json lines are refused, streamed ones too (see RecvLimits)
+       * @param maxAttachment bigger attached files are refused before they are spooled
+       * */
+    explicit InputProcessor(std::size_t maxFrame = std::numeric_limits<std::size_t>::max(),
+                            std::uint64_t maxAttachment = std::numeric_limits<std::uint64_t>::max())
+      : m_maxFrame(maxFrame), m_maxAttachment(maxAttachment)
+    {
+    }
+
+      /**
+       * process new input
+       * @param input received data, must start with the not consumed
+       * rest of the previous input
+       * @return number of consumed bytes (complete messages) or nothing
+       * if the input can not be parsed
+       * */
+    std::optional<std::size_t> processNewInput(const ByteSlice &input, session &ss);
+
+      /**
+       * @return size of the incomplete message at the beginning of
+       * not consumed input if it is known (binary frame), otherwise 0;
+       * bigger frames than maxFrame are refused before they are wanted
+       * */
+    [[nodiscard]] std::size_t wanted() const { return m_wanted; }
+
+      /** the body is being streamed */
+    [[nodiscard]] bool streaming() const { return m_stream.has_value(); }
+      /** the connection is lost, finish the stream in progress as incomplete */
+    void abortStream();
+
+      /**
+       * @return bytes of the attached file still to be received, the
+       * session moves them from the socket to attachmentFd() and calls
+       * attachmentReceived() before reading the next input
+       * */
+    [[nodiscard]] std::uint64_t attachmentRemaining() const { return m_attachment ? m_attachment->remaining : 0; }
+    [[nodiscard]] int attachmentFd() const { return m_attachment->msg->attachment()->fd(); }
+      /** len bytes of the file were written, dispatch the message if it is complete */
+    void attachmentReceived(std::uint64_t len, session &ss);
+      /** the connection is lost, drop the incomplete file */
+    void abortAttachment() { m_attachment.reset(); }
+
+      /** smaller bodies are always dispatched whole */
+    static constexpr std::size_t StreamBodySize = 256UL*1024;
+
+      /** received compressed messages */
+    [[nodiscard]] const compress::Stats &inflated() const { return m_inflated; }
 
     // NOLINTBEGIN(misc-non-private-member-variables-in-classes,cppcoreguidelines-non-private-member-variables-in-classes)
     //   /** signal fired if authentication failed */
@@ -46,10 +120,60 @@ namespace uzel
     // NOLINTEND(misc-non-private-member-variables-in-classes,cppcoreguidelines-non-private-member-variables-in-classes)
 
   private:
-      /** process input stream, parse messages */
+      /**
+       * process json lines starting at pos
+       * @return position after the last complete message
+       * */
+    std::size_t processLines(const ByteSlice &input, std::size_t pos, session &ss);
+      /** decode complete binary frame */
+    [[nodiscard]] Msg::shr_t decodeFrame(const frame::Prefix &prefix, ByteSlice data, session &ss);
+      /**
+       * create the spool file for the attachment of the frame
+       * @param msg decoded frame
+       * */
+    void beginAttachment(Msg::shr_t msg, std::uint64_t size);
+      /** @return position after the part of the file written from the input */
+    std::size_t continueAttachment(const ByteSlice &input, std::size_t pos, session &ss);
+      /**
+       * start streaming the body of the frame at pos, its prefix and
+       * routing section are received already
+       * @return false if nobody wants the stream
+       * */
+    bool beginStream(const frame::Prefix &prefix, const ByteSlice &input, std::size_t pos, session &ss);
+      /** @return position after the streamed part of the input */
+    std::size_t continueStream(const ByteSlice &input, std::size_t pos);
+
+    struct Incoming
+    {
+      Msg::shr_t msg;                 //!< with the spool file attached
+      std::uint64_t remaining{0};     //!< file bytes not received yet
+    };
+
+    struct Stream
+    {
+      Msg::shr_t msg;                 //!< header only
+      MsgDispatcher::shr_t dispatcher;
+      std::size_t remaining{0};       //!< body bytes not received yet
+    };
+
+    std::size_t m_maxFrame;
+    std::uint64_t m_maxAttachment;
+      /** splits json lines */
     AccuLine m_acculine{};
       /** temporal storage for the message header */
-    std::optional<boost::property_tree::ptree> m_header;
+    std::optional<MsgHeader> m_header;
+      /** length of the header line (with new line), which waits for the body line */
+    std::size_t m_headerLen{0};
+      /** see wanted() */
+    std::size_t m_wanted{0};
+      /** body being streamed */
+    std::optional<Stream> m_stream;
+      /** file being received */
+    std::optional<Incoming> m_attachment;
+      /** the incomplete frame at the input start is buffered, it was not wanted as a stream */
+    bool m_buffering{false};
+      /** see inflated() */
+    compress::Stats m_inflated;
   };
 
 };
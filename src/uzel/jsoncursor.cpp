@@ -0,0 +1,195 @@
+#include "jsoncursor.h"
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+namespace uzel
+{
+  namespace
+  {
+    void appendUtf8(std::string &out, std::uint32_t cp)
+    {
+      if(cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+      } else if(cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+      } else if(cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+      } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+      }
+    }
+  }
+
+
+  void JsonCursor::fail(const char *what) const
+  {
+    throw std::runtime_error(std::string("malformed json at position ") + std::to_string(m_pos) + ": " + what);
+  }
+
+
+  void JsonCursor::skipWs()
+  {
+    while(m_pos < m_json.size()) {
+      const char ch = m_json[m_pos];
+      if(ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n') break;
+      ++m_pos;
+    }
+  }
+
+
+  char JsonCursor::peek()
+  {
+    skipWs();
+    if(m_pos == m_json.size()) fail("unexpected end");
+    return m_json[m_pos];
+  }
+
+
+  void JsonCursor::expect(char ch)
+  {
+    if(peek() != ch) fail("unexpected character");
+    ++m_pos;
+  }
+
+
+  bool JsonCursor::consume(char ch)
+  {
+    if(peek() != ch) return false;
+    ++m_pos;
+    return true;
+  }
+
+
+  std::string JsonCursor::string()
+  {
+    expect('"');
+    std::string rez;
+    while(true) {
+      const auto end = m_json.find_first_of("\"\\", m_pos);
+      if(end == std::string_view::npos) fail("unterminated string");
+      rez.append(m_json.substr(m_pos, end - m_pos));
+      m_pos = end + 1;
+      if(m_json[end] == '"') return rez;
+      if(m_pos == m_json.size()) fail("unterminated string");
+      const char esc = m_json[m_pos++];
+      switch(esc) {
+      case '"': case '\\': case '/': rez.push_back(esc); break;
+      case 'b': rez.push_back('\b'); break;
+      case 'f': rez.push_back('\f'); break;
+      case 'n': rez.push_back('\n'); break;
+      case 'r': rez.push_back('\r'); break;
+      case 't': rez.push_back('\t'); break;
+      case 'u': {
+        auto cp = hex4();
+        if(cp >= 0xD800 && cp < 0xDC00 && m_json.substr(m_pos, 2) == "\\u") {
+          m_pos += 2;
+          const auto low = hex4();
+          if(low < 0xDC00 || low >= 0xE000) fail("invalid surrogate pair");
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        appendUtf8(rez, cp);
+        break;
+      }
+      default: fail("invalid escape");
+      }
+    }
+  }
+
+
+  bool JsonCursor::skipString()
+  {
+    expect('"');
+    bool escaped{false};
+    while(true) {
+      const auto end = m_json.find_first_of("\"\\", m_pos);
+      if(end == std::string_view::npos) fail("unterminated string");
+      m_pos = end + 1;
+      if(m_json[end] == '"') return escaped;
+      escaped = true;
+      ++m_pos; // escaped character
+    }
+  }
+
+
+  std::string_view JsonCursor::stringView(std::string &buf)
+  {
+    peek();
+    const auto start = m_pos;
+    if(!skipString()) {
+      return m_json.substr(start + 1, m_pos - start - 2);
+    }
+    m_pos = start;
+    buf = string();
+    return buf;
+  }
+
+
+  std::uint32_t JsonCursor::hex4()
+  {
+    if(m_json.size() - m_pos < 4) fail("invalid \\u escape");
+    std::uint32_t cp{0};
+    const auto *begin = std::next(m_json.data(), static_cast<std::ptrdiff_t>(m_pos));
+    auto [ptr, ec] = std::from_chars(begin, std::next(begin, 4), cp, 16);
+    if(ec != std::errc() || ptr != std::next(begin, 4)) fail("invalid \\u escape");
+    m_pos += 4;
+    return cp;
+  }
+
+
+  std::string_view JsonCursor::scalar()
+  {
+    skipWs();
+    const auto end = std::min(m_json.find_first_of(",}] \t\r\n", m_pos), m_json.size());
+    if(end == m_pos) fail("value expected");
+    auto rez = m_json.substr(m_pos, end - m_pos);
+    m_pos = end;
+    return rez;
+  }
+
+
+  std::string JsonCursor::text()
+  {
+    if(peek() == '"') return string();
+    return std::string(scalar());
+  }
+
+
+  std::string_view JsonCursor::skipValue()
+  {
+    skipWs();
+    const auto start = m_pos;
+    const char first = peek();
+    if(first == '"') {
+      skipString();
+    } else if(first == '{' || first == '[') {
+      std::size_t depth{0};
+      do {
+        const auto next = m_json.find_first_of("\"{}[]", m_pos);
+        if(next == std::string_view::npos) fail("unterminated value");
+        m_pos = next;
+        const char ch = m_json[next];
+        if(ch == '"') {
+          skipString();
+          continue;
+        }
+        ++m_pos;
+        if(ch == '{' || ch == '[') {
+          ++depth;
+        } else {
+          --depth;
+        }
+      } while(depth > 0);
+    } else {
+      scalar();
+    }
+    return m_json.substr(start, m_pos - start);
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace uzel
+{
+    /**
+     * Forward-only cursor over json text.
+     *
+     * Allows to read the values one by one and to skip not interesting
+     * values without parsing them, so only the needed part of the text
+     * is looked at and nothing is allocated for the skipped values.
+     * All methods throw std::runtime_error on malformed json.
+     * */
+  class JsonCursor
+  {
+  public:
+    explicit JsonCursor(std::string_view json) : m_json(json) {}
+
+    [[noreturn]] void fail(const char *what) const;
+
+    void skipWs();
+      /** @return next not white space character, does not consume it */
+    char peek();
+    void expect(char ch);
+      /** consume next not white space character if it is ch */
+    bool consume(char ch);
+      /** parse string, unescape it if needed */
+    std::string string();
+      /**
+       * skip string without unescaping it
+       * @return true if the string contains escape sequences
+       * */
+    bool skipString();
+      /**
+       * parse string without copying it if there is nothing to unescape
+       * @param buf storage for the unescaped string
+       * @return view into the json text or into buf
+       * */
+    std::string_view stringView(std::string &buf);
+      /** number, true, false or null as is */
+    std::string_view scalar();
+      /** string or scalar value as text */
+    std::string text();
+      /**
+       * skip json value without parsing it, nested values are not validated
+       * @return text of the value
+       * */
+    std::string_view skipValue();
+
+    [[nodiscard]] std::size_t pos() const { return m_pos; }
+    [[nodiscard]] bool atEnd() const { return m_pos == m_json.size(); }
+
+  private:
+    std::uint32_t hex4();
+
+    std::string_view m_json;
+    std::size_t m_pos{0};
+  };
+}
@@ -0,0 +1,219 @@
+#include "jsonwriter.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace uzel::jsonwriter
+{
+  namespace
+  {
+    using ptree = boost::property_tree::ptree;
+
+    constexpr std::array<bool, 256> makeEscapeTable()
+    {
+      std::array<bool, 256> table{};
+      for(std::size_t ch = 0; ch < 0x20; ++ch) {
+        table.at(ch) = true;
+      }
+      table.at('"') = true;
+      table.at('\\') = true;
+      return table;
+    }
+
+    constexpr auto NeedsEscape = makeEscapeTable();
+
+    template<typename Buf>
+    void append(Buf &out, std::string_view str)
+    {
+      out.insert(out.end(), str.begin(), str.end());
+    }
+
+      /** separator and key of the next object field */
+    template<typename Buf>
+    void key(Buf &out, bool &first, std::string_view name)
+    {
+      if(!first) out.push_back(',');
+      first = false;
+      writeString(out, name);
+      out.push_back(':');
+    }
+
+    template<typename Buf>
+    void writeNode(Buf &out, const ptree &pt);
+
+    template<typename Buf>
+    void writeMembers(Buf &out, const ptree &pt, bool &first)
+    {
+      for(auto &&child : pt) {
+        key(out, first, child.first);
+        writeNode(out, child.second);
+      }
+    }
+
+    template<typename Buf>
+    void writeNode(Buf &out, const ptree &pt)
+    {
+      if(pt.empty()) {
+        writeString(out, pt.data());
+      } else if(pt.count(std::string()) == pt.size()) {
+        out.push_back('[');
+        bool first{true};
+        for(auto &&child : pt) {
+          if(!first) out.push_back(',');
+          first = false;
+          writeNode(out, child.second);
+        }
+        out.push_back(']');
+      } else {
+        out.push_back('{');
+        bool first{true};
+        writeMembers(out, pt, first);
+        out.push_back('}');
+      }
+    }
+
+      /** address with the fields from ext merged in */
+    template<typename Buf>
+    void writeAddr(Buf &out, bool &first, std::string_view name, const Addr &addr, const ptree *ext)
+    {
+      key(out, first, name);
+      out.push_back('{');
+      bool firstField{true};
+      if(!addr.nodeAtom().empty()) {
+        key(out, firstField, "n");
+        writeString(out, addr.node());
+      }
+      if(!addr.appAtom().empty()) {
+        key(out, firstField, "a");
+        writeString(out, addr.app());
+      }
+      if(ext != nullptr) {
+        for(auto &&child : *ext) {
+          if((child.first == "n" && !addr.nodeAtom().empty()) || (child.first == "a" && !addr.appAtom().empty())) continue;
+          key(out, firstField, child.first);
+          writeNode(out, child.second);
+        }
+      }
+      out.push_back('}');
+    }
+
+    template<typename Buf>
+    void writeNumber(Buf &out, std::int64_t val)
+    {
+      writeString(out, std::to_string(val));
+    }
+  }
+
+
+  template<typename Buf>
+  void writeString(Buf &out, std::string_view str)
+  {
+    out.push_back('"');
+    std::size_t from = 0;
+    for(std::size_t ii = 0; ii < str.size(); ++ii) {
+      const auto ch = static_cast<unsigned char>(str[ii]);
+      if(!NeedsEscape.at(ch)) continue;
+      append(out, str.substr(from, ii - from));
+      from = ii + 1;
+      switch(ch) {
+      case '"': append(out, "\\\""); break;
+      case '\\': append(out, "\\\\"); break;
+      case '\n': append(out, "\\n"); break;
+      case '\r': append(out, "\\r"); break;
+      case '\t': append(out, "\\t"); break;
+      default: {
+        const std::string_view hex("0123456789abcdef");
+        append(out, "\\u00");
+        out.push_back(hex[ch >> 4U]);
+        out.push_back(hex[ch & 0xFU]);
+      }
+      }
+    }
+    append(out, str.substr(from));
+    out.push_back('"');
+  }
+
+
+  template<typename Buf>
+  void writePtree(Buf &out, const ptree &pt)
+  {
+    if(pt.empty() && !pt.data().empty()) {
+      writeString(out, pt.data());
+      return;
+    }
+    out.push_back('{');
+    bool first{true};
+    writeMembers(out, pt, first);
+    out.push_back('}');
+  }
+
+
+  template<typename Buf>
+  bool writeHeader(Buf &out, const MsgHeader &hdr, bool close)
+  {
+    out.push_back('{');
+    bool first{true};
+    const auto extFrom = hdr.ext.get_child_optional(ptree::path_type("from", '\0'));
+    const auto extTo = hdr.ext.get_child_optional(ptree::path_type("to", '\0'));
+    if(!hdr.from.empty()) {
+      writeAddr(out, first, "from", hdr.from, extFrom.get_ptr());
+    }
+    if(!hdr.to.empty()) {
+      writeAddr(out, first, "to", hdr.to, extTo.get_ptr());
+    }
+    if(!hdr.cname.empty()) {
+      key(out, first, "cname");
+      writeString(out, hdr.cname.str());
+    }
+    const bool hasPrio = hdr.priority != +Priority::undefined;
+    if(hasPrio) {
+      key(out, first, "prio");
+      writeNumber(out, hdr.priority._to_integral());
+    }
+    if(hdr.flags != 0) {
+      key(out, first, "flags");
+      writeNumber(out, hdr.flags);
+    }
+    if(hdr.deadline != 0) {
+      key(out, first, "dl");
+      writeNumber(out, hdr.deadline);
+    }
+    if(!hdr.hops.empty()) {
+      key(out, first, "hops");
+      out.push_back('[');
+      bool firstHop{true};
+      for(auto &&hop : hdr.hops) {
+        if(!firstHop) out.push_back(',');
+        firstHop = false;
+        writeString(out, hop.str());
+      }
+      out.push_back(']');
+    }
+      // other fields, unless they were already written from own members
+    for(auto &&child : hdr.ext) {
+      const auto &name = child.first;
+      if((name == "from" && !hdr.from.empty()) || (name == "to" && !hdr.to.empty()) ||
+         (name == "cname" && !hdr.cname.empty()) || (name == "prio" && hasPrio) ||
+         (name == "flags" && hdr.flags != 0) || (name == "dl" && hdr.deadline != 0) ||
+         (name == "hops" && !hdr.hops.empty())) {
+        continue;
+      }
+      key(out, first, name);
+      writeNode(out, child.second);
+    }
+    if(close) {
+      out.push_back('}');
+    }
+    return !first;
+  }
+
+
+  template void writeString(std::string &out, std::string_view str);
+  template void writeString(std::vector<char> &out, std::string_view str);
+  template void writePtree(std::string &out, const ptree &pt);
+  template void writePtree(std::vector<char> &out, const ptree &pt);
+  template bool writeHeader(std::string &out, const MsgHeader &hdr, bool close);
+  template bool writeHeader(std::vector<char> &out, const MsgHeader &hdr, bool close);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "msgheader.h"
+
+#include <boost/property_tree/ptree.hpp>
+#include <string_view>
+
+namespace uzel::jsonwriter
+{
+    /**
+     * Compact json serialization straight into the output buffer.
+     *
+     * Replaces write_json with ostringstream: nothing is formatted
+     * through streams and no intermediate strings are built. The
+     * output is appended to out, which is std::string or
+     * std::vector<char>.
+     * */
+
+    /** quoted and escaped string, runs without special characters are copied at once */
+  template<typename Buf>
+  void writeString(Buf &out, std::string_view str);
+
+    /**
+     * property tree the same way as write_json does: leaves are
+     * strings, nodes with empty keys only are arrays and the root is
+     * always an object
+     * */
+  template<typename Buf>
+  void writePtree(Buf &out, const boost::property_tree::ptree &pt);
+
+    /**
+     * message header, the same as write_json of MsgHeader::toPtree()
+     * without building the tree
+     * @param close false to leave the object open, so more fields can be appended
+     * @return true if at least one field was written
+     * */
+  template<typename Buf>
+  bool writeHeader(Buf &out, const MsgHeader &hdr, bool close = true);
+}
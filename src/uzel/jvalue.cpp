@@ -0,0 +1,357 @@
+#include "jvalue.h"
+#include "jsoncursor.h"
+#include "jsonwriter.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace uzel
+{
+  namespace
+  {
+      /** protects stack from too deeply nested input */
+    constexpr std::size_t MaxDepth = 512;
+
+    template<typename Buf, typename T>
+    void writeNumber(Buf &out, T val)
+    {
+      std::array<char, 32> buf{};
+      auto [ptr, ec] = std::to_chars(buf.data(), std::next(buf.data(), static_cast<std::ptrdiff_t>(buf.size())), val);
+      out.insert(out.end(), buf.data(), ptr);
+    }
+
+    template<typename Buf>
+    void appendText(Buf &out, std::string_view str)
+    {
+      out.insert(out.end(), str.begin(), str.end());
+    }
+
+    class Parser : public JsonCursor
+    {
+    public:
+      explicit Parser(std::string_view json) : JsonCursor(json), m_json(json) {}
+
+      void value(JValue &val, std::size_t depth)
+      {
+        if(depth > MaxDepth) fail("too deeply nested");
+        switch(peek()) {
+        case '{': {
+          expect('{');
+          auto &obj = val.makeObject();
+          if(consume('}')) return;
+          do {
+            obj.emplace_back(std::piecewise_construct, std::forward_as_tuple(stringView()), std::forward_as_tuple(val.resource()));
+            expect(':');
+            value(obj.back().second, depth + 1);
+          } while(consume(','));
+          expect('}');
+          return;
+        }
+        case '[': {
+          expect('[');
+          auto &arr = val.makeArray();
+          if(consume(']')) return;
+          do {
+            value(arr.emplace_back(val.resource()), depth + 1);
+          } while(consume(','));
+          expect(']');
+          return;
+        }
+        case '"':
+          val.setString(stringView());
+          return;
+        default:
+          scalar(val);
+        }
+      }
+
+    private:
+        /** string value, points into the input if there are no escapes */
+      std::string_view stringView()
+      {
+        skipWs();
+        const auto start = pos();
+        const bool escaped = skipString();
+        const auto token = m_json.substr(start, pos() - start);
+        if(!escaped) return token.substr(1, token.size() - 2);
+        m_unescaped = JsonCursor(token).string();
+        return m_unescaped;
+      }
+
+      void scalar(JValue &val)
+      {
+        const auto token = JsonCursor::scalar();
+        if(token == "true") {
+          val.setBool(true);
+        } else if(token == "false") {
+          val.setBool(false);
+        } else if(token == "null") {
+          val.setNull();
+        } else {
+          const auto *end = std::next(token.data(), static_cast<std::ptrdiff_t>(token.size()));
+          if(token.find_first_of(".eE") == std::string_view::npos) {
+            std::int64_t ival{0};
+            auto [ptr, ec] = std::from_chars(token.data(), end, ival);
+            if(ec == std::errc() && ptr == end) {
+              val.setInt(ival);
+              return;
+            }
+          }
+          double dval{0};
+          auto [ptr, ec] = std::from_chars(token.data(), end, dval);
+          if(ec != std::errc() || ptr != end) fail("invalid value");
+          val.setReal(dval);
+        }
+      }
+
+      std::string_view m_json;
+      std::string m_unescaped; //!< storage for the last string with escapes
+    };
+  }
+
+
+  bool JValue::asBool() const
+  {
+    if(const auto *val = std::get_if<bool>(&m_v)) return *val;
+    throw std::runtime_error("json value is not a boolean");
+  }
+
+
+  std::int64_t JValue::asInt() const
+  {
+    if(const auto *val = std::get_if<std::int64_t>(&m_v)) return *val;
+    throw std::runtime_error("json value is not an integer");
+  }
+
+
+  double JValue::asDouble() const
+  {
+    if(const auto *val = std::get_if<double>(&m_v)) return *val;
+    if(const auto *val = std::get_if<std::int64_t>(&m_v)) return static_cast<double>(*val);
+    throw std::runtime_error("json value is not a number");
+  }
+
+
+  std::string_view JValue::asString() const
+  {
+    if(const auto *val = std::get_if<string_t>(&m_v)) return *val;
+    throw std::runtime_error("json value is not a string");
+  }
+
+
+  const JValue::array_t &JValue::array() const
+  {
+    if(const auto *val = std::get_if<array_t>(&m_v)) return *val;
+    throw std::runtime_error("json value is not an array");
+  }
+
+
+  const JValue::object_t &JValue::object() const
+  {
+    if(const auto *val = std::get_if<object_t>(&m_v)) return *val;
+    throw std::runtime_error("json value is not an object");
+  }
+
+
+  const JValue *JValue::find(std::string_view key) const
+  {
+    const auto *obj = std::get_if<object_t>(&m_v);
+    if(obj == nullptr) return nullptr;
+    for(auto &&member : *obj) {
+      if(member.first == key) return &member.second;
+    }
+    return nullptr;
+  }
+
+
+  const JValue *JValue::findPath(std::string_view path) const
+  {
+    const auto *val = this;
+    while(val != nullptr) {
+      const auto dot = path.find('.');
+      val = val->find(path.substr(0, dot));
+      if(dot == std::string_view::npos) break;
+      path.remove_prefix(dot + 1);
+    }
+    return val;
+  }
+
+
+  std::string JValue::text() const
+  {
+    switch(kind()) {
+    case Kind::null: return "null";
+    case Kind::boolean: return asBool() ? "true" : "false";
+    case Kind::string: return std::string(asString());
+    case Kind::integer:
+    case Kind::real: {
+      std::string out;
+      write(out);
+      return out;
+    }
+    default: return {};
+    }
+  }
+
+
+  JValue::object_t &JValue::makeObject()
+  {
+    if(!isObject()) m_v.emplace<object_t>(m_res);
+    return std::get<object_t>(m_v);
+  }
+
+
+  JValue::array_t &JValue::makeArray()
+  {
+    if(!isArray()) m_v.emplace<array_t>(m_res);
+    return std::get<array_t>(m_v);
+  }
+
+
+  JValue &JValue::operator[](std::string_view key)
+  {
+    if(isNull()) makeObject();
+    auto &obj = std::get<object_t>(m_v); // throws if not an object
+    for(auto &&member : obj) {
+      if(member.first == key) return member.second;
+    }
+    return obj.emplace_back(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(m_res)).second;
+  }
+
+
+  JValue &JValue::append()
+  {
+    if(isNull()) makeArray();
+    return std::get<array_t>(m_v).emplace_back(m_res);
+  }
+
+
+  JValue::ptree JValue::toPtree() const
+  {
+    ptree pt;
+    if(const auto *obj = std::get_if<object_t>(&m_v)) {
+      for(auto &&member : *obj) {
+        pt.push_back({std::string(member.first), member.second.toPtree()});
+      }
+    } else if(const auto *arr = std::get_if<array_t>(&m_v)) {
+      for(auto &&elem : *arr) {
+        pt.push_back({"", elem.toPtree()});
+      }
+    } else {
+      pt.data() = text();
+    }
+    return pt;
+  }
+
+
+  void JValue::assign(const ptree &pt)
+  {
+    if(pt.empty()) {
+      setString(pt.data());
+      return;
+    }
+      // write_json writes the tree as an array if all keys are empty
+    const bool isArr = std::all_of(pt.begin(), pt.end(), [](auto &&child){ return child.first.empty(); });
+    if(isArr) {
+      auto &arr = makeArray();
+      arr.clear();
+      arr.reserve(pt.size());
+      for(auto &&child : pt) {
+        arr.emplace_back(m_res).assign(child.second);
+      }
+    } else {
+      auto &obj = makeObject();
+      obj.clear();
+      obj.reserve(pt.size());
+      for(auto &&child : pt) {
+        obj.emplace_back(std::piecewise_construct, std::forward_as_tuple(child.first), std::forward_as_tuple(m_res)).second.assign(child.second);
+      }
+    }
+  }
+
+
+  template<typename Buf>
+  void JValue::write(Buf &out) const
+  {
+    switch(kind()) {
+    case Kind::null: appendText(out, "null"); break;
+    case Kind::boolean: appendText(out, asBool() ? "true" : "false"); break;
+    case Kind::integer: writeNumber(out, asInt()); break;
+    case Kind::real: {
+      const auto val = std::get<double>(m_v);
+      if(std::isfinite(val)) {
+        writeNumber(out, val);
+      } else {
+        appendText(out, "null");
+      }
+      break;
+    }
+    case Kind::string: jsonwriter::writeString(out, asString()); break;
+    case Kind::array: {
+      out.push_back('[');
+      bool first{true};
+      for(auto &&elem : array()) {
+        if(!first) out.push_back(',');
+        first = false;
+        elem.write(out);
+      }
+      out.push_back(']');
+      break;
+    }
+    case Kind::object: {
+      out.push_back('{');
+      bool first{true};
+      for(auto &&member : object()) {
+        if(!first) out.push_back(',');
+        first = false;
+        jsonwriter::writeString(out, member.first);
+        out.push_back(':');
+        member.second.write(out);
+      }
+      out.push_back('}');
+      break;
+    }
+    }
+  }
+
+
+  template void JValue::write(std::string &out) const;
+  template void JValue::write(std::vector<char> &out) const;
+
+
+  std::string JValue::str() const
+  {
+    std::string out;
+    write(out);
+    return out;
+  }
+
+
+  JDoc::JDoc(std::size_t initialSize)
+    : m_res(initialSize)
+  {
+  }
+
+
+  JDoc::shr_t JDoc::parse(std::string_view json)
+  {
+      // parsed tree is usually about twice as big as the text
+    auto doc = std::make_shared<JDoc>(std::max(DefaultBufSize, 2 * json.size()));
+    Parser parser(json);
+    parser.value(doc->m_root, 0);
+    parser.skipWs();
+    if(!parser.atEnd()) parser.fail("unexpected characters after the value");
+    return doc;
+  }
+
+
+  JDoc::shr_t JDoc::fromPtree(const JValue::ptree &pt)
+  {
+    auto doc = std::make_shared<JDoc>();
+    doc->m_root.assign(pt);
+    return doc;
+  }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <boost/property_tree/ptree.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Typed json value.
+     *
+     * Unlike ptree, numbers and booleans are stored as such and objects
+     * are flat vectors of members (in the received order), so parsing
+     * and serializing do not convert numbers to strings and there is
+     * no node allocation per field. All memory of the value tree comes
+     * from the memory resource of the document (see JDoc), so values
+     * must not be moved between documents.
+     * */
+  class JValue
+  {
+  public:
+    using ptree = boost::property_tree::ptree;
+    using string_t = std::pmr::string;
+    using array_t = std::pmr::vector<JValue>;
+    using member_t = std::pair<string_t, JValue>;
+    using object_t = std::pmr::vector<member_t>;
+
+      /** order matches alternatives of the value */
+    enum class Kind
+    {
+      null, boolean, integer, real, string, array, object
+    };
+
+    explicit JValue(std::pmr::memory_resource *res) : m_res(res) {}
+    JValue(const JValue &) = delete;
+    JValue &operator=(const JValue &) = delete;
+    JValue(JValue &&) noexcept = default;
+    JValue &operator=(JValue &&) = default;
+    ~JValue() = default;
+
+    [[nodiscard]] Kind kind() const { return static_cast<Kind>(m_v.index()); }
+    [[nodiscard]] bool isNull() const { return kind() == Kind::null; }
+    [[nodiscard]] bool isObject() const { return kind() == Kind::object; }
+    [[nodiscard]] bool isArray() const { return kind() == Kind::array; }
+
+      /** accessors throw std::runtime_error if the value is of other kind */
+    [[nodiscard]] bool asBool() const;
+    [[nodiscard]] std::int64_t asInt() const;
+      /** integers are converted */
+    [[nodiscard]] double asDouble() const;
+    [[nodiscard]] std::string_view asString() const;
+    [[nodiscard]] const array_t &array() const;
+    [[nodiscard]] const object_t &object() const;
+
+      /** @return member of the object or nullptr */
+    [[nodiscard]] const JValue *find(std::string_view key) const;
+      /** @return value at dot separated path (like in ptree) or nullptr */
+    [[nodiscard]] const JValue *findPath(std::string_view path) const;
+      /** scalar as text, like ptree::data() after read_json; empty for objects and arrays */
+    [[nodiscard]] std::string text() const;
+
+    void setNull() { m_v = nullptr; }
+    void setBool(bool val) { m_v = val; }
+    void setInt(std::int64_t val) { m_v = val; }
+    void setReal(double val) { m_v = val; }
+    void setString(std::string_view val) { m_v.emplace<string_t>(val, m_res); }
+      /** member of the object, it is added if missing; null value becomes an object */
+    JValue &operator[](std::string_view key);
+      /** append element to the array; null value becomes an array */
+    JValue &append();
+      /** make the value an empty object if it is not an object yet */
+    object_t &makeObject();
+      /** make the value an empty array if it is not an array yet */
+    array_t &makeArray();
+    [[nodiscard]] std::pmr::memory_resource *resource() const { return m_res; }
+
+      /** convert to property tree for old handlers */
+    [[nodiscard]] ptree toPtree() const;
+      /** replace value with the content of property tree, all leaves become strings */
+    void assign(const ptree &pt);
+
+      /** append compact json to out (std::string or std::vector<char>) */
+    template<typename Buf>
+    void write(Buf &out) const;
+    [[nodiscard]] std::string str() const;
+
+  private:
+    std::variant<std::nullptr_t, bool, std::int64_t, double, string_t, array_t, object_t> m_v{nullptr};
+    std::pmr::memory_resource *m_res;
+  };
+
+
+    /**
+     * Json document: root value and memory resource of all its values.
+     *
+     * Memory is taken from a monotonic buffer, which is sized by the
+     * parsed text, and is released at once with the document.
+     * */
+  class JDoc
+  {
+  public:
+    using shr_t = std::shared_ptr<JDoc>;
+    using shr_const_t = std::shared_ptr<const JDoc>;
+
+      /** @param initialSize size of the first memory buffer */
+    explicit JDoc(std::size_t initialSize = DefaultBufSize);
+    JDoc(const JDoc &) = delete;
+    JDoc &operator=(const JDoc &) = delete;
+    JDoc(JDoc &&) = delete;
+    JDoc &operator=(JDoc &&) = delete;
+    ~JDoc() = default;
+
+      /** @throw std::runtime_error on malformed json */
+    [[nodiscard]] static shr_t parse(std::string_view json);
+    [[nodiscard]] static shr_t fromPtree(const JValue::ptree &pt);
+
+    [[nodiscard]] JValue &root() { return m_root; }
+    [[nodiscard]] const JValue &root() const { return m_root; }
+
+  private:
+    static constexpr std::size_t DefaultBufSize = 1024;
+
+    std::pmr::monotonic_buffer_resource m_res;
+    JValue m_root{&m_res};
+  };
+}
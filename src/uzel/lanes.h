@@ -0,0 +1,98 @@
+#pragma once
+
+#include "msgqueue.h"
+#include "priority.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Lanes of the channel to one remote node.
+     *
+     * A message is sent by the session of its priority: high, low or
+     * control. While one lane is down the others stand in for it, in
+     * the order given by lane(). While no lane is up, messages wait in
+     * the queue of their priority. Messages a closed lane did not send
+     * go there as well (see close()), so they fail over to the lanes
+     * left.
+     *
+     * Session is anything which tests false while the lane is down, a
+     * session::shr_t for the remote. Not thread safe, the owner keeps it
+     * on one strand.
+     * */
+  template<typename Session>
+  class Lanes
+  {
+  public:
+    Lanes(const QueueLimits &limits, const StrandTimers::shr_t &wheel)
+      : m_highQueue(limits, wheel), m_lowQueue(limits, wheel)
+    {
+    }
+
+      /** session of the lane, to assign it */
+    [[nodiscard]] Session &slot(Priority prio)
+    {
+      switch(prio) {
+        case Priority::control: return m_control;
+        case Priority::low: return m_low;
+        default: return m_high;
+      }
+    }
+
+      /**
+       * session to send the message of that priority to: control falls
+       * back to high then low, low to high then control, the rest to
+       * low then control
+       * @return empty if no lane is up
+       * */
+    [[nodiscard]] Session lane(Priority prio) const
+    {
+      switch(prio) {
+        case Priority::control:
+          return m_control ? m_control : m_high ? m_high : m_low;
+        case Priority::low:
+          return m_low ? m_low : m_high ? m_high : m_control;
+        default:
+          return m_high ? m_high : m_low ? m_low : m_control;
+      }
+    }
+
+      /** the high and low lanes are up */
+    [[nodiscard]] bool connected() const { return m_high && m_low; }
+
+      /** queue for the messages of that priority while no lane is up */
+    [[nodiscard]] MsgQueue &queue(Priority prio) { return prio == +Priority::low ? m_lowQueue : m_highQueue; }
+
+      /**
+       * the session closed: its lanes are down, the messages it did not
+       * send are queued by priority, except the service ones which
+       * belong to the closed connection
+       * @return number of messages queued
+       * */
+    std::size_t close(const Session &ss, std::vector<QueuedMsg> unsent)
+    {
+      for(auto *slot : {&m_high, &m_low, &m_control}) {
+        if(*slot == ss) *slot = Session();
+      }
+      std::size_t count{0};
+      for(auto &&qmsg : unsent) {
+        if(qmsg.destType() == Msg::DestType::service) continue;
+        const auto prio = qmsg.priority();
+        if(queue(prio).push(std::move(qmsg))) {
+          ++count;
+        }
+      }
+      return count;
+    }
+
+  private:
+    Session m_high;
+    Session m_low;
+    Session m_control; //!< always outgoing, if low and high are incoming
+    MsgQueue m_highQueue;
+    MsgQueue m_lowQueue;
+  };
+}
@@ -0,0 +1,105 @@
+#include "linescan.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UZEL_LINESCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace uzel::linescan
+{
+  namespace
+  {
+    const char Eol = '\n';
+
+    using FindAllFn = void (*)(std::string_view, std::size_t, std::vector<std::size_t> &);
+
+#ifdef UZEL_LINESCAN_X86
+      /** append positions of set bits in the mask */
+    inline void pushMask(unsigned mask, std::size_t pos, std::vector<std::size_t> &out)
+    {
+      while(mask != 0) {
+        out.push_back(pos + static_cast<std::size_t>(__builtin_ctz(mask)));
+        mask &= mask - 1;
+      }
+    }
+
+    __attribute__((target("sse2")))
+    void findAllSse2(std::string_view data, std::size_t base, std::vector<std::size_t> &out)
+    {
+      const std::size_t width = sizeof(__m128i);
+      const __m128i eol = _mm_set1_epi8(Eol);
+      std::size_t pos = 0;
+      for(; pos + width <= data.size(); pos += width) {
+        //NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data.data() + pos));
+        pushMask(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, eol))), base + pos, out);
+      }
+      findAllScalar(data.substr(pos), base + pos, out);
+    }
+
+    __attribute__((target("avx2")))
+    void findAllAvx2(std::string_view data, std::size_t base, std::vector<std::size_t> &out)
+    {
+      const std::size_t width = sizeof(__m256i);
+      const __m256i eol = _mm256_set1_epi8(Eol);
+      std::size_t pos = 0;
+      for(; pos + width <= data.size(); pos += width) {
+        //NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data.data() + pos));
+        pushMask(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, eol))), base + pos, out);
+      }
+      findAllSse2(data.substr(pos), base + pos, out);
+    }
+#endif
+
+    struct Impl
+    {
+      FindAllFn fn;
+      const char *name;
+    };
+
+    Impl choose()
+    {
+#ifdef UZEL_LINESCAN_X86
+      __builtin_cpu_init();
+      if(__builtin_cpu_supports("avx2")) return {.fn = findAllAvx2, .name = "avx2"};
+      if(__builtin_cpu_supports("sse2")) return {.fn = findAllSse2, .name = "sse2"};
+#endif
+      return {.fn = findAllScalar, .name = "scalar"};
+    }
+
+    const Impl &impl()
+    {
+      static const Impl chosen = choose();
+      return chosen;
+    }
+  }
+
+
+  void findAllScalar(std::string_view data, std::size_t base, std::vector<std::size_t> &out)
+  {
+    const char *begin = data.data();
+    const char *end = begin + data.size(); //NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    const char *cur = begin;
+    while(cur != end) {
+      const auto *found = static_cast<const char *>(std::memchr(cur, Eol, static_cast<std::size_t>(end - cur)));
+      if(found == nullptr) break;
+      out.push_back(base + static_cast<std::size_t>(found - begin));
+      cur = found + 1; //NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    }
+  }
+
+
+  void findAll(std::string_view data, std::size_t base, std::vector<std::size_t> &out)
+  {
+    impl().fn(data, base, out);
+  }
+
+
+  const char *implName()
+  {
+    return impl().name;
+  }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace uzel::linescan
+{
+    /**
+     * Find positions of all new line characters in the data in one pass.
+     *
+     * Uses AVX2 or SSE2 if the CPU supports them (checked once at
+     * runtime), otherwise falls back to the scalar search.
+     * @param data block to scan
+     * @param base added to every found position
+     * @param out positions are appended here in increasing order
+     * */
+  void findAll(std::string_view data, std::size_t base, std::vector<std::size_t> &out);
+
+    /** @return name of the implementation chosen for this CPU */
+  [[nodiscard]] const char *implName();
+
+    /** scalar implementation, exposed for testing */
+  void findAllScalar(std::string_view data, std::size_t base, std::vector<std::size_t> &out);
+}
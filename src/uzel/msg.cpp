@@ -1,12 +1,13 @@
 #include "msg.h"
 #include "addr.h"
 #include "uconfig.h"
+#include "viewbuf.h"
+#include "jsonwriter.h"
 
 #define BOOST_BIND_GLOBAL_PLACEHOLDERS
 #include <boost/property_tree/json_parser.hpp>
 #include <ios>
 #include <iostream>
-#include <sstream>
 #include <string_view>
 #include <utility>
 #include <variant>
@@ -15,21 +16,58 @@
 
 
 namespace uzel {
-  Msg::Msg(Msg::ptree &&header, std::string &&body, SessionWPtr sswptr)
-    : m_body{std::vector<char>{body.begin(), body.end()}},  m_destType(DestType::local), m_origin(std::move(sswptr))
+  namespace
+  {
+      /** names that are compared with every message */
+    struct LocalAtoms
+    {
+      Atom node{Atom::intern(UConfigS::getUConfig().nodeName())};
+      Atom app{Atom::intern(UConfig::appName())};
+      Atom any{Atom::intern("*")};
+      Atom localhost{Atom::intern("localhost")};
+    };
+
+    const LocalAtoms &localAtoms()
+    {
+      static const LocalAtoms atoms;
+      return atoms;
+    }
+  }
+
+
+  Msg::Msg(MsgHeader &&header, ByteSlice body, SessionWPtr sswptr)
+    : m_header(std::move(header)), m_body{std::move(body)},  m_destType(DestType::local), m_origin(std::move(sswptr))
   {
-    m_header.swap(header);
-    updateFrom();
     updateDest();
   }
 
-  Msg::Msg(Msg::ptree &&header, Msg::ptree &&body, SessionWPtr sswptr)
-    : m_header(header), m_body(body),  m_destType(DestType::local), m_origin(std::move(sswptr))
+  Msg::Msg(MsgHeader &&header, Msg::ptree &&body, SessionWPtr sswptr)
+    : m_header(std::move(header)), m_body{Msg::ptree()},  m_destType(DestType::local), m_origin(std::move(sswptr))
   {
-    updateFrom();
+    std::get<Msg::ptree>(m_body).swap(body);
     updateDest();
   }
 
+  Msg::Msg(Msg::ptree &&header, std::string &&body, SessionWPtr sswptr)
+    : Msg(std::move(header), std::vector<char>{body.begin(), body.end()}, std::move(sswptr))
+  {
+  }
+
+  Msg::Msg(Msg::ptree &&header, std::vector<char> &&body, SessionWPtr sswptr)
+    : Msg(std::move(header), ByteSlice(std::move(body)), std::move(sswptr))
+  {
+  }
+
+  Msg::Msg(Msg::ptree &&header, ByteSlice body, SessionWPtr sswptr)
+    : Msg(MsgHeader::fromPtree(std::move(header)), std::move(body), std::move(sswptr))
+  {
+  }
+
+  Msg::Msg(Msg::ptree &&header, Msg::ptree &&body, SessionWPtr sswptr)
+    : Msg(MsgHeader::fromPtree(std::move(header)), std::move(body), std::move(sswptr))
+  {
+  }
+
   Msg::Msg(const Addr &dest, const std::string &cname, Msg::ptree && body)
     : m_destType{DestType::service}
   {
@@ -40,6 +78,22 @@ namespace uzel {
     setCname(cname);
   }
 
+  Msg::Msg(const Addr &dest, const std::string &cname, JDoc::shr_const_t body)
+    : m_body{std::move(body)}, m_destType{DestType::service}
+  {
+    setFromLocal();
+    setDest(dest);
+    setCname(cname);
+  }
+
+  Msg::Msg(const Addr &dest, const std::string &cname, ByteSlice body)
+    : m_body{std::move(body)}, m_destType{DestType::service}
+  {
+    setFromLocal();
+    setDest(dest);
+    setCname(cname);
+  }
+
   Msg::Msg(const Addr &dest, Msg &&other)
     : Msg(other)
   {
@@ -62,110 +116,294 @@ namespace uzel {
 
 
   void Msg::setDest(const Addr &dest) {
-    auto realhname = dest.node();
-    if(realhname == "localhost") {
-      realhname = uzel::UConfigS::getUConfig().nodeName();
+    auto realhname = dest.nodeAtom();
+    if(realhname == localAtoms().localhost) {
+      realhname = localAtoms().node;
     }
-    if(!dest.app().empty() && !dest.node().empty())
+    if(!dest.appAtom().empty() && !dest.nodeAtom().empty())
     { // service message to peer
-      m_header.put("to.n", realhname);
-      m_header.put("to.a", dest.app());
+      m_header.to = Addr(dest.appAtom(), realhname);
     }
+    headerChanged();
     updateDest();
   }
 
   void Msg::setCname(const std::string &cname)
   {
-    m_header.put("cname", cname);
+    m_header.cname = Atom::intern(cname);
+    headerChanged();
+  }
+
+  void Msg::setPriority(Priority prio)
+  {
+    m_header.priority = prio;
+    headerChanged();
+  }
+
+  void Msg::setDeadline(std::chrono::system_clock::time_point deadline)
+  {
+    m_header.deadline = std::chrono::duration_cast<std::chrono::milliseconds>(deadline.time_since_epoch()).count();
+    headerChanged();
+  }
+
+  void Msg::setTtl(std::chrono::milliseconds ttl)
+  {
+    setDeadline(std::chrono::system_clock::now() + ttl);
+  }
+
+  bool Msg::expired() const
+  {
+    return m_header.deadline != 0 &&
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() > m_header.deadline;
+  }
+
+  void Msg::headerChanged()
+  {
+    m_encoded.fill(ByteSlices());
+    m_compressed.reset();
+  }
+
+  void Msg::setWire(ByteSlice wire, Framing framing)
+  {
+    auto &cached = m_encoded.at(framing._to_integral());
+    cached.clear();
+    cached.push_back(std::move(wire));
+  }
+
+  void Msg::setContentType(ContentType ct)
+  {
+    if(ct == contentType()) return;
+    if(rawBody() != nullptr) {
+      (void)jbody(); // received bytes are in the old encoding
+    }
+    m_header.flags = frame::withContentType(m_header.flags, ct);
+    headerChanged();
+  }
+
+  void Msg::attach(Attachment::shr_t file)
+  {
+    m_attachment = std::move(file);
+      // received message carries the name already, keep its wire
+    if((m_header.flags & frame::Attached) != 0 && m_header.ext.get<std::string>("file", "") == m_attachment->name()) {
+      return;
+    }
+    m_header.flags = static_cast<std::uint16_t>(m_header.flags | frame::Attached);
+    m_header.ext.put("file", m_attachment->name());
+    headerChanged();
+  }
+
+  void Msg::setCompressedWire(ByteSlice wire, Compression codec, std::size_t packedSize)
+  {
+    const auto *raw = rawBody();
+    m_compressed = Compressed{{std::move(wire)}, raw != nullptr ? raw->size() : 0, packedSize};
+    m_compressedWith = codec;
   }
 
   const std::string &Msg::cname() const
   {
-    return m_header.get_child("cname").data();
+    if(m_header.cname.empty()) {
+      throw std::runtime_error("no cname in the message header");
+    }
+    return m_header.cname.str();
   }
 
 
   void Msg::setFromLocal()
   {
-    auto nodename = uzel::UConfigS::getUConfig().nodeName();
-    auto appname = uzel::UConfig::appName();
-    m_header.put("from.n", nodename);
-    m_header.put("from.a", appname );
-    m_from = Addr(appname, nodename);
+    m_header.from = Addr(localAtoms().app, localAtoms().node);
+    headerChanged();
   }
 
 
-  std::string Msg::str() const
+  std::size_t Msg::sizeHint() const
   {
-    std::ostringstream oss;
-    if(m_body.index() == 0) {
-      boost::property_tree::write_json(oss, m_header, false);
-      const auto & vbody = std::get<std::vector<char>>(m_body);
-        // TODO: use memcpy
-      oss.write(vbody.data(), static_cast<std::streamsize>(vbody.size()));
-      oss << "\n";
+    const std::size_t headerHint = 256;
+    const auto *raw = rawBody();
+    return headerHint + (raw != nullptr ? raw->size() : 0);
+  }
+
+  bool Msg::fitsJsonLine(const ByteSlice &raw)
+  {
+    const auto view = raw.view();
+    return view.find_first_of("\n\r") == std::string_view::npos;
+  }
+
+  template<typename Buf>
+  void Msg::writeBody(Buf &out, bool asJson) const
+  {
+    const auto ct = asJson ? ContentType(ContentType::json) : contentType();
+      // a json body received in a binary frame may be pretty printed, a json line must not break
+    if(const auto *raw = rawBody(); raw != nullptr && ct == contentType() && (!asJson || fitsJsonLine(*raw))) {
+      out.insert(out.end(), raw->data(), std::next(raw->data(), static_cast<std::ptrdiff_t>(raw->size())));
+      return;
+    }
+    JDoc::shr_const_t converted;
+    const JValue *jbody = jsonBody();
+    if(const auto *raw = rawBody()) {
+      converted = parseRaw(*raw);
+      jbody = &converted->root();
+    }
+    if(jbody == nullptr) {
+      if(ct == +ContentType::json) {
+        jsonwriter::writePtree(out, std::get<ptree>(m_body));
+        return;
+      }
+      converted = JDoc::fromPtree(std::get<ptree>(m_body));
+      jbody = &converted->root();
+    }
+    if(ct == +ContentType::json) {
+      jbody->write(out);
     } else {
-      boost::property_tree::write_json(oss, m_header, false);
-      boost::property_tree::write_json(oss, std::get<ptree>(m_body), false);
-        // or embed the body into the header:
-        // auto fullmsg = m_header;
-        // fullmsg.put_child("body", std::get<ptree>(m_body));
-        // boost::property_tree::write_json(oss, fullmsg, false);
+      binbody::write(ct, *jbody, out);
     }
-    return oss.str();
   }
 
-  std::string Msg::move_tostr()
+  JDoc::shr_t Msg::parseRaw(const ByteSlice &raw) const
+  {
+    const auto ct = contentType();
+    return ct == +ContentType::json ? JDoc::parse(raw.view()) : binbody::parse(ct, raw.view());
+  }
+
+  template<typename Buf>
+  void Msg::writeJson(Buf &out, bool oneLine) const
   {
-    std::ostringstream oss;
-    if(m_body.index() == 0) {
-      boost::property_tree::write_json(oss, m_header, false);
-      const auto & vbody = std::get<std::vector<char>>(m_body);
-        // TODO: use memcpy
-      oss.write(vbody.data(), static_cast<std::streamsize>(vbody.size()));
-      oss << "\n";
+    out.reserve(out.size() + sizeHint());
+      // binary body is converted to json, the header must say so
+    std::optional<MsgHeader> jsonHeader;
+    if(contentType() != +ContentType::json) {
+      jsonHeader = m_header;
+      jsonHeader->flags = frame::withContentType(m_header.flags, ContentType::json);
+    }
+    const auto &header = jsonHeader ? *jsonHeader : m_header;
+    if(oneLine) {
+        // embed the body into the header
+      if(jsonwriter::writeHeader(out, header, false)) {
+        out.push_back(',');
+      }
+      jsonwriter::writeString(out, "body");
+      out.push_back(':');
+      writeBody(out, true);
+      out.push_back('}');
     } else {
-      auto &ibody = m_header.put_child("body", ptree());
-      ibody.swap(std::get<ptree>(m_body));
-      boost::property_tree::write_json(oss, m_header, false);
+      jsonwriter::writeHeader(out, header);
+      out.push_back('\n');
+      writeBody(out, true);
     }
-    return oss.str();
+    out.push_back('\n');
+  }
+
+  std::string Msg::str() const
+  {
+    std::string out;
+    writeJson(out, false);
+    return out;
+  }
+
+  std::string Msg::move_tostr()
+  {
+    std::string out;
+    writeJson(out, true);
+    return out;
   }
 
   std::vector<char> Msg::charvec() const
   {
-      // TODO: FIXME: that is inefficient, store directly to std::vector!
-    std::string tmpstr = str();
-    return {tmpstr.begin(), tmpstr.end()};
+    std::vector<char> out;
+    writeJson(out, false);
+    return out;
   }
 
-  std::vector<char> Msg::moveToCharvec()
+  std::vector<char> Msg::framevec() const
   {
-      // TODO: FIXME: that is inefficient, store directly to std::vector!
-    std::string str = move_tostr();
-    return {str.begin(), str.end()};
+    std::vector<char> out;
+    const auto start = frame::beginFrame(m_header, out, sizeHint());
+    writeBody(out, false);
+    frame::endFrame(out, start);
+    return out;
   }
 
+  const ByteSlices &Msg::encoded(Framing framing) const
+  {
+    const std::lock_guard<std::mutex> lock(m_cacheMutex.mutex);
+    auto &cached = m_encoded.at(framing._to_integral());
+    if(cached.empty()) {
+      const auto *raw = rawBody();
+        // binary body can be sent as is only in binary frames
+      if(raw != nullptr && raw->size() >= GatherBodySize &&
+         (framing == +Framing::binary || (contentType() == +ContentType::json && fitsJsonLine(*raw)))) {
+        cached = encodeGather(framing, *raw);
+      } else {
+        cached.emplace_back(framing == +Framing::binary ? framevec() : charvec());
+      }
+    }
+    return cached;
+  }
 
+  ByteSlices Msg::encodeGather(Framing framing, const ByteSlice &body) const
+  {
+    std::vector<char> head;
+    if(framing == +Framing::binary) {
+      frame::encodePrefix(m_header, body.size(), head);
+      return {ByteSlice(std::move(head)), body};
+    }
+    static const ByteSlice eol(std::vector<char>{'\n'});
+    jsonwriter::writeHeader(head, m_header);
+    head.push_back('\n');
+    return {ByteSlice(std::move(head)), body, eol};
+  }
 
-  const Msg::ptree& Msg::header() const
+  const Msg::Compressed *Msg::compressed(Compression codec, std::size_t minSize) const
   {
-    return m_header;
+    const std::lock_guard<std::mutex> lock(m_cacheMutex.mutex);
+    if(!m_compressed || m_compressedWith != codec) {
+      m_compressed.emplace();
+      m_compressedWith = codec;
+      std::vector<char> serialized;
+      std::string_view body;
+      if(const auto *raw = rawBody()) {
+        body = raw->view();
+      } else {
+        writeBody(serialized, false);
+        body = {serialized.data(), serialized.size()};
+      }
+      if(body.size() >= minSize) {
+        auto packed = compress::deflate(codec, body);
+        if(packed.size() < body.size()) {
+          auto header = m_header;
+          header.flags = static_cast<std::uint16_t>((header.flags & ~frame::CompressionMask) | codec._to_integral());
+          std::vector<char> head;
+          frame::encodePrefix(header, packed.size(), head);
+          m_compressed->rawSize = body.size();
+          m_compressed->packedSize = packed.size();
+          m_compressed->wire = {ByteSlice(std::move(head)), ByteSlice(std::move(packed))};
+        }
+      }
+    }
+    return m_compressed->wire.empty() ? nullptr : &*m_compressed;
   }
 
-  const Addr& Msg::dest() const
+  std::vector<char> Msg::moveToCharvec()
   {
-    return m_dest;
+    std::vector<char> out;
+    writeJson(out, true);
+    return out;
   }
 
-  const Addr& Msg::from() const
+
+
+  Msg::ptree Msg::header() const
   {
-    return m_from;
+    return m_header.toPtree();
   }
 
-  void Msg::updateFrom()
+  const Addr& Msg::dest() const
   {
-    m_from = Addr(m_header.get<std::string>("from.a", ""), m_header.get<std::string>("from.n", ""));
+    return m_header.to;
+  }
+
+  const Addr& Msg::from() const
+  {
+    return m_header.from;
   }
 
   void Msg::updateDest()
@@ -173,43 +411,43 @@ namespace uzel {
     m_destType = DestType::local;
     m_toMe = false;
       // m_toOthers = false;
-    auto dest   = m_header.get<std::string>("to.n", "");
-    auto appn = m_header.get<std::string>("to.a", "");
-    m_dest = Addr(appn, dest);
+    const auto &atoms = localAtoms();
+    const auto dest = m_header.to.nodeAtom();
+    const auto appn = m_header.to.appAtom();
     if(appn.empty() && dest.empty()){
       m_destType = DestType::service;
       m_toMe = true;
       return;
     }
     if(dest.empty()) {
-      if(appn == UConfigS::getUConfig().appName()) {
+      if(appn == atoms.app) {
         m_toMe = true;
       } else {
         // m_toOthers = true;
       }
       return;
     }
-    if(dest == UConfigS::getUConfig().nodeName()) {
-      if(appn == UConfigS::getUConfig().appName()) {
+    if(dest == atoms.node) {
+      if(appn == atoms.app) {
         m_toMe = true;
       } else {
           // m_toOthers = true;
       }
-      if(appn == "*") {
+      if(appn == atoms.any) {
         m_destType = DestType::localbroadcast;
         m_toMe = true;
           // m_toOthers = true;
       }
       return;
     }
-    if(dest == "*") {
+    if(dest == atoms.any) {
       m_destType = DestType::broadcast;
-      if(appn == UConfigS::getUConfig().appName()) {
+      if(appn == atoms.app) {
         m_toMe = true;
       } else {
           // m_toOthers = true;
       }
-      if(appn == "*") {
+      if(appn == atoms.any) {
         m_toMe = true;
           // m_toOthers = true;
       }
@@ -234,7 +472,7 @@ namespace uzel {
 
   bool Msg::fromLocal() const
   {
-    return UConfigS::getUConfig().isLocalNode(m_from.node());
+    return m_header.from.nodeAtom() == localAtoms().node;
   }
 
 
@@ -250,30 +488,67 @@ namespace uzel {
 
 
 
-  class vector_inputbuf : public std::streambuf {
-  public:
-    explicit vector_inputbuf(const std::vector<char>& data) {
-        // const_cast is necessary to workaround setg() flaw
-      char* begin = const_cast<char*>(data.data()); // NOLINT{cppcoreguidelines-pro-type-const-cast}
-      setg(begin, begin, begin + data.size()); // NOLINT{cppcoreguidelines-pro-bounds-pointer-arithmetic}
-    }
-  };
-
   const Msg::ptree& Msg::pbody() const
   {
+      // encoded() and compressed() read the body from other threads
+    const std::lock_guard<std::mutex> lock(m_cacheMutex.mutex);
     if(std::holds_alternative<Msg::ptree>(m_body))
     {
       return std::get<Msg::ptree>(m_body);
     }
-    if(std::holds_alternative<std::vector<char>>(m_body)) {
-      auto bodyvec(std::move(std::get<std::vector<char>>(m_body)));
+    if(const auto *raw = rawBody(); raw != nullptr && contentType() != +ContentType::json) {
+      m_body = JDoc::shr_const_t(parseRaw(*raw));
+    }
+    if(std::holds_alternative<ByteSlice>(m_body)) {
+      auto bodyslice(std::move(std::get<ByteSlice>(m_body)));
       m_body = Msg::ptree();
-      vector_inputbuf vibuf(bodyvec);
+      view_inputbuf vibuf(bodyslice.view());
       std::istream is(&vibuf);
       auto& pbody = std::get<Msg::ptree>(m_body);
       boost::property_tree::read_json(is, pbody);
       return pbody;
     }
+    if(const auto *jdoc = std::get_if<JDoc::shr_const_t>(&m_body)) {
+      auto converted = (*jdoc)->root().toPtree();
+      m_body = Msg::ptree();
+      std::get<Msg::ptree>(m_body).swap(converted);
+      return std::get<Msg::ptree>(m_body);
+    }
     throw std::runtime_error("unsupported message body format");
   }
+
+
+  const JValue& Msg::jbody() const
+  {
+    const std::lock_guard<std::mutex> lock(m_cacheMutex.mutex);
+    if(const auto *jdoc = std::get_if<JDoc::shr_const_t>(&m_body)) {
+      return (*jdoc)->root();
+    }
+    JDoc::shr_const_t jdoc;
+    if(const auto *bodyslice = std::get_if<ByteSlice>(&m_body)) {
+      jdoc = parseRaw(*bodyslice);
+    } else {
+      jdoc = JDoc::fromPtree(std::get<Msg::ptree>(m_body));
+    }
+    m_body = jdoc;
+    return jdoc->root();
+  }
+
+
+  std::string Msg::bodyJson() const
+  {
+    if(const auto *raw = rawBody(); raw != nullptr && contentType() == +ContentType::json) {
+      return std::string(raw->view());
+    }
+    std::string out;
+    writeBody(out, true);
+    return out;
+  }
+
+
+  const JValue *Msg::jsonBody() const
+  {
+    const auto *jdoc = std::get_if<JDoc::shr_const_t>(&m_body);
+    return jdoc != nullptr ? &(*jdoc)->root() : nullptr;
+  }
 }
@@ -1,11 +1,21 @@
 #pragma once
 
 #include "acculine.h"
+#include "attachment.h"
 #include "uconfig.h"
 #include "addr.h"
+#include "frame.h"
+#include "byteslice.h"
+#include "msgheader.h"
+#include "bodyview.h"
+#include "jvalue.h"
 
 #include <boost/property_tree/ptree.hpp>
 //#include <boost/asio/ip/address_v6.hpp>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <optional>
 #include <variant>
 #include <string>
 #include <string_view>
@@ -29,13 +39,25 @@ namespace uzel
       service, local, remote, broadcast, localbroadcast
     };
     using ptree = boost::property_tree::ptree;
-    using hdr_t = ptree;
+    using hdr_t = MsgHeader;
+      /*** construct incoming message */
+    explicit Msg(MsgHeader &&header, ByteSlice body, SessionWPtr sswptr);
+      /*** construct incoming message */
+    explicit Msg(MsgHeader &&header, ptree &&body, SessionWPtr sswptr);
       /*** construct incoming message */
     explicit Msg(ptree &&header, std::string &&body, SessionWPtr sswptr);
       /*** construct incoming message */
+    explicit Msg(ptree &&header, std::vector<char> &&body, SessionWPtr sswptr);
+      /*** construct incoming message, the body is not copied */
+    explicit Msg(ptree &&header, ByteSlice body, SessionWPtr sswptr);
+      /*** construct incoming message */
     explicit Msg(ptree &&header, ptree &&body, SessionWPtr sswptr);
       /** construct outgoing message */
     Msg(const Addr &dest, const std::string &cname, Msg::ptree && body);
+      /** construct outgoing message with typed json body */
+    Msg(const Addr &dest, const std::string &cname, JDoc::shr_const_t body);
+      /** construct outgoing message with already serialized json body (see typedmsg.h) */
+    Msg(const Addr &dest, const std::string &cname, ByteSlice body);
       /** ctor forwarding message
        * used to forward incoming message
        * @param to where to forward
@@ -54,14 +76,98 @@ namespace uzel
     [[nodiscard]] std::string move_tostr();
     [[nodiscard]] std::vector<char> moveToCharvec();
     [[nodiscard]] std::vector<char> charvec() const;
+      /** serialize to binary frame, see frame.h */
+    [[nodiscard]] std::vector<char> framevec() const;
+      /**
+       * serialize using given framing
+       * The result is cached until the header is changed, so the
+       * message delivered to many sessions is serialized only once and
+       * all queues share the same buffer. If the message was received
+       * with the same framing, then the received bytes are returned as
+       * is. Received bodies from GatherBodySize are not copied, the
+       * result consists of the header, the body and the trailer then.
+       * Can be called from several threads, the header must not change
+       * meanwhile.
+       * */
+    [[nodiscard]] const ByteSlices &encoded(Framing framing) const;
+      /** bodies from that size are sent by reference, see encoded() */
+    static constexpr std::size_t GatherBodySize = 4UL*1024;
+      /**
+       * remember bytes the message was received as, so it can be
+       * forwarded without serializing it again
+       * */
+    void setWire(ByteSlice wire, Framing framing);
+      /** binary frame with compressed body */
+    struct Compressed
+    {
+      ByteSlices wire;
+      std::size_t rawSize{0};    //!< body size before compression
+      std::size_t packedSize{0}; //!< and after
+    };
+      /**
+       * binary frame with the body compressed by codec, cached like
+       * encoded(), the decision not to compress is cached too
+       * @param minSize bodies smaller than that are not compressed
+       * @return nullptr if the body is too small or does not shrink
+       * */
+    [[nodiscard]] const Compressed *compressed(Compression codec, std::size_t minSize) const;
+      /**
+       * remember the received compressed frame, see setWire()
+       * @param packedSize size of the compressed body in the frame
+       * */
+    void setCompressedWire(ByteSlice wire, Compression codec, std::size_t packedSize);
     [[nodiscard]] const Addr& from() const;
     [[nodiscard]] const Addr& dest() const;
-    [[nodiscard]] const ptree& header() const;
-      /** that will parse the body if needed, may throw */
+      /** header as property tree (for compatibility, it is converted on every call) */
+    [[nodiscard]] ptree header() const;
+    [[nodiscard]] const MsgHeader& hdr() const { return m_header; }
+      /**
+       * that will parse the body if needed, may throw
+       * The body is converted if it is kept as JValue, references
+       * returned by jbody() are invalidated then.
+       * */
     [[nodiscard]] const ptree& pbody() const;
+      /**
+       * body as typed json, parses the body if needed, may throw
+       * The body is converted if it is kept as ptree, references
+       * returned by pbody() are invalidated then.
+       * */
+    [[nodiscard]] const JValue& jbody() const;
+      /** access body fields without parsing the whole body, see BodyView */
+    [[nodiscard]] BodyView body() const { return BodyView(*this); }
+      /** encoding of the body, see frame::ContentTypeMask */
+    [[nodiscard]] ContentType contentType() const { return frame::contentType(m_header.flags); }
+      /**
+       * encode the body with ct when the message is sent with binary
+       * framing, json framing always carries json bodies (they are
+       * converted if needed). A received body in other encoding is
+       * parsed first.
+       * */
+    void setContentType(ContentType ct);
+      /** @return received body if it is not parsed yet, otherwise nullptr; it is encoded as contentType() says */
+    [[nodiscard]] const ByteSlice *rawBody() const { return std::get_if<ByteSlice>(&m_body); }
+      /** body as json text, serialized if it is parsed already */
+    [[nodiscard]] std::string bodyJson() const;
+      /** @return body if it is kept as JValue, otherwise nullptr */
+    [[nodiscard]] const JValue *jsonBody() const;
+      /**
+       * send the file after the message (binary framing is used then),
+       * the file name goes to the "file" header field
+       * */
+    void attach(Attachment::shr_t file);
+      /** @return attached file or nullptr, a received file is in the spool directory */
+    [[nodiscard]] const Attachment::shr_t &attachment() const { return m_attachment; }
       /** throws if there is no cname in header */
     [[nodiscard]] const std::string &cname() const;
     void setCname(const std::string &cname);
+      /** lane the message is sent to remote nodes with, see MsgHeader::priority */
+    void setPriority(Priority prio);
+      /** the message is dropped by every hop after that time, see MsgHeader::deadline */
+    void setDeadline(std::chrono::system_clock::time_point deadline);
+      /** the message is dropped if it is not delivered within ttl from now */
+    void setTtl(std::chrono::milliseconds ttl);
+      /** deadline of the message passed */
+    [[nodiscard]] bool expired() const;
       /** message must be delivered (also) to local host and this app */
     [[nodiscard]] bool toMe() const;
       /** message destination address (also) matches with other hosts and apps */
@@ -74,15 +180,48 @@ namespace uzel
   private:
     void setDest(const Addr &dest);
     void updateDest();
-    void updateFrom();
     void setFromLocal();
+    void headerChanged();
+      /** received json body has no line breaks, so it can be written into a json line as is */
+    [[nodiscard]] static bool fitsJsonLine(const ByteSlice &raw);
+      /** serialize header separately from the received body */
+    [[nodiscard]] ByteSlices encodeGather(Framing framing, const ByteSlice &body) const;
+      /** expected size of the serialized message */
+    [[nodiscard]] std::size_t sizeHint() const;
+      /**
+       * serialize body
+       * @param asJson write json whatever contentType() is
+       * */
+    template<typename Buf>
+    void writeBody(Buf &out, bool asJson) const;
+      /** parse received body according to contentType() */
+    [[nodiscard]] JDoc::shr_t parseRaw(const ByteSlice &raw) const;
+      /**
+       * serialize message as json lines
+       * @param oneLine embed the body into the header instead of the separate body line
+       * */
+    template<typename Buf>
+    void writeJson(Buf &out, bool oneLine) const;
 
-    ptree m_header; //!< message header
-    mutable std::variant<std::vector<char>,boost::property_tree::ptree> m_body; //!< unparsed/parsed message body
+    MsgHeader m_header; //!< message header
+    mutable std::variant<ByteSlice,boost::property_tree::ptree,JDoc::shr_const_t> m_body; //!< unparsed/parsed message body
+      /** guards the serialization caches and the body conversion, a routed message is sent by several threads; copies get their own */
+    struct CacheMutex
+    {
+      std::mutex mutex;
+      CacheMutex() = default;
+      CacheMutex(const CacheMutex & /*other*/) {}
+      CacheMutex &operator=(const CacheMutex & /*other*/) { return *this; }
+    };
+    mutable CacheMutex m_cacheMutex;
+      /** serialized message per framing, empty if not known yet or the header was changed */
+    mutable std::array<ByteSlices, Framing::_size_constant> m_encoded;
+      /** compressed binary frame, empty wire if compression does not pay off, unset if not known yet */
+    mutable std::optional<Compressed> m_compressed;
+    mutable Compression m_compressedWith{Compression::none}; //!< codec of m_compressed
+    Attachment::shr_t m_attachment; //!< file sent after the message
       // cached values (not serialized):
     DestType m_destType;
-    Addr m_dest;
-    Addr m_from;
     bool m_toMe{false}; // set by updateDest()
     SessionWPtr m_origin;
   };
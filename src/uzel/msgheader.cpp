@@ -0,0 +1,108 @@
+#include "msgheader.h"
+
+#include <string>
+
+namespace uzel
+{
+  namespace
+  {
+    using ptree = MsgHeader::ptree;
+
+      /** take address out of the tree, drop parent node if nothing left */
+    Addr takeAddr(ptree &pt, const std::string &key)
+    {
+      auto addr = pt.get_child_optional(key);
+      if(!addr) return {};
+      Addr rez(Atom(addr->get<std::string>("a", "")), Atom(addr->get<std::string>("n", "")));
+      addr->erase("n");
+      addr->erase("a");
+      if(addr->empty() && addr->data().empty()) {
+        pt.erase(key);
+      }
+      return rez;
+    }
+
+    void putAddr(ptree &pt, const std::string &key, const Addr &addr)
+    {
+      if(addr.empty()) return;
+      auto &child = pt.put_child(key, ptree());
+      if(!addr.nodeAtom().empty()) child.put("n", addr.node());
+      if(!addr.appAtom().empty()) child.put("a", addr.app());
+    }
+
+      /** merge src into dst, keeping fields already in dst */
+    void merge(ptree &dst, const ptree &src)
+    {
+      for(auto &&child : src) {
+        const ptree::path_type path(child.first, '\0');
+        auto existing = dst.get_child_optional(path);
+        if(existing && !child.second.empty()) {
+          merge(*existing, child.second);
+        } else {
+          dst.put_child(path, child.second);
+        }
+      }
+    }
+  }
+
+
+  MsgHeader MsgHeader::fromPtree(ptree &&pt)
+  {
+    MsgHeader hdr;
+    hdr.from = takeAddr(pt, "from");
+    hdr.to = takeAddr(pt, "to");
+    if(auto cname = pt.get_child_optional("cname")) {
+      hdr.cname = Atom(cname->data());
+      pt.erase("cname");
+    }
+    if(auto prio = pt.get_optional<Priority>("prio")) {
+      hdr.priority = *prio;
+      pt.erase("prio");
+    }
+    if(auto flags = pt.get_optional<std::uint16_t>("flags")) {
+      hdr.flags = *flags;
+      pt.erase("flags");
+    }
+    if(auto deadline = pt.get_optional<std::int64_t>("dl")) {
+      hdr.deadline = *deadline;
+      pt.erase("dl");
+    }
+    if(auto hops = pt.get_child_optional("hops")) {
+      hdr.hops.reserve(hops->size());
+      for(auto &&hop : *hops) {
+        hdr.hops.emplace_back(hop.second.data());
+      }
+      pt.erase("hops");
+    }
+    hdr.ext.swap(pt);
+    return hdr;
+  }
+
+
+  MsgHeader::ptree MsgHeader::toPtree() const
+  {
+    ptree pt;
+    putAddr(pt, "from", from);
+    putAddr(pt, "to", to);
+    if(!cname.empty()) {
+      pt.put("cname", cname.str());
+    }
+    if(priority != +Priority::undefined) {
+      pt.put("prio", priority);
+    }
+    if(flags != 0) {
+      pt.put("flags", flags);
+    }
+    if(deadline != 0) {
+      pt.put("dl", deadline);
+    }
+    if(!hops.empty()) {
+      auto &harr = pt.put_child("hops", ptree());
+      for(auto &&hop : hops) {
+        harr.push_back({"", ptree(hop.str())});
+      }
+    }
+    merge(pt, ext);
+    return pt;
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "addr.h"
+#include "atom.h"
+#include "priority.h"
+
+#include <boost/property_tree/ptree.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Message header.
+     *
+     * Routing fields are kept in a fixed layout with interned names, so
+     * looking them up and comparing them does not walk a property tree
+     * and copying the header allocates only for the hop list and rare
+     * fields. Fields without own member are kept in ext.
+     *
+     * In json the header looks like
+     * @code
+     * {"from":{"n":"node1","a":"app1"},"to":{"n":"node2","a":"app2"},"cname":"ping","prio":"10","dl":"1700000000000","hops":["node3"]}
+     * @endcode
+     * where everything except "from" is optional.
+     *
+     * The deadline is absolute (unix time in milliseconds), so it does
+     * not change on the way and the message can be forwarded as
+     * received; the clocks of the nodes are expected to be in sync.
+     * */
+  struct MsgHeader
+  {
+    using ptree = boost::property_tree::ptree;
+
+    Addr from;
+    Addr to;
+    Atom cname;
+    Priority priority{Priority::undefined};
+    std::uint16_t flags{0};     //!< message flags, see frame.h
+    std::int64_t deadline{0};   //!< the message is dropped after that unix time in ms, 0 - no deadline
+    std::vector<Atom> hops;     //!< nodes the message was forwarded through
+    ptree ext;                  //!< other (rare) header fields
+
+      /** convert from json representation, known fields are moved out of the tree */
+    [[nodiscard]] static MsgHeader fromPtree(ptree &&pt);
+      /** json representation of the header */
+    [[nodiscard]] ptree toPtree() const;
+  };
+}
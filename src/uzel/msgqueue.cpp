@@ -0,0 +1,227 @@
+#include "msgqueue.h"
+
+#include <algorithm>
+
+namespace uzel
+{
+  namespace
+  {
+      /** order of the priorities when dropping, undefined is between low and high */
+    int rank(Priority prio)
+    {
+      switch(prio) {
+        case Priority::low:     return 0;
+        case Priority::high:    return 2;
+        case Priority::control: return 3;
+        default:                return 1;
+      }
+    }
+  }
+
+
+  MsgQueue::MsgQueue(QueueLimits limits, StrandTimers::shr_t wheel)
+    : m_limits(limits), m_wheel(std::move(wheel))
+  {
+  }
+
+
+  MsgQueue::~MsgQueue()
+  {
+    if(!m_wheel) return;
+    for(auto &&qmsg : m_queue) {
+      m_wheel->cancel(qmsg.m_expiry);
+    }
+  }
+
+
+  bool MsgQueue::fits(const QueuedMsg &qmsg) const
+  {
+    return (m_limits.maxMessages == 0 || m_queue.size() < m_limits.maxMessages) &&
+           (m_limits.maxBytes == 0 || m_bytes + qmsg.bytes() <= m_limits.maxBytes);
+  }
+
+
+  bool MsgQueue::over(unsigned percent) const
+  {
+    return (m_limits.maxMessages > 0 && m_queue.size() * 100 >= m_limits.maxMessages * percent) ||
+           (m_limits.maxBytes > 0 && m_bytes * 100 >= m_limits.maxBytes * percent);
+  }
+
+
+  bool MsgQueue::push(QueuedMsg &&qmsg)
+  {
+    qmsg.m_expires = qmsg.deadline() ? *qmsg.deadline()
+      : m_limits.ttl.count() > 0 ? qmsg.enqueueTime() + m_limits.ttl
+      : std::chrono::steady_clock::time_point::max();
+    if(qmsg.m_expires <= std::chrono::steady_clock::now()) {
+      ++m_expired;
+      s_expired(qmsg.dest());
+      return false;
+    }
+    if(!fits(qmsg)) {
+      switch(m_limits.policy) {
+        case OverflowPolicy::block:
+          break;
+        case OverflowPolicy::dropNewest:
+          ++m_dropped;
+          return false;
+        case OverflowPolicy::dropOldest:
+          while(!fits(qmsg) && m_queue.size() > m_busy) {
+            drop(firstIdle());
+          }
+          break;
+        case OverflowPolicy::dropLowPriority:
+          while(!fits(qmsg) && m_queue.size() > m_busy) {
+            auto victim = std::min_element(firstIdle(), m_queue.end(),
+                                           [](const QueuedMsg &lhs, const QueuedMsg &rhs) {
+                                             return rank(lhs.priority()) < rank(rhs.priority());
+                                           });
+            if(rank(victim->priority()) > rank(qmsg.priority())) {
+              ++m_dropped;
+              return false;
+            }
+            drop(victim);
+          }
+          break;
+      }
+        // a message bigger than the limit is queued when there is nothing more to drop
+    }
+    m_bytes += qmsg.bytes();
+      // earliest expiry first within the priority: in front of the idle messages of
+      // the priority which expire later, looking past the other priorities back to
+      // the first one which does not, usually it is the end
+    auto pos = m_queue.end();
+    const auto idle = firstIdle();
+    for(auto prev = pos; prev != idle;) {
+      --prev;
+      if(prev->priority() != qmsg.priority()) continue;
+      if(prev->m_expires <= qmsg.m_expires) break;
+      pos = prev;
+    }
+    auto it = m_queue.insert(pos, std::move(qmsg));
+    if(m_wheel && it->m_expires != std::chrono::steady_clock::time_point::max()) {
+      it->m_expiry = m_wheel->schedule(it->m_expires, [this, it]() { expire(it); });
+    }
+    updateWatermarks();
+    return true;
+  }
+
+
+  void MsgQueue::remove(container_t::iterator it)
+  {
+    if(m_wheel) {
+      m_wheel->cancel(it->m_expiry);
+    }
+    m_bytes -= it->bytes();
+    m_queue.erase(it);
+  }
+
+
+  void MsgQueue::drop(container_t::iterator it)
+  {
+    remove(it);
+    ++m_dropped;
+  }
+
+
+  void MsgQueue::expire(container_t::iterator it)
+  {
+    it->m_expiry = TimerWheel::Handle{};
+    if(it->m_expires > m_wheel->now()) {
+        // not due yet, the wheel keeps far timers in its last slot
+      it->m_expiry = m_wheel->schedule(it->m_expires, [this, it]() { expire(it); });
+      return;
+    }
+    for(auto busy = m_queue.begin(); busy != firstIdle(); ++busy) {
+        // being written, it is removed when done
+      if(busy == it) return;
+    }
+    removeExpired(it);
+    updateWatermarks();
+  }
+
+
+  void MsgQueue::removeExpired(container_t::iterator it)
+  {
+    const auto dest = it->dest();
+    remove(it);
+    ++m_expired;
+    s_expired(dest);
+  }
+
+
+  void MsgQueue::dropExpired(std::size_t window)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    auto it = firstIdle();
+    bool removed{false};
+    for(std::size_t kept = 0; it != m_queue.end() && kept < window;) {
+      if(it->m_expires <= now) {
+        removeExpired(it++);
+        removed = true;
+      } else {
+        ++it;
+        ++kept;
+      }
+    }
+    if(removed) {
+      updateWatermarks();
+    }
+  }
+
+
+  void MsgQueue::pop_front()
+  {
+    remove(m_queue.begin());
+    m_busy = m_busy > 0 ? m_busy - 1 : 0;
+    updateWatermarks();
+  }
+
+
+  QueuedMsg MsgQueue::take_front()
+  {
+    auto it = firstIdle();
+    if(m_wheel) {
+      m_wheel->cancel(it->m_expiry);
+    }
+    QueuedMsg qmsg = std::move(*it);
+    m_bytes -= qmsg.bytes();
+    m_queue.erase(it);
+    updateWatermarks();
+    return qmsg;
+  }
+
+
+  std::vector<QueuedMsg> MsgQueue::take_all()
+  {
+    std::vector<QueuedMsg> msgs;
+    msgs.reserve(m_queue.size() - std::min(m_busy, m_queue.size()));
+    while(m_queue.size() > m_busy) {
+      msgs.push_back(take_front());
+    }
+    return msgs;
+  }
+
+
+  void MsgQueue::erase_front(std::size_t n)
+  {
+    n = std::min(n, m_queue.size());
+    for(std::size_t i = 0; i < n; ++i) {
+      remove(m_queue.begin());
+    }
+    m_busy = m_busy > n ? m_busy - n : 0;
+    updateWatermarks();
+  }
+
+
+  void MsgQueue::updateWatermarks()
+  {
+    if(!m_high && over(m_limits.highPercent)) {
+      m_high = true;
+      s_highWatermark();
+    } else if(m_high && !over(m_limits.lowPercent)) {
+      m_high = false;
+      s_lowWatermark();
+    }
+  }
+}
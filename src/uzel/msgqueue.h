@@ -0,0 +1,200 @@
+#pragma once
+
+#include "msg.h"
+#include "timerwheel.h"
+#include "uconfig.h"
+
+#include <boost/signals2.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <optional>
+#include <vector>
+
+namespace uzel
+{
+  struct QueuedMsg
+  {
+    explicit QueuedMsg(Msg::shr_t msg, Framing framing = Framing::json)
+      : QueuedMsg(*msg, msg->encoded(framing))
+    {
+    }
+
+    QueuedMsg(const Msg &msg, const ByteSlices &wire)
+      : QueuedMsg(wire, msg.destType(), msg.hdr().priority, msg.dest(), steadyDeadline(msg.hdr()))
+    {
+    }
+
+    QueuedMsg(ByteSlices wire, Msg::DestType dt, Priority priority, const Addr &dest = {},
+              std::optional<std::chrono::steady_clock::time_point> deadline = {})
+      : m_wire(std::move(wire)), m_bytes(totalSize(m_wire)), m_dt(dt), m_priority(priority), m_dest(dest),
+        m_enqueueTime(std::chrono::steady_clock::now()), m_deadline(deadline)
+    {
+    }
+
+      /** binary frame of the message followed by the attached file (see frame::Attached) */
+    QueuedMsg(const Msg &msg, const ByteSlices &frame, Attachment::shr_t file)
+      : QueuedMsg(msg, frame)
+    {
+      m_wire.emplace_back(frame::encodeAttachedSize(file->size()));
+      m_bytes += frame::AttachedSizeLen;
+      m_file = std::move(file);
+    }
+
+    [[nodiscard]] Msg::DestType destType() const { return m_dt; }
+    [[nodiscard]] Priority priority() const { return m_priority; }
+    [[nodiscard]] const Addr &dest() const { return m_dest; }
+    [[nodiscard]] std::chrono::steady_clock::time_point enqueueTime() const { return m_enqueueTime;}
+      /** deadline of the message (see MsgHeader::deadline), if it has one */
+    [[nodiscard]] const std::optional<std::chrono::steady_clock::time_point> &deadline() const { return m_deadline;}
+      /** serialized message, the parts are written with one gather write */
+    [[nodiscard]] const ByteSlices &wire() const { return m_wire;}
+      /** size of the wire */
+    [[nodiscard]] std::size_t bytes() const { return m_bytes;}
+      /** file sent after the wire, not included in it */
+    [[nodiscard]] const Attachment::shr_t &file() const { return m_file;}
+
+
+  private:
+    friend class MsgQueue;
+
+      /** the header has wall clock time, queues use the steady one */
+    static std::optional<std::chrono::steady_clock::time_point> steadyDeadline(const MsgHeader &hdr)
+    {
+      if(hdr.deadline == 0) return {};
+      const auto left = std::chrono::milliseconds(hdr.deadline) - std::chrono::system_clock::now().time_since_epoch();
+      return std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(left);
+    }
+
+    ByteSlices m_wire;
+    std::size_t m_bytes;
+    Attachment::shr_t m_file;
+    Msg::DestType m_dt;
+    Priority m_priority;
+    Addr m_dest;
+    std::chrono::steady_clock::time_point m_enqueueTime;
+    std::optional<std::chrono::steady_clock::time_point> m_deadline;
+    std::chrono::steady_clock::time_point m_expires{std::chrono::steady_clock::time_point::max()}; //!< set by MsgQueue
+    TimerWheel::Handle m_expiry; //!< set while queued in a MsgQueue with TTL
+  };
+
+
+    /**
+     * Bounded queue of outgoing messages.
+     *
+     * The queue keeps at most QueueLimits::maxBytes of serialized
+     * messages (attached files are not counted, they stay on disk) and
+     * maxMessages messages. A message which does not fit is handled by
+     * the OverflowPolicy: the drop policies make room or refuse the
+     * message right here, with OverflowPolicy::block the message is
+     * queued anyway and the owner is expected to stop the producers
+     * while full() is true. Messages at the front which are being
+     * written (busy) are never dropped.
+     *
+     * s_highWatermark is emitted when the queue fills highPercent of a
+     * limit, s_lowWatermark when it drains below lowPercent of both
+     * limits afterwards.
+     *
+     * Each message expires at its own deadline or, if it has none,
+     * QueueLimits::ttl after it was created (the time is kept when it
+     * moves to another queue). An expired message is not queued, with
+     * StrandTimers queued messages are removed when they expire,
+     * independently of writing, and dropExpired() removes the ones the
+     * wheel did not get to yet. s_expired is emitted for each of them.
+     * The timers refer to the queue, so it can not be moved.
+     *
+     * Messages of the same priority are kept earliest expiry first, so
+     * a message with a short deadline overtakes older ones with a
+     * longer deadline (or none), also past messages of other priorities
+     * queued between them.
+     * */
+  class MsgQueue
+  {
+  public:
+    using container_t = std::list<QueuedMsg>;
+
+    explicit MsgQueue(QueueLimits limits = {}, StrandTimers::shr_t wheel = nullptr);
+
+    MsgQueue(const MsgQueue &) = delete;
+    MsgQueue(MsgQueue &&) = delete;
+    MsgQueue &operator=(const MsgQueue &) = delete;
+    MsgQueue &operator=(MsgQueue &&) = delete;
+    ~MsgQueue();
+
+      /** @return false if the message was dropped or expired */
+    bool push(QueuedMsg &&qmsg);
+      /**
+       * remove expired messages from the idle ones before writing them:
+       * the first `window` unexpired ones are kept in front, expired ones
+       * between them are removed (other priorities may expire earlier)
+       * */
+    void dropExpired(std::size_t window = std::numeric_limits<std::size_t>::max());
+      /**
+       * messages at the front being written, they are neither dropped
+       * nor expired
+       * */
+    void setBusy(std::size_t busy) { m_busy = busy; }
+    void pop_front();
+      /** remove and return the first message which is not busy, there must be one */
+    [[nodiscard]] QueuedMsg take_front();
+      /**
+       * remove and return all messages which are not busy, to hand them
+       * over to another queue; the busy ones are written by this queue's
+       * owner and removed when done
+       * */
+    [[nodiscard]] std::vector<QueuedMsg> take_all();
+      /** remove first n messages */
+    void erase_front(std::size_t n);
+
+    [[nodiscard]] bool empty() const { return m_queue.empty(); }
+    [[nodiscard]] std::size_t size() const { return m_queue.size(); }
+      /** size of the queued wires */
+    [[nodiscard]] std::size_t bytes() const { return m_bytes; }
+    [[nodiscard]] const QueuedMsg &front() const { return m_queue.front(); }
+    [[nodiscard]] const QueuedMsg &at(std::size_t idx) const { return *std::next(m_queue.begin(), static_cast<std::ptrdiff_t>(idx)); }
+    [[nodiscard]] container_t::const_iterator begin() const { return m_queue.begin(); }
+    [[nodiscard]] container_t::const_iterator end() const { return m_queue.end(); }
+
+    [[nodiscard]] const QueueLimits &limits() const { return m_limits; }
+      /** a limit is reached */
+    [[nodiscard]] bool full() const { return over(100); }
+      /** the high watermark was reached and the low one not yet */
+    [[nodiscard]] bool high() const { return m_high; }
+      /** messages dropped because the queue was full */
+    [[nodiscard]] std::size_t dropped() const { return m_dropped; }
+      /** messages removed because their deadline or TTL passed */
+    [[nodiscard]] std::size_t expired() const { return m_expired; }
+
+    // NOLINTBEGIN(misc-non-private-member-variables-in-classes,cppcoreguidelines-non-private-member-variables-in-classes)
+    boost::signals2::signal<void ()> s_highWatermark;
+    boost::signals2::signal<void ()> s_lowWatermark;
+    boost::signals2::signal<void (const Addr &dest)> s_expired;
+    // NOLINTEND(misc-non-private-member-variables-in-classes,cppcoreguidelines-non-private-member-variables-in-classes)
+
+  private:
+      /** the message can be added without exceeding a limit */
+    [[nodiscard]] bool fits(const QueuedMsg &qmsg) const;
+      /** a limit is filled to percent */
+    [[nodiscard]] bool over(unsigned percent) const;
+    [[nodiscard]] container_t::iterator firstIdle() { return std::next(m_queue.begin(), static_cast<std::ptrdiff_t>(std::min(m_busy, m_queue.size()))); }
+      /** remove the message, without watermark update */
+    void remove(container_t::iterator it);
+    void drop(container_t::iterator it);
+    void expire(container_t::iterator it);
+      /** remove the message which is not busy, it expired */
+    void removeExpired(container_t::iterator it);
+    void updateWatermarks();
+
+    container_t m_queue;
+    QueueLimits m_limits;
+    StrandTimers::shr_t m_wheel;
+    std::size_t m_busy{0};
+    std::size_t m_bytes{0};
+    std::size_t m_dropped{0};
+    std::size_t m_expired{0};
+    bool m_high{false};
+  };
+}
@@ -3,12 +3,19 @@
 #include "dispatcher.h"
 #include "session.h"
 
+#include <boost/log/trivial.hpp>
+#include <algorithm>
+#include <sstream>
+
 namespace uzel
 {
 
-  NetAppContext::NetAppContext(boost::asio::io_context& io_context)
+  NetAppContext::NetAppContext(boost::asio::io_context& io_context, unsigned threads)
     :  m_iocontext(io_context), m_aresolver{ResolverThreads, io_context},
-       m_dispatcher(std::make_shared<MsgDispatcher>(io_context.get_executor()))
+       m_dispatcher(std::make_shared<MsgDispatcher>(io_context.get_executor())),
+       m_recvQuota(std::make_shared<RecvQuota>(UConfigS::getUConfig().recvLimits().totalBytes)),
+       m_threads(std::max(1U, threads)),
+       m_timerWheel(std::make_shared<TimerWheel>(makeStrand()))
   {
   }
 
@@ -27,4 +34,39 @@ namespace uzel
     return m_dispatcher;
   }
 
+  boost::asio::any_io_executor NetAppContext::makeStrand() const
+  {
+    if(m_threads == 1) {
+      return m_iocontext.get_executor();
+    }
+    return boost::asio::make_strand(m_iocontext);
+  }
+
+  StrandTimers::shr_t NetAppContext::timers(const boost::asio::any_io_executor &executor) const
+  {
+    return std::make_shared<StrandTimers>(m_timerWheel, executor);
+  }
+
+  std::unordered_map<std::string, std::size_t> NetAppContext::expired() const
+  {
+    const std::lock_guard<std::mutex> lock(m_expiredMutex);
+    return m_expired;
+  }
+
+  void NetAppContext::msgExpired(const Addr &dest)
+  {
+    std::ostringstream key;
+    key << dest;
+    std::size_t count{0};
+    {
+      const std::lock_guard<std::mutex> lock(m_expiredMutex);
+      count = ++m_expired[key.str()];
+    }
+      // a node down for long expires a lot, do not log every message
+    if(count == 1 || count % ExpiredLogEvery == 0) {
+      BOOST_LOG_TRIVIAL(warning) << count << " message(s) to " << key.str() << " dropped so far because their deadline (or TTL of "
+                                 << UConfigS::getUConfig().queueLimits().ttl.count() << " sec) passed";
+    }
+  }
+
 }
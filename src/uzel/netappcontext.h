@@ -1,10 +1,16 @@
 #pragma once
 
 #include "aresolver.h"
+#include "bufferpool.h"
 #include "dispatcher.h"
+#include "recvquota.h"
+#include "timerwheel.h"
 
 #include <boost/asio.hpp>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 namespace uzel
 {
@@ -12,6 +18,7 @@ namespace uzel
   using SessionPtr = std::shared_ptr<session>;
   class Msg;
   using MsgPtr = std::shared_ptr<Msg>;
+  class Addr;
 
     /** @brief network application context class
      * keeps several important classes that are important
@@ -23,8 +30,9 @@ namespace uzel
       /**
        * @brief ctor
        * @param io_context asio io context
+       * @param threads number of threads running io_context
        */
-    explicit NetAppContext(boost::asio::io_context& io_context);
+    explicit NetAppContext(boost::asio::io_context& io_context, unsigned threads = 1);
 
     NetAppContext(const NetAppContext &) = delete;
     NetAppContext(NetAppContext &&) = delete;
@@ -36,13 +44,42 @@ namespace uzel
 
     boost::asio::io_context& iocontext() const;
     AResolver& aresolver();
+      /** received data held by all sessions, see RecvLimits::totalBytes */
+    [[nodiscard]] RecvQuota::shr_t recvQuota() const { return m_recvQuota; }
+      /** receive buffers shared by all sessions */
+    [[nodiscard]] BufferPool::shr_t bufferPool() const { return m_bufferPool; }
+      /** number of threads running the io_context */
+    [[nodiscard]] unsigned threads() const { return m_threads; }
+      /**
+       * executor for a new session (or other object with own state): a
+       * new strand when several threads run the io_context, so its
+       * handlers never run concurrently
+       * */
+    [[nodiscard]] boost::asio::any_io_executor makeStrand() const;
+      /**
+       * expires the messages of the out queues running on executor, see
+       * QueueLimits::ttl. All of them share one TimerWheel, with several
+       * threads it runs on a strand of its own.
+       * */
+    [[nodiscard]] StrandTimers::shr_t timers(const boost::asio::any_io_executor &executor) const;
+      /** count message to dest dropped because its deadline or TTL passed, can be called from any thread */
+    void msgExpired(const Addr &dest);
+      /** expired messages by destination address */
+    [[nodiscard]] std::unordered_map<std::string, std::size_t> expired() const;
   private:
     const unsigned ResolverThreads = 5;
+    const std::size_t ExpiredLogEvery = 1000;
 
 
     boost::asio::io_context &m_iocontext;
     AResolver m_aresolver;
     MsgDispatcher::shr_t m_dispatcher;
+    RecvQuota::shr_t m_recvQuota;
+    BufferPool::shr_t m_bufferPool{std::make_shared<BufferPool>()};
+    unsigned m_threads;
+    TimerWheel::shr_t m_timerWheel; //!< shared by all queues
+    mutable std::mutex m_expiredMutex;
+    std::unordered_map<std::string, std::size_t> m_expired; //!< guarded by m_expiredMutex
   };
 
 }
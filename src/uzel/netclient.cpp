@@ -74,6 +74,8 @@ namespace uzel
           // found old session: move old messages from it to the new session
         ss->takeOverMessages(*(oldSessionIt->second));
       }
+      ss->s_highWatermark.connect([this]() { s_highWatermark(); });
+      ss->s_lowWatermark.connect([this]() { s_lowWatermark(); });
       m_locals[appname] = ss;
       s_authSuccess();
     } else {
@@ -89,4 +91,10 @@ namespace uzel
   {
     m_locals["userver"]->putOutQueue(msg);
   }
+
+  void NetClient::sendFile(uzel::Msg::shr_t msg, const std::string &path)
+  {
+    msg->attach(Attachment::open(path));
+    send(std::move(msg));
+  }
 }
@@ -21,7 +21,25 @@ namespace uzel
     NetClient(boost::asio::io_context& io_context, unsigned short port);
 
     void send(uzel::Msg::shr_t msg);
+      /**
+       * send message with the file attached (see Attachment), the file
+       * is opened here and sent from the page cache when its turn comes
+       * @throw std::runtime_error if the file can not be opened
+       * */
+    void sendFile(uzel::Msg::shr_t msg, const std::string &path);
+      /** send typed message (see typedmsg.h), the body is encoded without ptree */
+    template<typed::Body T>
+    void send(const Addr &dest, const T &body)
+    {
+      send(typed::makeMsg(dest, body));
+    }
     boost::signals2::signal<void ()> s_authSuccess;
+      /**
+       * the queue of messages to userver reached the high watermark
+       * (see QueueLimits), a producer should slow down until s_lowWatermark
+       * */
+    boost::signals2::signal<void ()> s_highWatermark;
+    boost::signals2::signal<void ()> s_lowWatermark;
 
   protected:
 
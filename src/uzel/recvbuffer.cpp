@@ -0,0 +1,111 @@
+#include "recvbuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace uzel
+{
+  RecvBuffer::RecvBuffer(std::size_t segmentSize, std::size_t minSegmentSize)
+    : m_maxSegment(segmentSize),
+      m_minSegment(minSegmentSize == 0 ? segmentSize : std::min(minSegmentSize, segmentSize)),
+      m_segmentSize(m_minSegment)
+  {
+  }
+
+
+  boost::asio::mutable_buffer RecvBuffer::prepare(std::size_t wanted)
+  {
+    const auto pend = pending();
+    bool exclusive = m_seg && m_seg.use_count() == 1;
+    if(exclusive && pend == 0) {
+        // nobody refers to the segment, start from the beginning
+      m_begin = m_end = 0;
+      if(m_seg->size() < m_segmentSize) {
+          // the peer sends in bulk now, take a bigger one
+        m_seg.reset();
+        exclusive = false;
+      }
+    }
+
+    const std::size_t need = std::max(wanted, pend + 1);
+    if(!m_seg || m_seg->size() - m_begin < need) {
+      if(exclusive && m_seg->size() >= need) {
+          // pending data is the only user: move it to the front, no allocation
+        std::memmove(m_seg->data(), std::next(m_seg->data(), static_cast<std::ptrdiff_t>(m_begin)), pend);
+        m_begin = 0;
+        m_end = pend;
+      } else {
+          // grow for big messages, otherwise keep the default size
+        newSegment(std::max(m_segmentSize, need > m_segmentSize ? std::max(need, 2*pend) : need));
+      }
+    }
+    m_prepared = m_seg->size() - m_end;
+    return {std::next(m_seg->data(), static_cast<std::ptrdiff_t>(m_end)), m_prepared};
+  }
+
+
+  void RecvBuffer::newSegment(std::size_t size)
+  {
+    segment_t seg;
+    if(m_quota || m_pool) {
+      auto vec = m_pool ? m_pool->take(size) : std::make_unique<std::vector<char>>(size);
+      const auto charged = vec->size();
+      if(m_quota) {
+        m_quota->acquire(charged);
+      }
+        // slices of the segment can outlive the buffer, the deleter keeps the quota and the pool
+      seg = segment_t(vec.release(), [quota = m_quota, pool = m_pool, charged](std::vector<char> *ptr) {
+        BufferPool::buffer_t buf(ptr);
+        if(quota) quota->release(charged);
+        if(pool) pool->give(std::move(buf));
+      });
+    } else {
+      seg = std::make_shared<std::vector<char>>(size);
+    }
+    const auto pend = pending();
+    if(pend > 0) {
+      std::memcpy(seg->data(), std::next(m_seg->data(), static_cast<std::ptrdiff_t>(m_begin)), pend);
+    }
+    m_seg = std::move(seg);
+    m_begin = 0;
+    m_end = pend;
+  }
+
+
+  void RecvBuffer::commit(std::size_t n)
+  {
+    m_end += n;
+    m_lastReadFull = (n == m_prepared);
+    if(m_lastReadFull) {
+      m_segmentSize = std::min(m_maxSegment, 2*m_segmentSize);
+    }
+  }
+
+
+  void RecvBuffer::release()
+  {
+    if(pending() > 0) return;
+    m_seg.reset();
+    m_begin = m_end = 0;
+    m_lastReadFull = false;
+    m_segmentSize = std::max(m_minSegment, m_segmentSize / 2);
+  }
+
+
+  ByteSlice RecvBuffer::data() const
+  {
+    if(!m_seg) return {};
+    return {std::shared_ptr<const char>(m_seg, std::next(m_seg->data(), static_cast<std::ptrdiff_t>(m_begin))), pending()};
+  }
+
+
+  void RecvBuffer::consume(std::size_t n)
+  {
+    m_begin += std::min(n, pending());
+    if(pending() == 0 && m_seg && m_seg->size() > m_maxSegment) {
+        // do not keep the segment grown for a big message, the messages in it free it when done
+      m_seg.reset();
+      m_begin = m_end = 0;
+    }
+  }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "bufferpool.h"
+#include "byteslice.h"
+#include "recvquota.h"
+
+#include <boost/asio/buffer.hpp>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Segmented receive buffer of the session.
+     *
+     * Data is read directly into the current segment. Complete
+     * messages are handed out as ByteSlice's referring to the segment,
+     * so message bodies are never copied. The segment is reused from
+     * the beginning when nothing refers to it any more. If the
+     * segment is still referenced or full, a new segment is started
+     * and only the incomplete tail (a message spanning the boundary)
+     * is copied into it.
+     *
+     * Segments are charged to the quota (see RecvQuota) until the
+     * last slice referring to them is destroyed, then they go back to
+     * the pool (see BufferPool).
+     *
+     * The default segment size adapts to the peer: it starts at
+     * minSegmentSize, doubles up to segmentSize whenever a read fills
+     * the whole free space and halves whenever the idle session gives
+     * its segment back with release().
+     * */
+  class RecvBuffer
+  {
+  public:
+      /**
+       * @param segmentSize max default size of one segment
+       * @param minSegmentSize initial size of the segment, 0 - same as segmentSize
+       * */
+    explicit RecvBuffer(std::size_t segmentSize, std::size_t minSegmentSize = 0);
+
+      /** charge new segments to the quota */
+    void setQuota(RecvQuota::shr_t quota) { m_quota = std::move(quota); }
+      /** take segments from the pool */
+    void setPool(BufferPool::shr_t pool) { m_pool = std::move(pool); }
+
+      /**
+       * @return free space to read into, it is never empty
+       * @param wanted hint: size of the incomplete message at the
+       * beginning of the pending data, if known
+       * */
+    boost::asio::mutable_buffer prepare(std::size_t wanted = 0);
+
+      /** n bytes were read into the buffer returned by prepare() */
+    void commit(std::size_t n);
+
+      /** @return received but not consumed data */
+    [[nodiscard]] ByteSlice data() const;
+
+      /**
+       * first n bytes of data() are processed and not needed any more,
+       * segment grown for a big message is let go when it is consumed
+       * */
+    void consume(std::size_t n);
+
+    [[nodiscard]] std::size_t pending() const { return m_end - m_begin; }
+
+      /** the last read filled all the space from prepare(), the peer sends in bulk */
+    [[nodiscard]] bool lastReadFull() const { return m_lastReadFull; }
+
+      /**
+       * nothing is pending and the session waits for input: let the
+       * segment go and shrink the default segment size
+       * */
+    void release();
+
+      /** current default segment size */
+    [[nodiscard]] std::size_t segmentSize() const { return m_segmentSize; }
+
+  private:
+    using segment_t = std::shared_ptr<std::vector<char>>;
+
+      /** start new segment of given size and move pending data into it */
+    void newSegment(std::size_t size);
+
+    const std::size_t m_maxSegment;
+    const std::size_t m_minSegment;
+    std::size_t m_segmentSize;
+    RecvQuota::shr_t m_quota;
+    BufferPool::shr_t m_pool;
+    segment_t m_seg;
+    std::size_t m_begin{0}; //!< start of pending data in the segment
+    std::size_t m_end{0};   //!< end of pending data in the segment
+    std::size_t m_prepared{0}; //!< free space returned by the last prepare()
+    bool m_lastReadFull{false};
+  };
+}
@@ -0,0 +1,59 @@
+#include "recvquota.h"
+
+namespace uzel
+{
+  RecvQuota::RecvQuota(std::size_t limit, shr_t parent)
+    : m_limit(limit), m_parent(std::move(parent))
+  {
+  }
+
+
+  void RecvQuota::acquire(std::size_t bytes)
+  {
+    m_used.fetch_add(bytes, std::memory_order_relaxed);
+    if(m_parent) {
+      m_parent->acquire(bytes);
+    }
+  }
+
+
+  void RecvQuota::release(std::size_t bytes)
+  {
+    const auto now = m_used.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+    if(m_parent) {
+      m_parent->release(bytes);
+    }
+    std::vector<std::function<void()>> ready;
+    {
+      const std::lock_guard<std::mutex> lock(m_mutex);
+      if(m_waiters.empty() || now > m_limit / 100 * ResumePercent) return;
+      ready.swap(m_waiters);
+    }
+    for(auto &&resume : ready) {
+      resume();
+    }
+  }
+
+
+  bool RecvQuota::exceeded() const
+  {
+    return over() || (m_parent && m_parent->exceeded());
+  }
+
+
+  void RecvQuota::whenDrained(std::function<void()> resume)
+  {
+    {
+      const std::lock_guard<std::mutex> lock(m_mutex);
+      if(over()) {
+        m_waiters.push_back(std::move(resume));
+        return;
+      }
+    }
+    if(m_parent) {
+      m_parent->whenDrained(std::move(resume));
+      return;
+    }
+    resume();
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Accounting of memory held by received data.
+     *
+     * Receive segments (see RecvBuffer) are charged to the quota of
+     * their session and to the global quota of the application when
+     * allocated, and are released when the last message referring to
+     * them is gone, so data waiting in the out queues of slow peers
+     * stays charged to the session it came from. A session stops
+     * reading while a quota is exceeded and resumes when the usage
+     * drops to ResumePercent of the limit.
+     *
+     * Segments can be released from any thread, the counters are
+     * atomic and the waiters are guarded by the mutex.
+     * */
+  class RecvQuota
+  {
+  public:
+    using shr_t = std::shared_ptr<RecvQuota>;
+
+      /** waiters are woken when the usage drops that low (percent of the limit) */
+    static constexpr std::size_t ResumePercent = 75;
+
+      /**
+       * @param limit bytes, 0 - unlimited
+       * @param parent quota charged together with this one
+       * */
+    explicit RecvQuota(std::size_t limit, shr_t parent = nullptr);
+
+    void acquire(std::size_t bytes);
+    void release(std::size_t bytes);
+
+    [[nodiscard]] std::size_t used() const { return m_used.load(std::memory_order_relaxed); }
+    [[nodiscard]] std::size_t limit() const { return m_limit; }
+      /** this or the parent quota is exceeded */
+    [[nodiscard]] bool exceeded() const;
+
+      /**
+       * call resume once the exceeded quota drains, immediately if no
+       * quota is exceeded any more. It is called by the thread
+       * releasing the memory, so it should only post the work.
+       * */
+    void whenDrained(std::function<void()> resume);
+
+  private:
+    [[nodiscard]] bool over() const { return m_limit > 0 && used() >= m_limit; }
+
+    const std::size_t m_limit;
+    const shr_t m_parent;
+    std::atomic<std::size_t> m_used{0};
+    std::mutex m_mutex;
+    std::vector<std::function<void()>> m_waiters; //!< guarded by m_mutex
+  };
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Map shared by the threads running the io_context.
+     *
+     * Lookups take the shared lock, changes the exclusive one. Values
+     * are returned by copy (they are meant to be shared pointers), so no
+     * reference into the map escapes the lock. The callbacks of update()
+     * and read() run under the lock and must not use the registry.
+     * */
+  template<typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+  class Registry
+  {
+  public:
+    [[nodiscard]] std::optional<Value> find(const Key &key) const
+    {
+      const std::shared_lock lock(m_mutex);
+      auto it = m_map.find(key);
+      if(it == m_map.end()) return {};
+      return it->second;
+    }
+
+      /** @return value for key, it is created with make() if there is none yet */
+    template<typename Make>
+    Value findOrAdd(const Key &key, Make &&make)
+    {
+      if(auto found = find(key)) {
+        return *found;
+      }
+      const std::unique_lock lock(m_mutex);
+      auto it = m_map.find(key);
+      if(it == m_map.end()) {
+        it = m_map.emplace(key, make()).first;
+      }
+      return it->second;
+    }
+
+      /** map key to value, @return the value it was mapped to before */
+    std::optional<Value> exchange(const Key &key, Value value)
+    {
+      const std::unique_lock lock(m_mutex);
+      auto [it, inserted] = m_map.try_emplace(key, std::move(value));
+      if(inserted) return {};
+      std::swap(it->second, value);
+      return value;
+    }
+
+      /** remove key, @return the value it was mapped to */
+    std::optional<Value> erase(const Key &key)
+    {
+      const std::unique_lock lock(m_mutex);
+      auto it = m_map.find(key);
+      if(it == m_map.end()) return {};
+      std::optional<Value> value(std::move(it->second));
+      m_map.erase(it);
+      return value;
+    }
+
+      /** call fn(Value &) under the exclusive lock, the value is default constructed if needed */
+    template<typename Fn>
+    auto update(const Key &key, Fn &&fn)
+    {
+      const std::unique_lock lock(m_mutex);
+      return fn(m_map[key]);
+    }
+
+      /** call fn(const Value *) under the shared lock, with nullptr if there is no such key */
+    template<typename Fn>
+    auto read(const Key &key, Fn &&fn) const
+    {
+      const std::shared_lock lock(m_mutex);
+      auto it = m_map.find(key);
+      return fn(it == m_map.end() ? nullptr : &it->second);
+    }
+
+      /** copy of all values, to iterate without holding the lock */
+    [[nodiscard]] std::vector<Value> values() const
+    {
+      const std::shared_lock lock(m_mutex);
+      std::vector<Value> rez;
+      rez.reserve(m_map.size());
+      for(auto &&entry : m_map) {
+        rez.push_back(entry.second);
+      }
+      return rez;
+    }
+
+  private:
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<Key, Value, Hash, KeyEqual> m_map;
+  };
+}
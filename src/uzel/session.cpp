@@ -7,9 +7,15 @@
 
 #include <boost/asio.hpp>
 #include <boost/log/trivial.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <memory>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <sys/sendfile.h>
+#include <unistd.h>
 
 
 namespace uzel
@@ -20,11 +26,28 @@ namespace uzel
   session::session(NetAppContextPtr netctx, tcp::socket socket, Direction direction, boost::asio::ip::address ip, std::string remoteHostName)
     : m_socket(std::move(socket)),
       m_direction(direction),
-      m_data{0},
+      m_outQueue(UConfigS::getUConfig().queueLimits(), netctx->timers(m_socket.get_executor())),
       m_remoteIp(std::move(ip)),
       m_remoteHostName(std::move(remoteHostName)),
       m_netctx(std::move(netctx))
   {
+      // the current receive segment is always held, the quota must fit more of them
+    const std::size_t minQuota = 4UL*max_length;
+    m_recvQuota = std::make_shared<RecvQuota>(m_recvLimits.sessionBytes == 0 ? 0 : std::max(m_recvLimits.sessionBytes, minQuota),
+                                              m_netctx->recvQuota());
+    m_recv.setQuota(m_recvQuota);
+    m_recv.setPool(m_netctx->bufferPool());
+    m_outQueue.s_highWatermark.connect([this]() {
+      BOOST_LOG_TRIVIAL(debug) << "session '" << this << "': out queue reached high watermark, " << m_outQueue.size()
+                               << " messages, " << m_outQueue.bytes() << " bytes";
+      s_highWatermark();
+    });
+    m_outQueue.s_expired.connect([this](const Addr &dest) { m_netctx->msgExpired(dest); });
+    m_outQueue.s_lowWatermark.connect([this]() {
+      BOOST_LOG_TRIVIAL(debug) << "session '" << this << "': out queue drained to low watermark";
+      releaseProducers();
+      s_lowWatermark();
+    });
   }
 
   session::~session()
@@ -90,14 +113,51 @@ namespace uzel
         return false;
       }
     }
+      // names of authenticated peers are interned, so their messages compare ids
+    Atom::intern(app);
+    Atom::intern(node);
     m_msg1 = msg;
+    m_authenticated.store(true, std::memory_order_release);
+      // switch to binary framing only if both sides want it
+    if(UConfigS::getUConfig().framing() == +Framing::binary &&
+       msg->body().get<std::string>("framing", Framing(Framing::json)._to_string()) == Framing(Framing::binary)._to_string()) {
+      m_framing = Framing::binary;
+    }
+    negotiateCompression(*msg, isLocal);
     BOOST_LOG_TRIVIAL(info) << "authenticated "<< (isLocal ? "local" : "remote")
                             << " " << m_direction._to_string()
-                            << " connection with " << m_msg1->from();
+                            << " connection with " << m_msg1->from()
+                            << ", framing " << m_framing._to_string()
+                            << ", compression " << m_compression._to_string();
     return true;
   }
 
 
+  void session::negotiateCompression(const Msg &msg1, bool isLocal)
+  {
+      // compressed bodies are carried by binary frames only, local connections are fast enough
+    if(m_framing != +Framing::binary || isLocal) {
+      return;
+    }
+    const auto &remote = m_remoteHostName.empty() ? msg1.from().node() : m_remoteHostName;
+    const auto wanted = UConfigS::getUConfig().compression(remote);
+    if(wanted == +Compression::none) {
+      return;
+    }
+      // peer lists codecs it can decompress
+    const auto accepted = msg1.body().get<std::string>("compression", "");
+    std::string_view rest(accepted);
+    while(!rest.empty()) {
+      const auto comma = rest.find(',');
+      if(rest.substr(0, comma) == wanted._to_string()) {
+        m_compression = wanted;
+        return;
+      }
+      rest.remove_prefix(comma == std::string_view::npos ? rest.size() : comma + 1);
+    }
+  }
+
+
   void session::dispatchMsg(Msg::shr_t msg)
   {
     if(!authenticated()) {
@@ -114,36 +174,54 @@ namespace uzel
   }
 
 
+  MsgDispatcher::shr_t session::dispatcher() const
+  {
+    return m_netctx->dispatcher();
+  }
+
+
   void session::start()
   {
     uzel::Msg::ptree body{};
     body.add("pid", getpid());
+    body.add("framing", UConfigS::getUConfig().framing()._to_string());
+    std::string codecs;
+    for(auto codec : Compression::_values()) {
+      if(codec == +Compression::none) continue;
+      if(!codecs.empty()) codecs += ',';
+      codecs += codec._to_string();
+    }
+    body.add("compression", codecs);
 
     putOutQueue(std::make_shared<Msg>(uzel::Addr(), "auth", std::move(body)));
-    do_read();
+    boost::asio::dispatch(m_socket.get_executor(), [self = shared_from_this()]() { self->do_read(); });
   }
 
   void session::startConnection(const tcp::resolver::results_type &remote)
   {
     auto self(shared_from_this());
-    m_socket.async_connect(
-      *remote,
-      [&, self, remote](const boost::system::error_code &ec) {
-        self->connectHandler(ec, remote);
-      }
-                           );
+    boost::asio::dispatch(m_socket.get_executor(), [self, remote]() {
+      self->m_socket.async_connect(
+        *remote,
+        [self, remote](const boost::system::error_code &ec) {
+          self->connectHandler(ec, remote);
+        }
+                                   );
+    });
   }
 
   void session::gracefullClose(const std::string &reason)
   {
-    if(m_closeFlag) {
-      return;
-    }
-    m_reason = reason;
-    m_closeFlag = true;
-    if(m_outQueue.empty()) {
-      sendByeAndClose();
-    }
+    boost::asio::dispatch(m_socket.get_executor(), [self = shared_from_this(), reason]() {
+      if(self->m_closeFlag) {
+        return;
+      }
+      self->m_reason = reason;
+      self->m_closeFlag = true;
+      if(self->m_outQueue.empty()) {
+        self->sendByeAndClose();
+      }
+    });
   }
 
   void session::sendByeAndClose()
@@ -161,28 +239,42 @@ namespace uzel
 
   void session::takeOverMessages(session &os)
   {
-    takeOverMessages(os.m_outQueue);
+      // the old queue is emptied on its own executor, the messages are queued on ours
+    boost::asio::dispatch(os.m_socket.get_executor(), [self = shared_from_this(), old = os.shared_from_this()]() {
+      self->takeOverMessages(old->m_outQueue.take_all());
+    });
   }
 
 
   void session::takeOverMessages(MsgQueue &oq)
   {
-    bool wasEmpty = outQueueEmpty();
-    size_t count{0};
-    while(!oq.empty())
-    {
-      if(oq.front().destType() == Msg::DestType::service) {
-        continue;
+    takeOverMessages(oq.take_all());
+  }
+
+
+  void session::takeOverMessages(std::vector<QueuedMsg> msgs)
+  {
+    boost::asio::dispatch(m_socket.get_executor(), [self = shared_from_this(), msgs = std::move(msgs)]() mutable {
+      size_t count{0};
+      for(auto &&qmsg : msgs) {
+        if(qmsg.destType() == Msg::DestType::service) {
+            // service messages belong to the old connection
+          continue;
+        }
+        if(self->m_outQueue.push(std::move(qmsg))) {
+          count++;
+        }
       }
+      self->tookOver(count);
+    });
+  }
 
-      m_outQueue.emplace_back(std::move(oq.front()));
-      oq.pop_front();
-      count++;
-    }
 
+  void session::tookOver(std::size_t count)
+  {
     if(count > 0) {
-      BOOST_LOG_TRIVIAL(debug) << DBGOUT << " queue " << &m_outQueue <<  " take over "  << count << " messsages from " << &oq;
-      if(wasEmpty) {
+      BOOST_LOG_TRIVIAL(debug) << DBGOUT << " queue " << &m_outQueue <<  " take over "  << count << " messsages";
+      if(!m_writing) {
         do_write();
       }
     }
@@ -205,24 +297,145 @@ namespace uzel
 
   void session::do_read()
   {
+      // pause only between messages, the incomplete one needs the rest to be released
+    if(m_recv.pending() == 0 && m_recvQuota->exceeded()) {
+      pauseReading();
+      return;
+    }
+    if(m_recv.pending() == 0 && m_readBlocks > 0) {
+        // a full out queue of another session waits for us to stop
+      m_readParked = true;
+      return;
+    }
+    if(m_recv.pending() == 0 && !m_recv.lastReadFull()) {
+        // the peer is quiet: wait without holding a buffer, read when there is something
+      m_recv.release();
+      m_socket.async_wait(tcp::socket::wait_read, [self = shared_from_this()](boost::system::error_code ec) {
+        if(ec) {
+          self->readDone(ec, 0);
+          return;
+        }
+        self->m_socket.non_blocking(true, ec);
+        const auto length = self->m_socket.read_some(self->m_recv.prepare(self->m_processor.wanted()), ec);
+        if(ec == boost::asio::error::would_block) {
+          self->do_read();
+          return;
+        }
+        self->readDone(ec, length);
+      });
+      return;
+    }
     m_socket.async_read_some(
-      boost::asio::buffer(m_data, max_length),
+      m_recv.prepare(m_processor.wanted()),
       [self = shared_from_this()](boost::system::error_code ec, std::size_t length)
         {
-          if(ec) {
-            BOOST_LOG_TRIVIAL(error) << "error reading from socket: " << ec.message();
-            self->s_recv_error();
-            self->stop();
-            return;
-          }
-          if(!self->m_processor.processNewInput(std::string_view(self->m_data.data(), length), *self)) {
-            BOOST_LOG_TRIVIAL(error) << "error parsing stream from remote: (implement error message)";
+          self->readDone(ec, length);
+        });
+  }
+
+
+  void session::readDone(const boost::system::error_code &ec, std::size_t length)
+  {
+    if(ec) {
+      if(m_stopped) return;
+      BOOST_LOG_TRIVIAL(error) << "error reading from socket: " << ec.message();
+      s_recv_error();
+      stop();
+      return;
+    }
+    m_recv.commit(length);
+    auto consumed = m_processor.processNewInput(m_recv.data(), *this);
+    if(!consumed) {
+      BOOST_LOG_TRIVIAL(error) << "error parsing stream from remote: (implement error message)";
+      s_recv_error();
+      stop();
+      return;
+    }
+    m_recv.consume(*consumed);
+    if(m_processor.attachmentRemaining() > 0) {
+      receiveAttachment();
+      return;
+    }
+    if(m_processor.streaming()) {
+        // read on when the handlers are done with the chunks, so they do not pile up
+      dispatcher()->post([self = shared_from_this()]() {
+        boost::asio::dispatch(self->m_socket.get_executor(), [self]() {
+          if(!self->m_stopped) self->do_read();
+        });
+      });
+      return;
+    }
+    do_read();
+  }
+
+  void session::pauseReading()
+  {
+    ++m_readPauses;
+    BOOST_LOG_TRIVIAL(debug) << "session '" << this << "': pause reading, holding " << m_recvQuota->used()
+                             << " received bytes, application holds " << m_netctx->recvQuota()->used();
+    m_recvQuota->whenDrained([wself = weak_from_this(), executor = m_socket.get_executor()]() {
+        // may be called from the thread releasing the last message
+      boost::asio::post(executor, [wself]() {
+        auto self = wself.lock();
+        if(self && !self->m_stopped) {
+          BOOST_LOG_TRIVIAL(debug) << "session '" << self.get() << "': resume reading";
+          self->do_read();
+        }
+      });
+    });
+  }
+
+
+  void session::receiveAttachment()
+  {
+      // the file is moved by the kernel: socket -> pipe -> spool file
+    const std::size_t chunk = 64UL*1024; // default pipe capacity
+    if(m_pipe[0] < 0 && ::pipe2(m_pipe.data(), O_CLOEXEC | O_NONBLOCK) != 0) {
+      BOOST_LOG_TRIVIAL(error) << "can not create pipe to receive attachment: " << std::strerror(errno);
+      s_recv_error();
+      stop();
+      return;
+    }
+    boost::system::error_code ec;
+    m_socket.native_non_blocking(true, ec);
+    while(const auto remaining = m_processor.attachmentRemaining()) {
+      const auto got = ::splice(m_socket.native_handle(), nullptr, m_pipe[1], nullptr,
+                                std::min<std::uint64_t>(remaining, chunk), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if(got < 0 && errno == EINTR) continue;
+      if(got < 0 && errno == EAGAIN) {
+        m_socket.async_wait(asiotcp::socket::wait_read, [self = shared_from_this()](boost::system::error_code wec) {
+          if(self->m_stopped) return;
+          if(wec) {
+            BOOST_LOG_TRIVIAL(error) << "error reading from socket: " << wec.message();
             self->s_recv_error();
             self->stop();
             return;
           }
-          self->do_read();
+          self->receiveAttachment();
         });
+        return;
+      }
+      if(got <= 0) {
+        BOOST_LOG_TRIVIAL(error) << "error receiving attachment: " << (got == 0 ? "connection closed" : std::strerror(errno));
+        s_recv_error();
+        stop();
+        return;
+      }
+      auto left = static_cast<std::size_t>(got);
+      while(left > 0) {
+        const auto moved = ::splice(m_pipe[0], nullptr, m_processor.attachmentFd(), nullptr, left, SPLICE_F_MOVE);
+        if(moved < 0 && errno == EINTR) continue;
+        if(moved <= 0) {
+          BOOST_LOG_TRIVIAL(error) << "error writing attachment to the spool directory: " << std::strerror(errno);
+          s_recv_error();
+          stop();
+          return;
+        }
+        left -= static_cast<std::size_t>(moved);
+      }
+      m_processor.attachmentReceived(static_cast<std::uint64_t>(got), *this);
+    }
+    do_read();
   }
 
   bool session::outQueueEmpty() const
@@ -230,72 +443,230 @@ namespace uzel
     return m_outQueue.empty();
   }
 
-  void session::deleteOld()
+  bool session::batchFull() const
   {
-    auto now = std::chrono::steady_clock::now();
-    int dropped {0};
-    while(!m_outQueue.empty()) {
-      auto etime = m_outQueue.front().enqueueTime();
-      if(now - etime > std::chrono::seconds(MessageTTL_sec)) {
-        ++dropped;
-        m_outQueue.pop_front();
-      } else {
-        if(dropped>0) {
-          BOOST_LOG_TRIVIAL(warning) << "dropped " << dropped << " messages to '" << m_msg1->dest().node() << "' because timeout of "  << MessageTTL_sec << "sec exceeded";
-        }
-        return /*false*/;
-      }
+    return m_outQueue.size() >= m_batch.maxFrames || m_outQueue.bytes() >= m_batch.maxBytes;
+  }
+
+  void session::do_write()
+  {
+    if(outQueueEmpty() || m_stopped) {
+      m_writing = false;
+      return;
     }
-    if(dropped>0) {
-      BOOST_LOG_TRIVIAL(warning) << "dropped " << dropped << " messages to '" << m_msg1->dest().node() << "' because timeout of "  << MessageTTL_sec << "sec exceeded";
+    m_writing = true;
+    if(m_batch.delay.count() > 0 && m_outQueue.size() < m_batch.maxFrames && m_outQueue.front().bytes() < m_batch.maxBytes) {
+        // small trickle: let more messages come, putOutQueue() flushes earlier if the batch is full
+      m_flushPending = true;
+      m_flushTimer.expires_after(m_batch.delay);
+      m_flushTimer.async_wait([self = shared_from_this()](const boost::system::error_code & /*ec*/) {
+        if(!self->m_flushPending) return;
+        self->m_flushPending = false;
+        self->writeBatch();
+      });
+      return;
     }
-      // return true;
+    writeBatch();
   }
 
 
-
 //NOLINTBEGIN(misc-no-recursion)
-  void session::do_write()
+  void session::writeBatch()
   {
-    deleteOld();
-    if(outQueueEmpty()) return;
+      // the batch takes at most maxFrames messages, none of them expired
+    m_outQueue.dropExpired(m_batch.maxFrames);
+    if(outQueueEmpty() || m_stopped) {
+      m_writing = false;
+      return;
+    }
+    m_writeBufs.clear();
+    std::size_t bytes{0};
+    m_inFlight = 0;
+    for(auto &&qmsg : m_outQueue) {
+      if(m_inFlight == m_batch.maxFrames || (m_inFlight > 0 && bytes >= m_batch.maxBytes)) break;
+      for(auto &&part : qmsg.wire()) {
+        m_writeBufs.emplace_back(part.data(), part.size());
+        bytes += part.size();
+      }
+      ++m_inFlight;
+        // the attached file follows the write, nothing can be added after it
+      if(qmsg.file()) break;
+    }
+    m_outQueue.setBusy(m_inFlight);
+    ++m_writes;
     boost::asio::async_write(
-      m_socket, boost::asio::buffer(m_outQueue.front().rawmsg()),
-      [self = shared_from_this()](boost::system::error_code ec, std::size_t /*length*/)
+      m_socket, std::span<const boost::asio::const_buffer>(m_writeBufs),
+      [self = shared_from_this()](boost::system::error_code ec, std::size_t length)
         {
+            // stopped meanwhile: the queue may be taken over already (see shutdown())
+          if(self->m_stopped) return;
           if(ec) {
             BOOST_LOG_TRIVIAL(error) << "got error while writing to the socket: " << ec.message();
+            self->m_writing = false;
+            self->s_send_error();
+            self->stop();
+            return;
+          }
+          BOOST_LOG_TRIVIAL(debug) << "session '"<< self
+                                   << "': writing succeed, " << self->m_inFlight << " messages, " << length
+                                   << " bytes, queue size: " << self->m_outQueue.size()
+                                   << ", first message: " << dump(self->m_outQueue.front().wire().front().view());
+          if(self->m_outQueue.at(self->m_inFlight - 1).file()) {
+            self->sendAttachment(0);
+            return;
+          }
+          self->batchWritten();
+        });
+  }
+
+
+  void session::batchWritten()
+  {
+    const auto written = m_inFlight;
+    m_inFlight = 0;
+    m_outQueue.erase_front(written);
+      // do not wait until everything from outQueue will be sent and queue will become empty,
+      // messages from queue will be taken over by the next session
+    if(m_closeFlag) {
+      m_writing = false;
+      sendByeAndClose();
+      return;
+    }
+      // there is a backlog already, write it without waiting
+    writeBatch();
+  }
+
+
+  void session::sendAttachment(std::uint64_t offset)
+  {
+      // the file goes from the page cache to the socket, the queued message keeps it open
+    const auto file = m_outQueue.at(m_inFlight - 1).file();
+    const std::size_t chunk = 1UL*1024*1024;
+    boost::system::error_code ec;
+    m_socket.native_non_blocking(true, ec);
+    while(offset < file->size()) {
+      auto off = static_cast<off_t>(offset);
+      const auto sent = ::sendfile(m_socket.native_handle(), file->fd(), &off, std::min<std::uint64_t>(file->size() - offset, chunk));
+      if(sent > 0) {
+        offset += static_cast<std::uint64_t>(sent);
+        continue;
+      }
+      if(sent < 0 && errno == EINTR) continue;
+      if(sent < 0 && errno == EAGAIN) {
+        m_socket.async_wait(asiotcp::socket::wait_write, [self = shared_from_this(), offset](boost::system::error_code wec) {
+          if(self->m_stopped) return;
+          if(wec) {
+            BOOST_LOG_TRIVIAL(error) << "got error while writing to the socket: " << wec.message();
+            self->m_writing = false;
             self->s_send_error();
             self->stop();
-          } else {
-            BOOST_LOG_TRIVIAL(debug) << "session '"<< self
-                                     << "': writing succeed, queue size+1: " << self->m_outQueue.size()
-                                     << ", message: " << dump(self->m_outQueue.front().rawmsg());
-            self->m_outQueue.pop_front();
-            self->deleteOld();
-              // do not wait until everything from outQueue will be sent and queue will become empty,
-              // messages from queue will be taken over by the next session
-              // if(self->outQueueEmpty())
-            {
-              if(self->m_closeFlag) {
-                self->sendByeAndClose();
-              }
-              return;
-            }
-            self->do_write();
+            return;
           }
+          self->sendAttachment(offset);
         });
+        return;
+      }
+        // the frame can not be completed, the connection is useless now
+      BOOST_LOG_TRIVIAL(error) << "error sending attachment '" << file->path() << "': "
+                               << (sent == 0 ? "file was truncated" : std::strerror(errno));
+      m_writing = false;
+      s_send_error();
+      stop();
+      return;
+    }
+    BOOST_LOG_TRIVIAL(debug) << "session '" << this << "': sent attachment '" << file->path() << "', " << file->size() << " bytes";
+    batchWritten();
   }
 //NOLINTEND(misc-no-recursion)
 
 
+  void session::blockReading()
+  {
+    boost::asio::dispatch(m_socket.get_executor(), [self = shared_from_this()]() { ++self->m_readBlocks; });
+  }
+
+
+  void session::unblockReading()
+  {
+    boost::asio::dispatch(m_socket.get_executor(), [self = shared_from_this()]() {
+      if(self->m_readBlocks == 0 || --self->m_readBlocks > 0 || !self->m_readParked) return;
+      self->m_readParked = false;
+      boost::asio::post(self->m_socket.get_executor(), [self]() {
+        if(!self->m_stopped) self->do_read();
+      });
+    });
+  }
+
+
+  void session::blockProducer(const Msg &msg)
+  {
+    auto producer = msg.origin().lock();
+    if(!producer || producer.get() == this) return;
+    for(auto &&blocked : m_blockedProducers) {
+      if(blocked.lock() == producer) return;
+    }
+    BOOST_LOG_TRIVIAL(debug) << "session '" << this << "': out queue is full, stop reading from session '" << producer << "'";
+    producer->blockReading();
+    m_blockedProducers.emplace_back(producer);
+  }
+
+
+  void session::releaseProducers()
+  {
+    auto blocked = std::move(m_blockedProducers);
+    m_blockedProducers.clear();
+    for(auto &&wproducer : blocked) {
+      if(auto producer = wproducer.lock()) {
+        producer->unblockReading();
+      }
+    }
+  }
+
+
   void session::putOutQueue(uzel::Msg::shr_t msg)
   {
-    const bool wasEmpty = m_outQueue.empty();
-    m_outQueue.emplace_back(msg);
+    boost::asio::dispatch(m_socket.get_executor(), [self = shared_from_this(), msg = std::move(msg)]() mutable {
+      self->queueMsg(std::move(msg));
+    });
+  }
+
+
+  void session::queueMsg(uzel::Msg::shr_t msg)
+  {
+    if(msg->expired()) {
+      m_netctx->msgExpired(msg->dest());
+      return;
+    }
+    const Msg::Compressed *packed = nullptr;
+    if(m_compression != +Compression::none) {
+      packed = msg->compressed(m_compression, m_compressMin);
+    }
+    if(packed != nullptr) {
+      m_deflated.add(packed->rawSize, packed->packedSize);
+    }
+    bool queued{false};
+    if(msg->attachment()) {
+        // the file length follows the frame, so json framing can not carry it; every peer reads binary frames
+      queued = m_outQueue.push(QueuedMsg(*msg, packed != nullptr ? packed->wire : msg->encoded(Framing::binary), msg->attachment()));
+    } else if(packed != nullptr) {
+      queued = m_outQueue.push(QueuedMsg(*msg, packed->wire));
+    } else {
+      queued = m_outQueue.push(QueuedMsg(msg, m_framing));
+    }
+    if(!queued) {
+      BOOST_LOG_TRIVIAL(debug) << "session '"<< this << "': out queue is full, message to " << msg->dest() << " is dropped";
+      return;
+    }
+    if(m_outQueue.full() && m_outQueue.limits().policy == +OverflowPolicy::block) {
+      blockProducer(*msg);
+    }
     BOOST_LOG_TRIVIAL(debug) << "session '"<< this << "': insert new message to " << msg->dest() << ", new output queue size is: " << m_outQueue.size();
-    if(wasEmpty) {
+    if(!m_writing) {
       do_write();
+    } else if(m_flushPending && batchFull()) {
+      m_flushPending = false;
+      m_flushTimer.cancel();
+      writeBatch();
     }
   }
 
@@ -323,6 +694,37 @@ namespace uzel
     m_stopped = true;
     m_closeFlag = true;
 
+    m_flushPending = false;
+    m_flushTimer.cancel();
+    m_processor.abortStream();
+    m_processor.abortAttachment();
+    for(auto &fd : m_pipe) {
+      if(fd >= 0) ::close(fd);
+      fd = -1;
+    }
+
+    if(m_deflated.messages > 0 || inflated().messages > 0) {
+      BOOST_LOG_TRIVIAL(info) << "session '" << this << "' " << m_compression._to_string() << " compression stats: sent "
+                              << m_deflated.messages << " messages, " << m_deflated.rawBytes << " -> " << m_deflated.packedBytes
+                              << " bytes (ratio " << m_deflated.ratio() << "), received "
+                              << inflated().messages << " messages, " << inflated().packedBytes << " -> " << inflated().rawBytes
+                              << " bytes (ratio " << inflated().ratio() << ")";
+    }
+
+    releaseProducers();
+      // nothing will be written any more, the messages in flight can be taken over too
+    m_inFlight = 0;
+    m_writing = false;
+    m_outQueue.setBusy(0);
+    if(m_outQueue.dropped() > 0) {
+      BOOST_LOG_TRIVIAL(warning) << "session '" << this << "' dropped " << m_outQueue.dropped() << " messages because the out queue was full ("
+                                 << m_outQueue.limits().policy._to_string() << ")";
+    }
+    if(m_readPauses > 0) {
+      BOOST_LOG_TRIVIAL(info) << "session '" << this << "' paused reading " << m_readPauses << " times, receive quota "
+                              << m_recvLimits.sessionBytes << " bytes per session, " << m_recvLimits.totalBytes << " total";
+    }
+
     boost::system::error_code ec;
     m_socket.cancel(ec);
     if (ec && ec != boost::asio::error::bad_descriptor) {
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "inputprocessor.h"
+#include "recvbuffer.h"
 #include "msg.h"
+#include "msgqueue.h"
 #include "dispatcher.h"
+#include "registry.h"
 
 #include "enum.h"
 
@@ -13,43 +16,26 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
-#include <deque>
 #include <memory>
 #include <array>
+#include <atomic>
 #include <vector>
 
 namespace uzel
 {
   BETTER_ENUM(Direction, uint8_t, incoming = 0, outgoing); //NOLINT
 
-  inline const int64_t MessageTTL_sec = 60;
-
-  struct QueuedMsg
-  {
-    explicit QueuedMsg(Msg::shr_t msg)
-      : m_rawmsg(msg->charvec()), m_dt(msg->destType()), m_enqueueTime(std::chrono::steady_clock::now())
-    {
-    }
-
-    [[nodiscard]] Msg::DestType destType() const { return m_dt; }
-    [[nodiscard]] std::chrono::steady_clock::time_point enqueueTime() const { return m_enqueueTime;}
-    [[nodiscard]] const std::vector<char> &rawmsg() const { return m_rawmsg;}
-
-
-  private:
-    std::vector<char> m_rawmsg;
-    Msg::DestType m_dt;
-    std::chrono::steady_clock::time_point m_enqueueTime;
-  };
-
-  using MsgQueue = std::deque<QueuedMsg>;
-
   class NetAppContext;
   using NetAppContextPtr = std::shared_ptr<NetAppContext>;
 /**
  * class session handles one single (tcp) connection (there can be several between two remotes)
  * For incoming messages it uses uzel::Inputprocessor for initial
  * message parsing and dispatch, outgoing messages are queued in m_outQueue
+ *
+ * The socket should be created on NetAppContext::makeStrand(): all
+ * the session state is touched on the executor of the socket only, the
+ * public methods changing it can be called from any thread and hop
+ * there. The signals are emitted on that executor too.
  *  */
   class session
     : public std::enable_shared_from_this<session>
@@ -79,30 +65,97 @@ namespace uzel
     boost::signals2::signal<void ()> s_recv_error;
     boost::signals2::signal<void ()> s_connected;
     boost::signals2::signal<void ()> s_closed;
+      /** the out queue filled QueueLimits::highPercent of a limit */
+    boost::signals2::signal<void ()> s_highWatermark;
+      /** and drained below QueueLimits::lowPercent again */
+    boost::signals2::signal<void ()> s_lowWatermark;
       // NOLINTEND(misc-non-private-member-variables-in-classes,cppcoreguidelines-non-private-member-variables-in-classes)
 
     [[nodiscard]] bool outQueueEmpty() const;
+    [[nodiscard]] const MsgQueue &outQueue() const { return m_outQueue; }
+    [[nodiscard]] MsgQueue &outQueue() { return m_outQueue; }
 
     void start();
     void putOutQueue(uzel::Msg::shr_t msg);
       // take over processing of the messages from another (old) session
     void takeOverMessages(session &os);
+      /** the queue must belong to the caller's executor, it is emptied right away */
     void takeOverMessages(MsgQueue &oq);
+    void takeOverMessages(std::vector<QueuedMsg> msgs);
     void setRemoteIp(const boost::asio::ip::address &ip) {m_remoteIp = ip;}
     const boost::asio::ip::address& remoteIp() const{ return m_remoteIp;}
     void setRemoteHostName(const std::string &hname) {m_remoteHostName = hname;}
     const std::string& remoteHostName() const{ return m_remoteHostName;}
     const std::string& peerNode() const;
     const std::string& peerApp() const;
-    [[nodiscard]] bool authenticated() const { return m_msg1 != nullptr;}
+    [[nodiscard]] bool authenticated() const { return m_authenticated.load(std::memory_order_acquire);}
     [[nodiscard]] Direction direction() const {return m_direction;}
+      /** executor the session state is touched on */
+    [[nodiscard]] boost::asio::any_io_executor executor() {return m_socket.get_executor();}
+      /** framing used for outgoing messages, negotiated during authentication */
+    [[nodiscard]] Framing framing() const {return m_framing;}
+      /** codec outgoing message bodies are compressed with, negotiated during authentication */
+    [[nodiscard]] Compression compression() const {return m_compression;}
+      /** sent compressed messages */
+    [[nodiscard]] const compress::Stats &deflated() const {return m_deflated;}
+      /** received compressed messages */
+    [[nodiscard]] const compress::Stats &inflated() const {return m_processor.inflated();}
+      /** coalescing of the queued messages into writes, from the config by default; set it before writing */
+    void setWriteBatch(const WriteBatch &batch) {m_batch = batch;}
+      /** socket writes of queued messages, each carries one batch */
+    [[nodiscard]] std::size_t writes() const {return m_writes;}
     void dispatchMsg(Msg::shr_t msg);
+    [[nodiscard]] MsgDispatcher::shr_t dispatcher() const;
     bool peerIsLocal() const;
   private:
-    void deleteOld();
+      /** putOutQueue() on the executor of the socket */
+    void queueMsg(uzel::Msg::shr_t msg);
+      /** start writing the messages just taken over */
+    void tookOver(std::size_t count);
+      /** enough messages are queued to fill one write */
+    [[nodiscard]] bool batchFull() const;
+      /**
+       * read more input; a session with nothing buffered waits for the
+       * socket to become readable without a receive buffer
+       * */
     void do_read();
+      /** process the input read by do_read() */
+    void readDone(const boost::system::error_code &ec, std::size_t length);
+      /** stop reading until the exceeded receive quota drains */
+    void pauseReading();
+      /**
+       * stop reading (between messages) until unblockReading(), the
+       * calls nest
+       * */
+    void blockReading();
+    void unblockReading();
+      /**
+       * the out queue is full (OverflowPolicy::block): stop reading
+       * from the session the message came from until it drains
+       * */
+    void blockProducer(const Msg &msg);
+      /** let the blocked producers read again */
+    void releaseProducers();
+      /** write queued messages, or wait for more of them first (see WriteBatch::delay) */
     void do_write();
+      /** start one write of as many queued messages as the batch limits allow */
+    void writeBatch();
+      /** the messages in flight are written, go on with the queue */
+    void batchWritten();
+      /**
+       * send the file attached to the last message in flight with
+       * sendfile(), waiting for the socket whenever it is full
+       * @param offset bytes of the file sent already
+       * */
+    void sendAttachment(std::uint64_t offset);
+      /**
+       * move the rest of the attached file being received from the
+       * socket to the spool file with splice(), then read on
+       * */
+    void receiveAttachment();
     bool authenticate(uzel::Msg::shr_t msg);
+      /** choose compression supported by the peer and configured for it */
+    void negotiateCompression(const Msg &msg1, bool isLocal);
     void sendByeAndClose();
       /**
        *  shutdown socket and release all related resources, emits signal
@@ -117,11 +170,31 @@ namespace uzel
 
     boost::asio::ip::tcp::socket m_socket;
     Direction m_direction;
-    enum { max_length = 1024*1024 };
-    std::array<char, max_length> m_data;
-    uzel::InputProcessor m_processor;
+    Framing m_framing{Framing::json};
+    Compression m_compression{Compression::none};
+    std::size_t m_compressMin{UConfigS::getUConfig().compressMinBytes()};
+    compress::Stats m_deflated;
+    enum { max_length = 64*1024 }; //!< max default receive segment size, bigger messages grow it
+    enum { min_length = 4*1024 };  //!< receive segment size of a quiet peer
+    const RecvLimits m_recvLimits{UConfigS::getUConfig().recvLimits()};
+    RecvBuffer m_recv{max_length, min_length};
+    RecvQuota::shr_t m_recvQuota; //!< received data held by this session
+    std::size_t m_readPauses{0};  //!< times reading was paused by the quota
+    uzel::InputProcessor m_processor{m_recvLimits.maxFrame, m_recvLimits.maxAttachment};
+    std::array<int, 2> m_pipe{-1, -1}; //!< splices received attachments to the spool file, created when needed
     MsgQueue m_outQueue;
+    std::vector<std::weak_ptr<session>> m_blockedProducers; //!< sessions not reading because of the full out queue
+    std::size_t m_readBlocks{0};  //!< see blockReading()
+    bool m_readParked{false};     //!< do_read() stopped because of m_readBlocks
+    WriteBatch m_batch{UConfigS::getUConfig().writeBatch()};
+    boost::asio::steady_timer m_flushTimer{m_socket.get_executor()};
+    std::vector<boost::asio::const_buffer> m_writeBufs; //!< buffers of the write in progress
+    std::size_t m_inFlight{0};   //!< number of messages from the front of the queue being written
+    std::size_t m_writes{0};     //!< see writes()
+    bool m_writing{false};       //!< write is in progress or scheduled
+    bool m_flushPending{false};  //!< waiting for more messages before writing
     uzel::Msg::shr_t m_msg1; // the very first message is set only after authentication
+    std::atomic<bool> m_authenticated{false}; //!< m_msg1 is set, can be read from any thread
     bool m_closeFlag{false};
     bool m_stopped{false};
     std::string m_reason{};
@@ -143,8 +216,8 @@ namespace uzel
     }
   };
 
-  using IpToSession = std::unordered_map<boost::asio::ip::address,
-                                         std::unordered_set<uzel::session::shr_t>,
-                                         AddressHash, AddressEqual>;
+  using IpToSession = Registry<boost::asio::ip::address,
+                              std::unordered_set<uzel::session::shr_t>,
+                              AddressHash, AddressEqual>;
 
 }
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace uzel
+{
+    /**
+     * Bounded lock-free queue of one producer and one consumer thread.
+     *
+     * The ring holds a power of two slots. Head is written by the
+     * consumer only, tail by the producer only, each side caches the
+     * other's index to touch the shared cache line only when the ring
+     * looks full (or empty).
+     * */
+  template<typename T>
+  class SpscQueue
+  {
+  public:
+      /** @param capacity rounded up to a power of two */
+    explicit SpscQueue(std::size_t capacity)
+      : m_mask(roundUp(capacity) - 1),
+        m_slots(std::make_unique<std::optional<T>[]>(m_mask + 1))
+    {
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue(SpscQueue &&) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+    SpscQueue &operator=(SpscQueue &&) = delete;
+    ~SpscQueue() = default;
+
+      /** producer side: @return false if the queue is full, value is not moved then */
+    bool push(T &value)
+    {
+      const auto tail = m_tail.load(std::memory_order_relaxed);
+      if(tail - m_headCache > m_mask) {
+        m_headCache = m_head.load(std::memory_order_acquire);
+        if(tail - m_headCache > m_mask) return false;
+      }
+      m_slots[tail & m_mask].emplace(std::move(value));
+      m_tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+      /** consumer side: @return the oldest value or nothing if the queue is empty */
+    std::optional<T> pop()
+    {
+      const auto head = m_head.load(std::memory_order_relaxed);
+      if(head == m_tailCache) {
+        m_tailCache = m_tail.load(std::memory_order_acquire);
+        if(head == m_tailCache) return {};
+      }
+      auto &slot = m_slots[head & m_mask];
+      std::optional<T> value(std::move(slot));
+      slot.reset();
+      m_head.store(head + 1, std::memory_order_release);
+      return value;
+    }
+
+    [[nodiscard]] std::size_t capacity() const { return m_mask + 1; }
+
+  private:
+    static std::size_t roundUp(std::size_t n)
+    {
+      std::size_t size = 2;
+      while(size < n) size <<= 1U;
+      return size;
+    }
+
+    static constexpr std::size_t CacheLine = 64;
+
+    const std::size_t m_mask;
+    std::unique_ptr<std::optional<T>[]> m_slots;
+    alignas(CacheLine) std::atomic<std::size_t> m_head{0}; //!< next slot to pop
+    std::size_t m_tailCache{0};                            //!< consumer's view of m_tail
+    alignas(CacheLine) std::atomic<std::size_t> m_tail{0}; //!< next slot to push
+    std::size_t m_headCache{0};                            //!< producer's view of m_head
+  };
+}
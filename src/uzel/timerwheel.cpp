@@ -0,0 +1,235 @@
+#include "timerwheel.h"
+
+#include <boost/asio/post.hpp>
+#include <algorithm>
+
+namespace uzel
+{
+  TimerWheel::TimerWheel(const boost::asio::any_io_executor &executor, clock::duration tick)
+    : m_tick(tick), m_start(clock::now()), m_timer(executor)
+  {
+    m_slots.fill(None);
+  }
+
+
+  std::uint64_t TimerWheel::tickOf(clock::time_point when) const
+  {
+    if(when <= m_start) return 0;
+      // rounded up, a timer never fires early
+    return static_cast<std::uint64_t>((when - m_start + m_tick - clock::duration(1)) / m_tick);
+  }
+
+
+  TimerWheel::Handle TimerWheel::schedule(clock::time_point when, Callback cb)
+  {
+    std::uint32_t idx = m_free;
+    if(idx != None) {
+      m_free = m_entries[idx].next;
+    } else {
+      idx = static_cast<std::uint32_t>(m_entries.size());
+      m_entries.emplace_back();
+    }
+    auto &entry = m_entries[idx];
+    entry.cb = std::move(cb);
+      // the current tick is processed already
+    entry.expires = std::max(tickOf(when), m_now + 1);
+    insert(idx);
+    ++m_size;
+    arm();
+    return Handle{idx, entry.generation};
+  }
+
+
+  void TimerWheel::cancel(Handle &handle)
+  {
+    if(handle && handle.index < m_entries.size()) {
+      auto &entry = m_entries[handle.index];
+      if(entry.generation == handle.generation && entry.slot != None) {
+        unlink(handle.index);
+        release(handle.index);
+      }
+    }
+    handle = Handle{};
+  }
+
+
+  void TimerWheel::insert(std::uint32_t idx)
+  {
+    auto &entry = m_entries[idx];
+    const auto delta = entry.expires - m_now;
+    std::size_t level = 0;
+    while(level + 1 < Levels && delta >= (std::uint64_t{1} << (SlotBits * (level + 1)))) {
+      ++level;
+    }
+      // beyond the wheel: parked in the last slot it covers, the real expiry is kept
+      // and the entry goes further when that slot is cascaded
+    const auto horizon = std::uint64_t{1} << (SlotBits * Levels);
+    const auto at = delta >= horizon ? m_now + horizon - 1 : entry.expires;
+    const auto slot = static_cast<std::uint32_t>(level * Slots + ((at >> (SlotBits * level)) & (Slots - 1)));
+    entry.slot = slot;
+    entry.prev = None;
+    entry.next = m_slots[slot];
+    if(entry.next != None) {
+      m_entries[entry.next].prev = idx;
+    }
+    m_slots[slot] = idx;
+  }
+
+
+  void TimerWheel::unlink(std::uint32_t idx)
+  {
+    auto &entry = m_entries[idx];
+    if(entry.prev != None) {
+      m_entries[entry.prev].next = entry.next;
+    } else {
+      m_slots[entry.slot] = entry.next;
+    }
+    if(entry.next != None) {
+      m_entries[entry.next].prev = entry.prev;
+    }
+    entry.prev = None;
+    entry.next = None;
+    entry.slot = None;
+  }
+
+
+  void TimerWheel::release(std::uint32_t idx)
+  {
+    auto &entry = m_entries[idx];
+    entry.cb = nullptr;
+    ++entry.generation;
+    entry.next = m_free;
+    m_free = idx;
+    --m_size;
+  }
+
+
+  void TimerWheel::cascade(std::size_t level)
+  {
+    const auto slot = level * Slots + ((m_now >> (SlotBits * level)) & (Slots - 1));
+    auto idx = m_slots[slot];
+    m_slots[slot] = None;
+    while(idx != None) {
+      const auto next = m_entries[idx].next;
+      insert(idx);
+      idx = next;
+    }
+  }
+
+
+  void TimerWheel::advance(clock::time_point now)
+  {
+      // ticks completely elapsed
+    const auto target = now <= m_start ? std::uint64_t{0} : static_cast<std::uint64_t>((now - m_start) / m_tick);
+    while(m_now < target && m_size > 0) {
+      ++m_now;
+      for(std::size_t level = 1; level < Levels; ++level) {
+        if(((m_now >> (SlotBits * (level - 1))) & (Slots - 1)) != 0) break;
+        cascade(level);
+      }
+      m_processed.store(m_now, std::memory_order_relaxed);
+      const auto slot = m_now & (Slots - 1);
+        // callbacks may schedule and cancel, take the entries one by one
+      while(m_slots[slot] != None) {
+        const auto idx = m_slots[slot];
+        auto cb = std::move(m_entries[idx].cb);
+        unlink(idx);
+        release(idx);
+        cb();
+      }
+    }
+    if(m_size == 0) {
+        // nothing to wait for, the next schedule() starts from the current time
+      m_now = std::max(m_now, target);
+      m_processed.store(m_now, std::memory_order_relaxed);
+    }
+  }
+
+
+  void TimerWheel::arm()
+  {
+    if(m_armed || m_size == 0) return;
+    m_armed = true;
+    m_timer.expires_at(m_start + static_cast<std::int64_t>(m_now + 1) * m_tick);
+    m_timer.async_wait([this](const boost::system::error_code &ec) {
+      if(ec == boost::asio::error::operation_aborted) return;
+      m_armed = false;
+      advance(clock::now());
+      arm();
+    });
+  }
+
+
+  StrandTimers::StrandTimers(TimerWheel::shr_t wheel, const boost::asio::any_io_executor &executor)
+    : m_wheel(std::move(wheel)), m_executor(executor), m_direct(m_wheel->executor() == executor)
+  {
+  }
+
+
+  StrandTimers::Handle StrandTimers::schedule(clock::time_point when, Callback cb)
+  {
+    if(m_direct) {
+      return m_wheel->schedule(when, std::move(cb));
+    }
+    std::uint32_t idx = m_free;
+    if(idx != None) {
+      m_free = m_entries[idx].next;
+    } else {
+      idx = static_cast<std::uint32_t>(m_entries.size());
+      m_entries.emplace_back();
+    }
+    auto &entry = m_entries[idx];
+    entry.cb = std::move(cb);
+    const Handle handle{idx, entry.generation};
+    boost::asio::post(m_wheel->executor(), [self = shared_from_this(), when, key = keyOf(handle)]() {
+      self->m_scheduled[key] = self->m_wheel->schedule(when, [self, key]() {
+        self->m_scheduled.erase(key);
+        boost::asio::post(self->m_executor, [self, key]() { self->fire(key); });
+      });
+    });
+    return handle;
+  }
+
+
+  void StrandTimers::cancel(Handle &handle)
+  {
+    if(m_direct) {
+      m_wheel->cancel(handle);
+      return;
+    }
+    if(handle && handle.index < m_entries.size() && m_entries[handle.index].generation == handle.generation &&
+       m_entries[handle.index].cb) {
+      release(handle.index);
+        // posted after the schedule, the wheel's strand keeps the order
+      boost::asio::post(m_wheel->executor(), [self = shared_from_this(), key = keyOf(handle)]() {
+        const auto it = self->m_scheduled.find(key);
+        if(it == self->m_scheduled.end()) return;
+        self->m_wheel->cancel(it->second);
+        self->m_scheduled.erase(it);
+      });
+    }
+    handle = Handle{};
+  }
+
+
+  void StrandTimers::fire(std::uint64_t key)
+  {
+    const auto idx = static_cast<std::uint32_t>(key >> 32U);
+    const auto generation = static_cast<std::uint32_t>(key);
+      // cancelled after the wheel fired
+    if(idx >= m_entries.size() || m_entries[idx].generation != generation || !m_entries[idx].cb) return;
+    auto cb = std::move(m_entries[idx].cb);
+    release(idx);
+    cb();
+  }
+
+
+  void StrandTimers::release(std::uint32_t idx)
+  {
+    auto &entry = m_entries[idx];
+    entry.cb = nullptr;
+    ++entry.generation;
+    entry.next = m_free;
+    m_free = idx;
+  }
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Hierarchical timer wheel for many cheap timers (message TTLs).
+     *
+     * Time is counted in ticks. Level 0 has a slot for each of the next
+     * Slots ticks, every further level covers Slots times more with the
+     * same number of slots and its slots are moved (cascaded) one level
+     * down when the lower level wraps. Scheduling and cancelling are
+     * O(1), every timer is cascaded at most Levels-1 times. Timers
+     * further away than the wheel covers wait in its last slot and are
+     * put back there until they come within reach.
+     *
+     * Entries live in one vector linked by index, a Handle names the
+     * entry together with its generation, so a stale handle is
+     * harmless. One asio timer drives the wheel and only while timers
+     * are scheduled. Not thread safe: use it from the thread running the
+     * executor.
+     * */
+  class TimerWheel
+  {
+  public:
+    using shr_t = std::shared_ptr<TimerWheel>;
+    using clock = std::chrono::steady_clock;
+    using Callback = std::function<void ()>;
+
+    static constexpr unsigned SlotBits = 6;
+    static constexpr std::size_t Slots = std::size_t{1} << SlotBits;
+    static constexpr std::size_t Levels = 4;
+    static constexpr std::chrono::milliseconds DefaultTick{100};
+
+    struct Handle
+    {
+      std::uint32_t index{std::numeric_limits<std::uint32_t>::max()};
+      std::uint32_t generation{0};
+
+      [[nodiscard]] explicit operator bool() const { return index != std::numeric_limits<std::uint32_t>::max(); }
+    };
+
+    explicit TimerWheel(const boost::asio::any_io_executor &executor, clock::duration tick = DefaultTick);
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel(TimerWheel &&) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+    TimerWheel &operator=(TimerWheel &&) = delete;
+    ~TimerWheel() = default;
+
+      /** call cb once after when, rounded up to the next tick */
+    [[nodiscard]] Handle schedule(clock::time_point when, Callback cb);
+      /** forget the timer if it did not fire yet, resets the handle */
+    void cancel(Handle &handle);
+      /** time the wheel has processed, a fired timer is due by then; can be called from any thread */
+    [[nodiscard]] clock::time_point now() const
+    {
+      return m_start + static_cast<std::int64_t>(m_processed.load(std::memory_order_relaxed)) * m_tick;
+    }
+      /** executor running the wheel */
+    [[nodiscard]] boost::asio::any_io_executor executor() { return m_timer.get_executor(); }
+      /** scheduled timers */
+    [[nodiscard]] std::size_t size() const { return m_size; }
+      /**
+       * fire the timers due at now, called by the asio timer (and by
+       * tests with their own clock)
+       * */
+    void advance(clock::time_point now);
+
+  private:
+    static constexpr std::uint32_t None = std::numeric_limits<std::uint32_t>::max();
+
+    struct Entry
+    {
+      Callback cb;
+      std::uint64_t expires{0};  //!< tick
+      std::uint32_t prev{None};
+      std::uint32_t next{None};
+      std::uint32_t slot{None};  //!< index into m_slots, None - free entry
+      std::uint32_t generation{0};
+    };
+
+    [[nodiscard]] std::uint64_t tickOf(clock::time_point when) const;
+      /** put the entry in the slot matching its expiry */
+    void insert(std::uint32_t idx);
+    void unlink(std::uint32_t idx);
+    void release(std::uint32_t idx);
+      /** move the timers of a slot of the level one level down */
+    void cascade(std::size_t level);
+    void arm();
+
+    const clock::duration m_tick;
+    const clock::time_point m_start;
+    std::uint64_t m_now{0}; //!< ticks processed
+    std::atomic<std::uint64_t> m_processed{0}; //!< m_now for other threads
+    std::array<std::uint32_t, Slots * Levels> m_slots;
+    std::vector<Entry> m_entries;
+    std::uint32_t m_free{None};
+    std::size_t m_size{0};
+    boost::asio::steady_timer m_timer;
+    bool m_armed{false};
+  };
+
+
+    /**
+     * Timers of the objects running on one executor (a session or a
+     * remote on its strand), kept in a TimerWheel.
+     *
+     * With one thread the wheel runs on the same executor and is used
+     * directly. With several threads all strands share one wheel running
+     * on a strand of its own, instead of a wheel and its asio timer per
+     * strand: schedule() and cancel() are posted to the wheel and a due
+     * callback is posted back to the executor. A timer cancelled (or a
+     * slot reused) meanwhile is recognized by its generation, as in the
+     * wheel. Not thread safe: use it from the executor.
+     * */
+  class StrandTimers : public std::enable_shared_from_this<StrandTimers>
+  {
+  public:
+    using shr_t = std::shared_ptr<StrandTimers>;
+    using clock = TimerWheel::clock;
+    using Callback = TimerWheel::Callback;
+    using Handle = TimerWheel::Handle;
+
+    StrandTimers(TimerWheel::shr_t wheel, const boost::asio::any_io_executor &executor);
+
+    StrandTimers(const StrandTimers &) = delete;
+    StrandTimers(StrandTimers &&) = delete;
+    StrandTimers &operator=(const StrandTimers &) = delete;
+    StrandTimers &operator=(StrandTimers &&) = delete;
+    ~StrandTimers() = default;
+
+      /** call cb on the executor once after when, see TimerWheel::schedule() */
+    [[nodiscard]] Handle schedule(clock::time_point when, Callback cb);
+      /** forget the timer if it did not fire yet, resets the handle */
+    void cancel(Handle &handle);
+      /** see TimerWheel::now() */
+    [[nodiscard]] clock::time_point now() const { return m_wheel->now(); }
+
+  private:
+    static constexpr std::uint32_t None = std::numeric_limits<std::uint32_t>::max();
+
+    struct Entry
+    {
+      Callback cb;        //!< empty - free entry
+      std::uint32_t next{None};
+      std::uint32_t generation{0};
+    };
+
+    static std::uint64_t keyOf(const Handle &handle) { return (std::uint64_t{handle.index} << 32U) | handle.generation; }
+    void fire(std::uint64_t key);
+    void release(std::uint32_t idx);
+
+    const TimerWheel::shr_t m_wheel;
+    const boost::asio::any_io_executor m_executor;
+    const bool m_direct; //!< the wheel runs on the executor
+    std::vector<Entry> m_entries;
+    std::uint32_t m_free{None};
+    std::unordered_map<std::uint64_t, Handle> m_scheduled; //!< wheel timers by entry key, used on the wheel's executor
+  };
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "addr.h"
+#include "jsoncursor.h"
+#include "jsonwriter.h"
+#include "msg.h"
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <concepts>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace uzel
+{
+    /**
+     * Typed message bodies.
+     *
+     * A message type is a plain struct with the cname and the list of
+     * its fields, given by the static fields() visitor:
+     * @code
+     * struct Ping
+     * {
+     *   static constexpr std::string_view cname{"ping"};
+     *   std::uint64_t serial{0};
+     *   std::string note;
+     *
+     *   template<typename Self, typename Visitor>
+     *   static void fields(Self &self, Visitor &&visit)
+     *   {
+     *     visit("serial", self.serial);
+     *     visit("note", self.note);
+     *   }
+     * };
+     * @endcode
+     * Encoding writes the json body straight from the fields and
+     * decoding reads the received json into them with JsonCursor, so
+     * neither ptree nor JDoc is built and numbers are not converted
+     * through strings. Fields can be bool, numbers, std::string,
+     * std::optional (omitted if empty), std::vector and nested structs
+     * with fields(). Numbers are also accepted as strings, the way
+     * ptree writes them, unknown fields are skipped and missing ones
+     * keep their default values. Json has no nan or infinity, they are
+     * written as null, which is read back as nan.
+     * */
+  namespace typed
+  {
+    namespace detail
+    {
+      template<typename Buf>
+      void append(Buf &out, std::string_view str)
+      {
+        out.insert(out.end(), str.begin(), str.end());
+      }
+
+      struct FieldProbe
+      {
+        template<typename Field>
+        void operator()(std::string_view /*name*/, Field & /*field*/) const {}
+      };
+    }
+
+      /** struct with the fields() visitor */
+    template<typename T>
+    concept Fields = std::default_initializable<T> && requires(T &val) { T::fields(val, detail::FieldProbe{}); };
+
+      /** body of a message type, see above */
+    template<typename T>
+    concept Body = Fields<T> && requires { { T::cname } -> std::convertible_to<std::string_view>; };
+
+    template<typename T> struct IsOptional : std::false_type {};
+    template<typename T> struct IsOptional<std::optional<T>> : std::true_type {};
+    template<typename T> struct IsVector : std::false_type {};
+    template<typename T> struct IsVector<std::vector<T>> : std::true_type {};
+
+
+    template<typename Buf, typename T>
+    void writeValue(Buf &out, const T &val)
+    {
+      if constexpr(std::is_same_v<T, bool>) {
+        detail::append(out, val ? "true" : "false");
+      } else if constexpr(std::is_floating_point_v<T>) {
+        if(!std::isfinite(val)) {
+          detail::append(out, "null");
+          return;
+        }
+        std::array<char, 32> buf{};
+        auto [ptr, ec] = std::to_chars(buf.data(), std::next(buf.data(), buf.size()), val);
+        out.insert(out.end(), buf.data(), ptr);
+      } else if constexpr(std::is_arithmetic_v<T>) {
+        std::array<char, 32> buf{};
+        auto [ptr, ec] = std::to_chars(buf.data(), std::next(buf.data(), buf.size()), val);
+        out.insert(out.end(), buf.data(), ptr);
+      } else if constexpr(std::is_convertible_v<const T &, std::string_view>) {
+        jsonwriter::writeString(out, std::string_view(val));
+      } else if constexpr(IsOptional<T>::value) {
+        if(val) {
+          writeValue(out, *val);
+        } else {
+          detail::append(out, "null");
+        }
+      } else if constexpr(IsVector<T>::value) {
+        out.push_back('[');
+        bool first{true};
+        for(auto &&item : val) {
+          if(!first) out.push_back(',');
+          first = false;
+          writeValue(out, item);
+        }
+        out.push_back(']');
+      } else {
+        static_assert(Fields<T>, "unsupported field type");
+        out.push_back('{');
+        bool first{true};
+        T::fields(val, [&out, &first](std::string_view name, const auto &field) {
+          if constexpr(IsOptional<std::remove_cvref_t<decltype(field)>>::value) {
+            if(!field) return;
+          }
+          if(!first) out.push_back(',');
+          first = false;
+          jsonwriter::writeString(out, name);
+          out.push_back(':');
+          writeValue(out, field);
+        });
+        out.push_back('}');
+      }
+    }
+
+
+    template<typename T>
+    void readValue(JsonCursor &cur, T &val)
+    {
+      if constexpr(std::is_arithmetic_v<T>) {
+        std::string buf;
+        const auto text = cur.peek() == '"' ? cur.stringView(buf) : cur.scalar();
+        if constexpr(std::is_same_v<T, bool>) {
+          if(text != "true" && text != "false") cur.fail("boolean expected");
+          val = (text == "true");
+        } else if(std::is_floating_point_v<T> && text == "null") {
+          val = std::numeric_limits<T>::quiet_NaN();
+        } else {
+          const auto *end = std::next(text.data(), static_cast<std::ptrdiff_t>(text.size()));
+          auto [ptr, ec] = std::from_chars(text.data(), end, val);
+          if(ec != std::errc() || ptr != end) cur.fail("number expected");
+        }
+      } else if constexpr(std::is_same_v<T, std::string>) {
+        val = cur.string();
+      } else if constexpr(IsOptional<T>::value) {
+        if(cur.peek() == 'n') {
+          if(cur.scalar() != "null") cur.fail("null expected");
+          val.reset();
+        } else {
+          readValue(cur, val.emplace());
+        }
+      } else if constexpr(IsVector<T>::value) {
+        val.clear();
+        cur.expect('[');
+        if(cur.consume(']')) return;
+        do {
+          readValue(cur, val.emplace_back());
+        } while(cur.consume(','));
+        cur.expect(']');
+      } else {
+        static_assert(Fields<T>, "unsupported field type");
+        cur.expect('{');
+        if(cur.consume('}')) return;
+        std::string buf;
+        do {
+          const auto key = cur.stringView(buf);
+          cur.expect(':');
+          bool found{false};
+          T::fields(val, [&](std::string_view name, auto &field) {
+            if(found || name != key) return;
+            found = true;
+            readValue(cur, field);
+          });
+          if(!found) {
+            cur.skipValue();
+          }
+        } while(cur.consume(','));
+        cur.expect('}');
+      }
+    }
+
+
+      /** append json of the body to out (std::string or std::vector<char>) */
+    template<Fields T, typename Buf>
+    void encode(Buf &out, const T &body)
+    {
+      writeValue(out, body);
+    }
+
+      /** @throw std::runtime_error if json does not match the type */
+    template<Fields T>
+    [[nodiscard]] T decode(std::string_view json)
+    {
+      T body;
+      JsonCursor cur(json);
+      readValue(cur, body);
+      cur.skipWs();
+      if(!cur.atEnd()) cur.fail("unexpected data after the body");
+      return body;
+    }
+
+      /** decode body of the received message */
+    template<Fields T>
+    [[nodiscard]] T decode(const Msg &msg)
+    {
+      if(const auto *raw = msg.rawBody(); raw != nullptr && msg.contentType() == +ContentType::json) {
+        return decode<T>(raw->view());
+      }
+      return decode<T>(msg.bodyJson());
+    }
+
+      /** outgoing message with the typed body */
+    template<Body T>
+    [[nodiscard]] Msg::shr_t makeMsg(const Addr &dest, const T &body)
+    {
+      std::vector<char> json;
+      encode(json, body);
+      return std::make_shared<Msg>(dest, std::string(T::cname), ByteSlice(std::move(json)));
+    }
+  }
+}
@@ -5,7 +5,10 @@
 #include <boost/property_tree/ini_parser.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/filesystem.hpp>
+#include <algorithm>
+#include <limits>
 #include <regex>
+#include <thread>
 
 namespace uzel
 {
@@ -73,4 +76,129 @@ namespace uzel
     std::list<std::string> lst(iter, end);
     return lst;
   }
+
+  Framing UConfig::framing() const
+  {
+    auto name = m_pt.get<std::string>("protocol.framing", "binary");
+    auto fr = Framing::_from_string_nothrow(name.c_str());
+    if(!fr) {
+      throw std::runtime_error("unknown framing '" + name + "' in [protocol] section");
+    }
+    return *fr;
+  }
+
+  WriteBatch UConfig::writeBatch() const
+  {
+    WriteBatch batch;
+    batch.maxBytes = m_pt.get<std::size_t>("protocol.write_batch_bytes", batch.maxBytes);
+    batch.maxFrames = std::max<std::size_t>(1, m_pt.get<std::size_t>("protocol.write_batch_frames", batch.maxFrames));
+    batch.delay = std::chrono::microseconds(m_pt.get<std::int64_t>("protocol.write_delay_us", batch.delay.count()));
+    return batch;
+  }
+
+  Compression UConfig::compression(const std::string &remote) const
+  {
+    auto name = m_pt.get<std::string>("protocol.compression", "none");
+      // remote names can contain dots, do not split them into the path
+    if(auto section = m_pt.get_child_optional(ptree::path_type(remote, '\0'))) {
+      name = section->get<std::string>("compression", name);
+    }
+    auto codec = Compression::_from_string_nothrow(name.c_str());
+    if(!codec) {
+      throw std::runtime_error("unknown compression '" + name + "' for remote " + remote);
+    }
+    return *codec;
+  }
+
+  std::size_t UConfig::compressMinBytes() const
+  {
+    const std::size_t defaultMin = 1024;
+    return m_pt.get<std::size_t>("protocol.compress_min_bytes", defaultMin);
+  }
+
+  RecvLimits UConfig::recvLimits() const
+  {
+    RecvLimits limits;
+    limits.maxFrame = m_pt.get<std::size_t>("protocol.max_frame_bytes", limits.maxFrame);
+    if(limits.maxFrame == 0) {
+      limits.maxFrame = std::numeric_limits<std::size_t>::max();
+    }
+    limits.sessionBytes = m_pt.get<std::size_t>("protocol.session_recv_bytes", limits.sessionBytes);
+    limits.totalBytes = m_pt.get<std::size_t>("protocol.total_recv_bytes", limits.totalBytes);
+    limits.maxAttachment = m_pt.get<std::uint64_t>("protocol.max_attachment_bytes", limits.maxAttachment);
+    if(limits.maxAttachment == 0) {
+      limits.maxAttachment = std::numeric_limits<std::uint64_t>::max();
+    }
+    return limits;
+  }
+
+  QueueLimits UConfig::queueLimits() const
+  {
+    QueueLimits limits;
+    limits.maxBytes = m_pt.get<std::size_t>("protocol.queue_max_bytes", limits.maxBytes);
+    limits.maxMessages = m_pt.get<std::size_t>("protocol.queue_max_messages", limits.maxMessages);
+    limits.highPercent = std::min(100U, m_pt.get<unsigned>("protocol.queue_high_percent", limits.highPercent));
+    limits.lowPercent = std::min(limits.highPercent, m_pt.get<unsigned>("protocol.queue_low_percent", limits.lowPercent));
+    auto name = m_pt.get<std::string>("protocol.queue_overflow", limits.policy._to_string());
+    auto policy = OverflowPolicy::_from_string_nothrow(name.c_str());
+    if(!policy) {
+      throw std::runtime_error("unknown queue_overflow '" + name + "' in [protocol] section");
+    }
+    limits.policy = *policy;
+    limits.ttl = std::chrono::seconds(m_pt.get<std::int64_t>("protocol.message_ttl_sec", limits.ttl.count()));
+    return limits;
+  }
+
+  std::map<std::string, Priority> UConfig::cnamePriority() const
+  {
+    std::map<std::string, Priority> prios;
+    if(auto section = m_pt.get_child_optional("priority")) {
+      for(auto &&entry : *section) {
+        const auto &name = entry.second.data();
+        auto prio = Priority::_from_string_nothrow(name.c_str());
+        if(!prio || *prio == +Priority::undefined) {
+          throw std::runtime_error("unknown priority '" + name + "' of cname '" + entry.first + "' in [priority] section");
+        }
+        prios.emplace(entry.first, *prio);
+      }
+    }
+    return prios;
+  }
+
+  std::map<std::string, std::chrono::milliseconds> UConfig::cnameTtl() const
+  {
+    std::map<std::string, std::chrono::milliseconds> ttls;
+    if(auto section = m_pt.get_child_optional("ttl")) {
+      for(auto &&entry : *section) {
+        ttls.emplace(entry.first, std::chrono::milliseconds(entry.second.get_value<std::int64_t>()));
+      }
+    }
+    return ttls;
+  }
+
+  unsigned UConfig::threads() const
+  {
+    const auto threads = m_pt.get<unsigned>("node.threads", 1);
+    if(threads == 0) {
+      return std::max(1U, std::thread::hardware_concurrency());
+    }
+    return threads;
+  }
+
+  unsigned UConfig::shards() const
+  {
+    const auto shards = m_pt.get<unsigned>("node.shards", 1);
+    if(shards == 0) {
+      return std::max(1U, std::thread::hardware_concurrency());
+    }
+    return shards;
+  }
+
+  std::string UConfig::spoolDir() const
+  {
+    if(auto dir = m_pt.get_optional<std::string>("node.spool_dir")) {
+      return *dir;
+    }
+    return (boost::filesystem::temp_directory_path() / "uzel-spool").string();
+  }
 };
@@ -1,13 +1,55 @@
 #pragma once
 
+#include "enum.h"
+#include "frame.h"
+#include "priority.h"
+
 #include <boost/property_tree/ptree.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <list>
+#include <map>
 
 namespace uzel
 {
 
 
+    /** limits for coalescing queued messages into one socket write */
+  struct WriteBatch
+  {
+    std::size_t maxBytes{256UL*1024}; //!< stop adding messages to the write after that many bytes
+    std::size_t maxFrames{64};        //!< max messages per write
+    std::chrono::microseconds delay{0}; //!< how long the first message may wait for more to come
+  };
+
+
+    /** limits of received data held in memory */
+  struct RecvLimits
+  {
+    std::size_t maxFrame{64UL*1024*1024};      //!< bigger message (or json line) closes the connection
+    std::size_t sessionBytes{16UL*1024*1024};  //!< the session stops reading while holding more, 0 - unlimited
+    std::size_t totalBytes{256UL*1024*1024};   //!< all sessions stop reading while holding more, 0 - unlimited
+    std::uint64_t maxAttachment{4ULL*1024*1024*1024}; //!< bigger attached file closes the connection
+  };
+
+
+    /** what to do with a message to the full out queue */
+  BETTER_ENUM(OverflowPolicy, uint8_t, block = 0, dropOldest, dropNewest, dropLowPriority); //NOLINT
+
+    /** limits of one out queue, see MsgQueue */
+  struct QueueLimits
+  {
+    std::size_t maxBytes{64UL*1024*1024}; //!< 0 - unlimited
+    std::size_t maxMessages{100000};      //!< 0 - unlimited
+    unsigned highPercent{80};             //!< s_highWatermark when the queue fills that much of a limit
+    unsigned lowPercent{50};              //!< s_lowWatermark when it drains below that again
+    OverflowPolicy policy{OverflowPolicy::dropOldest};
+    std::chrono::seconds ttl{60};         //!< queued messages older than that are dropped, 0 - never
+  };
+
+
   class UConfig
   {
   public:
@@ -18,6 +60,28 @@ namespace uzel
     [[nodiscard]] static std::string appName();
     [[nodiscard]] bool isLocalNode(const std::string &nname) const;
     [[nodiscard]] std::list<std::string> remotes() const;
+      /** preferred framing, used only if peer supports it too */
+    [[nodiscard]] Framing framing() const;
+    [[nodiscard]] WriteBatch writeBatch() const;
+      /**
+       * codec to compress messages to the remote with, set in the
+       * section of the remote or in [protocol] for all remotes
+       * */
+    [[nodiscard]] Compression compression(const std::string &remote) const;
+      /** smaller message bodies are never compressed */
+    [[nodiscard]] std::size_t compressMinBytes() const;
+    [[nodiscard]] RecvLimits recvLimits() const;
+    [[nodiscard]] QueueLimits queueLimits() const;
+      /** priority of the messages by cname, set in [priority] section, applied to messages without priority */
+    [[nodiscard]] std::map<std::string, Priority> cnamePriority() const;
+      /** TTL of the messages by cname, set in [ttl] section, applied to messages without deadline */
+    [[nodiscard]] std::map<std::string, std::chrono::milliseconds> cnameTtl() const;
+      /** threads running the io_context of userver, at least 1 */
+    [[nodiscard]] unsigned threads() const;
+      /** shards of userver, each runs own io_context on own core, 1 - not sharded */
+    [[nodiscard]] unsigned shards() const;
+      /** directory received attachments are written to */
+    [[nodiscard]] std::string spoolDir() const;
   private:
     ptree m_pt;
   };
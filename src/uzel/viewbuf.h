@@ -0,0 +1,17 @@
+#pragma once
+
+#include <streambuf>
+#include <string_view>
+
+namespace uzel
+{
+    /** read-only std::streambuf over existing memory, allows to use istream without copying */
+  class view_inputbuf : public std::streambuf {
+  public:
+    explicit view_inputbuf(std::string_view data) {
+        // const_cast is necessary to workaround setg() flaw
+      char* begin = const_cast<char*>(data.data()); // NOLINT{cppcoreguidelines-pro-type-const-cast}
+      setg(begin, begin, begin + data.size()); // NOLINT{cppcoreguidelines-pro-bounds-pointer-arithmetic}
+    }
+  };
+}
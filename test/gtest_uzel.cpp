@@ -4,8 +4,40 @@
  * @brief test uzel
  *  */
 
+#include <uzel/frame.h>
+#include <uzel/inputprocessor.h>
+#include <uzel/lanes.h>
+#include <uzel/netappcontext.h>
+#include <uzel/session.h>
+#include <uzel/attachment.h>
+#include <uzel/recvbuffer.h>
+#include <uzel/msgqueue.h>
+#include <uzel/registry.h>
+#include <uzel/spscqueue.h>
+#include <uzel/timerwheel.h>
+#include <uzel/compress.h>
+#include <uzel/linescan.h>
+#include <uzel/acculine.h>
+#include <uzel/headerscan.h>
+#include <uzel/bodyview.h>
+#include <uzel/jvalue.h>
+#include <uzel/binbody.h>
+#include <uzel/jsonwriter.h>
+#include <uzel/typedmsg.h>
+
+#include <boost/property_tree/json_parser.hpp>
+
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 namespace {
 using std::string;
@@ -17,5 +49,1133 @@ TEST(uzel, input1) {
     EXPECT_EQ(1,1);
   }
 }
+
+  /** session without a connection, input is fed to an InputProcessor on its behalf */
+struct TestSession
+{
+  boost::asio::io_context ioc;
+  uzel::NetAppContextPtr netctx{std::make_shared<uzel::NetAppContext>(ioc)};
+  uzel::session::shr_t ss{std::make_shared<uzel::session>(netctx, boost::asio::ip::tcp::socket(ioc),
+                                                          uzel::Direction::incoming, boost::asio::ip::address())};
+  std::string node{uzel::UConfigS::getUConfig().nodeName()};
+
+    /** run the handlers dispatched so far */
+  void handle()
+  {
+    ioc.restart();
+    ioc.poll();
+  }
+
+    /** first message of the userver of this node */
+  void authenticate(uzel::InputProcessor &proc)
+  {
+    const std::string auth = R"({"from":{"n":")" + node + R"(","a":"userver"},"cname":"auth"})" "\n{}\n";
+    EXPECT_EQ(proc.processNewInput(uzel::ByteSlice(std::vector<char>(auth.begin(), auth.end())), *ss), std::make_optional(auth.size()));
+    ASSERT_TRUE(ss->authenticated());
+  }
+
+    /** binary frame from the userver to this app */
+  [[nodiscard]] std::vector<char> frame(const std::string &cname, const std::string &body) const
+  {
+    uzel::MsgHeader header;
+    header.from = uzel::Addr("userver", node);
+    header.to = uzel::Addr(uzel::UConfig::appName(), node);
+    header.cname = uzel::Atom::intern(cname);
+    std::vector<char> out;
+    uzel::frame::encode(header, body, out);
+    return out;
+  }
+};
+
+  /** input from begin to end of the frame */
+std::optional<std::size_t> feed(uzel::InputProcessor &proc, const std::vector<char> &frame, std::size_t begin, std::size_t end, uzel::session &ss)
+{
+  return proc.processNewInput(uzel::ByteSlice(std::vector<char>(std::next(frame.begin(), static_cast<std::ptrdiff_t>(begin)),
+                                                                std::next(frame.begin(), static_cast<std::ptrdiff_t>(end)))), ss);
+}
+
+TEST(uzel, frameLimit) {
+  uzel::MsgHeader header;
+  header.cname = uzel::Atom::intern("big");
+  std::vector<char> frame;
+  uzel::frame::encode(header, "{}", frame);
+  TestSession test;
+  {
+    uzel::InputProcessor proc(1024);
+    auto input = frame;
+    EXPECT_EQ(proc.processNewInput(uzel::ByteSlice(std::move(input)), *test.ss), std::make_optional(frame.size()));
+  }
+    // lengths from the peer are refused before anything is wanted for them,
+    // also the routing section of a body big enough to be streamed
+  const std::uint32_t huge = 0x7FFFFFFF;
+  const auto streamed = static_cast<std::uint32_t>(uzel::InputProcessor::StreamBodySize);
+  for(const auto &[routeLen, bodyLen] : {std::pair{huge, 2U}, std::pair{4U, huge}, std::pair{huge, streamed}}) {
+    auto input = frame;
+    std::memcpy(std::next(input.data(), 8), &routeLen, sizeof(routeLen));
+    std::memcpy(std::next(input.data(), 12), &bodyLen, sizeof(bodyLen));
+    uzel::InputProcessor proc(1024);
+    EXPECT_FALSE(proc.processNewInput(uzel::ByteSlice(std::move(input)), *test.ss));
+    EXPECT_EQ(proc.wanted(), 0U);
+  }
+}
+TEST(uzel, binaryFrame) {
+  uzel::MsgHeader::ptree pt;
+  pt.put("from.n", "liver");
+  pt.put("from.a", "usender");
+  pt.put("to.n", "pingutv");
+  pt.put("to.a", "uecho");
+  pt.put("cname", "ping");
+  pt.put("prio", "10");
+  pt.put("extra.x", "1");
+  auto header = uzel::MsgHeader::fromPtree(std::move(pt));
+  header.hops.emplace_back("relay");
+  header.deadline = 1700000000123;
+  EXPECT_EQ(header.priority, +uzel::Priority::high);
+  EXPECT_EQ(header.ext.get<std::string>("extra.x"), "1");
+  const std::string body = "{\"serial\":\"1\"}\n{\"second\":\"line\"}";
+
+  std::vector<char> out;
+  uzel::frame::encode(header, body, out);
+  const std::string_view data(out.data(), out.size());
+
+  EXPECT_FALSE(uzel::frame::parsePrefix(data.substr(0, uzel::frame::PrefixSize - 1)));
+  auto prefix = uzel::frame::parsePrefix(data);
+  ASSERT_TRUE(prefix);
+  EXPECT_EQ(prefix->frameSize(), out.size());
+  EXPECT_EQ(prefix->cnameId, uzel::frame::cnameId("ping"));
+  EXPECT_EQ(data.substr(uzel::frame::PrefixSize + prefix->routeLen), body);
+
+    // prefix for the body sent separately is the same as the head of the whole frame
+  std::vector<char> head;
+  uzel::frame::encodePrefix(header, body.size(), head);
+  EXPECT_EQ(std::string_view(head.data(), head.size()), data.substr(0, out.size() - body.size()));
+
+  auto decoded = uzel::frame::decodeHeader(*prefix, data.substr(uzel::frame::PrefixSize, prefix->routeLen));
+  EXPECT_EQ(decoded.from.appAtom(), header.from.appAtom());
+  EXPECT_EQ(decoded.from.node(), "liver");
+  EXPECT_EQ(decoded.to.app(), "uecho");
+  EXPECT_EQ(decoded.to.nodeAtom(), uzel::Atom("pingutv"));
+  EXPECT_EQ(decoded.cname, header.cname);
+  EXPECT_EQ(decoded.priority, header.priority);
+  EXPECT_EQ(decoded.deadline, header.deadline);
+  EXPECT_EQ(decoded.hops, header.hops);
+  EXPECT_EQ(decoded.toPtree(), header.toPtree());
+
+  EXPECT_THROW((void)uzel::frame::parsePrefix(std::string(uzel::frame::PrefixSize, '{')), std::runtime_error);
+
+    // a forwarded message is sent as the received frame, not serialized again
+  const std::string_view fwdBody = R"({"serial":"1"})";
+  out.clear();
+  uzel::frame::encode(header, fwdBody, out);
+  const uzel::ByteSlice wire{std::vector<char>(out)};
+  uzel::Msg msg(std::move(decoded), wire.sub(uzel::frame::PrefixSize + prefix->routeLen, fwdBody.size()), {});
+  msg.setWire(wire, uzel::Framing::binary);
+  const auto &sent = msg.encoded(uzel::Framing::binary);
+  ASSERT_EQ(sent.size(), 1U);
+  EXPECT_EQ(sent[0].data(), wire.data());
+    // serialized once for all the receivers
+  const auto *first = msg.encoded(uzel::Framing::json).front().data();
+  for(int receiver = 0; receiver < 3; ++receiver) {
+    EXPECT_EQ(uzel::QueuedMsg(msg, msg.encoded(uzel::Framing::json)).wire().front().data(), first);
+    EXPECT_EQ(uzel::QueuedMsg(msg, msg.encoded(uzel::Framing::binary)).wire().front().data(), wire.data());
+  }
+    // changed header drops the cache, the frame carries the new header
+  msg.setPriority(uzel::Priority::low);
+  const auto &resent = msg.encoded(uzel::Framing::binary);
+  ASSERT_FALSE(resent.empty());
+  EXPECT_NE(resent.front().data(), wire.data());
+  std::string frame2;
+  for(auto &&part : resent) frame2 += part.view();
+  auto prefix2 = uzel::frame::parsePrefix(frame2);
+  ASSERT_TRUE(prefix2);
+  EXPECT_EQ(uzel::frame::decodeHeader(*prefix2, std::string_view(frame2).substr(uzel::frame::PrefixSize, prefix2->routeLen)).priority,
+            +uzel::Priority::low);
+  EXPECT_EQ(std::string_view(frame2).substr(uzel::frame::PrefixSize + prefix2->routeLen), fwdBody);
+}
+
+TEST(uzel, forwardToJson) {
+  uzel::MsgHeader::ptree pt;
+  pt.put("from.n", "liver");
+  pt.put("from.a", "usender");
+  pt.put("to.n", "pingutv");
+  pt.put("to.a", "uecho");
+  pt.put("cname", "ping");
+    // pretty printed json is fine in a binary frame, small and gathered
+  for(const std::size_t pad : {std::size_t{0}, uzel::Msg::GatherBodySize}) {
+    const std::string body = "{\n  \"serial\": \"1\",\r\n  \"pad\": \"" + std::string(pad, 'p') + "\"\n}";
+    auto header = uzel::MsgHeader::fromPtree(uzel::MsgHeader::ptree(pt));
+    std::vector<char> frame;
+    uzel::frame::encode(header, body, frame);
+    uzel::Msg msg(std::move(header), uzel::ByteSlice(std::vector<char>(body.begin(), body.end())), {});
+    msg.setWire(uzel::ByteSlice(std::vector<char>(frame)), uzel::Framing::binary);
+
+    std::string line;
+    for(auto &&part : msg.encoded(uzel::Framing::json)) line += part.view();
+      // header line and compact body line
+    ASSERT_EQ(std::count(line.begin(), line.end(), '\n'), 2);
+    EXPECT_EQ(line.find('\r'), std::string::npos);
+    const auto bodyLine = line.substr(line.find('\n') + 1);
+    EXPECT_EQ(uzel::JDoc::parse(bodyLine)->root().find("serial")->asString(), "1");
+    EXPECT_EQ(msg.str(), line);
+      // the binary frame is still forwarded as received
+    EXPECT_EQ(msg.encoded(uzel::Framing::binary).front().view(), std::string_view(frame.data(), frame.size()));
+  }
+}
+
+TEST(uzel, streamBody) {
+  TestSession test;
+  auto dispatcher = test.netctx->dispatcher();
+  std::vector<std::string> events;
+  std::string streamed;
+  auto recordStream = [&]() {
+    return uzel::MsgDispatcher::StreamHandler{
+      [&](const uzel::Msg &msg, std::size_t size) { events.push_back("begin " + msg.cname() + " " + std::to_string(size)); },
+      [&](const uzel::Msg & /*msg*/, const uzel::ByteSlice &chunk) { events.emplace_back("chunk"); streamed += chunk.view(); },
+      [&](const uzel::Msg & /*msg*/, bool complete) { events.emplace_back(complete ? "end" : "incomplete"); }};
+  };
+  std::vector<std::string> whole;
+  auto recordWhole = [&](const uzel::Msg &msg) { whole.push_back(msg.cname() + " " + std::to_string(msg.rawBody()->size())); };
+  auto bulk = dispatcher->registerStreamHandler("bulk", recordStream());
+  auto bulkWhole = dispatcher->registerHandlerScoped("bulk", recordWhole);
+  auto plainWhole = dispatcher->registerHandlerScoped("plain", recordWhole);
+  EXPECT_TRUE(dispatcher->wantsStream(uzel::Atom("bulk")));
+  EXPECT_FALSE(dispatcher->wantsStream(uzel::Atom("plain")));
+
+  const auto size = uzel::InputProcessor::StreamBodySize;
+  std::string body(size, 'b');
+  body.front() = '[';
+  body.back() = ']';
+  const auto big = test.frame("bulk", body);
+  const auto head = big.size() - size;
+
+  {
+      // begin, chunks in order as they arrive, end; the small message after it is dispatched whole
+    uzel::InputProcessor proc;
+    test.authenticate(proc);
+    EXPECT_EQ(feed(proc, big, 0, head + 1000, *test.ss), std::make_optional(head + 1000));
+    EXPECT_TRUE(proc.streaming());
+    EXPECT_EQ(feed(proc, big, head + 1000, head + 100000, *test.ss), std::make_optional(std::size_t{99000}));
+    auto rest = big;
+    const auto small = test.frame("bulk", "{}");
+    rest.insert(rest.end(), small.begin(), small.end());
+    EXPECT_EQ(feed(proc, rest, head + 100000, rest.size(), *test.ss), std::make_optional(rest.size() - head - 100000));
+    EXPECT_FALSE(proc.streaming());
+    test.handle();
+    EXPECT_EQ(events, (std::vector<std::string>{"begin bulk " + std::to_string(size), "chunk", "chunk", "chunk", "end"}));
+    EXPECT_EQ(streamed, body);
+    EXPECT_EQ(whole, std::vector<std::string>{"bulk 2"});
+  }
+  events.clear();
+  whole.clear();
+  {
+      // nobody wants the stream: the frame is buffered and dispatched whole,
+      // also if a stream handler comes while it is being received
+    const auto plain = test.frame("plain", body);
+    uzel::InputProcessor proc;
+    test.authenticate(proc);
+    EXPECT_EQ(feed(proc, plain, 0, head + 1000, *test.ss), std::make_optional(std::size_t{0}));
+    EXPECT_FALSE(proc.streaming());
+    EXPECT_EQ(proc.wanted(), plain.size());
+    auto late = dispatcher->registerStreamHandler("plain", recordStream());
+    EXPECT_EQ(feed(proc, plain, 0, head + 2000, *test.ss), std::make_optional(std::size_t{0}));
+    EXPECT_FALSE(proc.streaming());
+    EXPECT_EQ(feed(proc, plain, 0, plain.size(), *test.ss), std::make_optional(plain.size()));
+    test.handle();
+    EXPECT_TRUE(events.empty());
+    EXPECT_EQ(whole, std::vector<std::string>{"plain " + std::to_string(size)});
+    late.disconnect();
+  }
+  events.clear();
+  whole.clear();
+  streamed.clear();
+  {
+      // the connection is lost in the middle of the body
+    uzel::InputProcessor proc;
+    test.authenticate(proc);
+    EXPECT_EQ(feed(proc, big, 0, head + 1000, *test.ss), std::make_optional(head + 1000));
+    proc.abortStream();
+    EXPECT_FALSE(proc.streaming());
+    test.handle();
+    EXPECT_EQ(events, (std::vector<std::string>{"begin bulk " + std::to_string(size), "chunk", "incomplete"}));
+    EXPECT_EQ(streamed.size(), 1000U);
+  }
+  events.clear();
+  {
+      // disconnected stream handler is removed, the body is not streamed any more
+    bulk.disconnect();
+    test.handle();
+    EXPECT_FALSE(dispatcher->wantsStream(uzel::Atom("bulk")));
+    EXPECT_FALSE(dispatcher->wantsStream(uzel::Atom("plain")));
+    uzel::InputProcessor proc;
+    test.authenticate(proc);
+    EXPECT_EQ(feed(proc, big, 0, head + 1000, *test.ss), std::make_optional(std::size_t{0}));
+    EXPECT_FALSE(proc.streaming());
+    EXPECT_EQ(feed(proc, big, 0, big.size(), *test.ss), std::make_optional(big.size()));
+    test.handle();
+    EXPECT_TRUE(events.empty());
+    EXPECT_EQ(whole, std::vector<std::string>{"bulk " + std::to_string(size)});
+  }
+}
+
+TEST(uzel, linescan) {
+  std::string data;
+  for(int ii = 0; ii < 300; ++ii) {
+    data += std::string(static_cast<size_t>(ii % 70), 'x');
+    data += '\n';
+  }
+  data += "tail";
+  std::vector<size_t> simd;
+  std::vector<size_t> scalar;
+  uzel::linescan::findAll(data, 5, simd);
+  uzel::linescan::findAllScalar(data, 5, scalar);
+  EXPECT_EQ(simd, scalar);
+  EXPECT_EQ(simd.size(), 300U);
+
+  AccuLine acc;
+  acc.addNewInput(std::string_view(data).substr(0, 100));
+  size_t lines{0};
+  while(acc.getNextCmd()) ++lines;
+    // next input starts with the not processed rest of the previous one
+  acc.addNewInput(std::string_view(data).substr(100 - acc.rest().size()));
+  std::optional<std::string_view> line;
+  while((line = acc.getNextCmd())) {
+    EXPECT_EQ(line->size(), lines % 70);
+    ++lines;
+  }
+  EXPECT_EQ(lines, 300U);
+  EXPECT_FALSE(acc.idle());
+  EXPECT_EQ(acc.rest(), "tail");
+}
+
+TEST(uzel, headerscan) {
+  const std::string line = R"({"from":{"n":"liver","a":"usender","x":"1"},"to":{"a":"uecho","n":"pingutv"},)"
+    R"("cname":"pi\u006eg","prio":"10","dl":"1700000000000","hops":["n1",2],"extra":{"y":[1,2]},"body":{"s":"a}\"]"}})";
+  auto rez = uzel::headerscan::scan(line);
+  const auto &hdr = rez.header;
+  EXPECT_EQ(hdr.from.node(), "liver");
+  EXPECT_EQ(hdr.from.app(), "usender");
+  EXPECT_EQ(hdr.to.node(), "pingutv");
+  EXPECT_EQ(hdr.to.app(), "uecho");
+  EXPECT_EQ(hdr.cname.str(), "ping");
+  EXPECT_EQ(hdr.priority, +uzel::Priority::high);
+  EXPECT_EQ(hdr.deadline, 1700000000000);
+  ASSERT_EQ(hdr.hops.size(), 2U);
+  EXPECT_EQ(hdr.hops[1].str(), "2");
+  EXPECT_EQ(hdr.ext.get<std::string>("from.x"), "1");
+  EXPECT_EQ(hdr.ext.get_child("extra.y").size(), 2U);
+  ASSERT_TRUE(rez.body);
+  EXPECT_EQ(line.substr(rez.body->first, rez.body->second), R"({"s":"a}\"]"})");
+  EXPECT_THROW((void)uzel::headerscan::scan(R"({"from":{"n":"x"})"), std::runtime_error);
+}
+
+TEST(uzel, bodyLookup) {
+  const std::string body = R"({"data":{"s":"x,}\"","a":[1,{"b":2}]},"serial":17,"n":{"serial":"5"}})";
+  EXPECT_EQ(uzel::BodyView::lookup(body, "serial"), "17");
+  EXPECT_EQ(uzel::BodyView::lookup(body, "n.serial"), "5");
+  EXPECT_EQ(uzel::BodyView::lookup(body, "data.s"), "x,}\"");
+  EXPECT_EQ(uzel::BodyView::lookup(body, "data.a"), "");
+  EXPECT_FALSE(uzel::BodyView::lookup(body, "data.x"));
+  EXPECT_FALSE(uzel::BodyView::lookup(body, "serial.x"));
+    // scanning stops at the value, the rest is not looked at
+  EXPECT_EQ(uzel::BodyView::lookup(R"({"serial":1,)", "serial"), "1");
+}
+
+TEST(uzel, jvalue) {
+  const std::string json = R"({"serial":17,"r":-1.5,"ok":true,"n":null,"s":"a\"b\u00e9","arr":[1,"x",{}],"o":{"k":"v"}})";
+  auto doc = uzel::JDoc::parse(json);
+  const auto &root = doc->root();
+  EXPECT_EQ(root.find("serial")->asInt(), 17);
+  EXPECT_DOUBLE_EQ(root.find("r")->asDouble(), -1.5);
+  EXPECT_TRUE(root.find("ok")->asBool());
+  EXPECT_TRUE(root.find("n")->isNull());
+  EXPECT_EQ(root.find("s")->asString(), "a\"b\u00e9");
+  EXPECT_EQ(root.find("arr")->array().size(), 3U);
+  EXPECT_EQ(root.findPath("o.k")->asString(), "v");
+  EXPECT_EQ(root.findPath("o.x"), nullptr);
+  EXPECT_EQ(uzel::JDoc::parse(root.str())->root().str(), root.str());
+  EXPECT_THROW((void)root.find("s")->asInt(), std::runtime_error);
+
+  auto pt = root.toPtree();
+  EXPECT_EQ(pt.get<unsigned>("serial"), 17U);
+  EXPECT_EQ(pt.get<std::string>("o.k"), "v");
+  auto back = uzel::JDoc::fromPtree(pt);
+  EXPECT_EQ(back->root().findPath("o.k")->asString(), "v");
+  EXPECT_EQ(back->root().find("arr")->array().size(), 3U);
+
+  EXPECT_THROW((void)uzel::JDoc::parse(R"({"a":1)"), std::runtime_error);
+  EXPECT_THROW((void)uzel::JDoc::parse(R"({"a":tru})"), std::runtime_error);
+}
+
+TEST(uzel, jsonwriter) {
+  uzel::MsgHeader::ptree pt;
+  pt.put("from.n", "liver");
+  pt.put("from.a", "usender");
+  pt.put("from.x", "1");
+  pt.put("cname", "ping");
+  pt.put("prio", "10");
+  pt.put("dl", "1700000000000");
+  pt.put("extra.s", "q\"t\\n\n\x01");
+  pt.add_child("extra.arr", uzel::MsgHeader::ptree()).push_back({"", uzel::MsgHeader::ptree("e")});
+
+  auto expected = [](const uzel::MsgHeader::ptree &tree) {
+    std::ostringstream oss;
+    boost::property_tree::write_json(oss, tree, false);
+    auto str = oss.str();
+    str.pop_back(); // new line
+    return str;
+  };
+  std::string out;
+  uzel::jsonwriter::writePtree(out, pt);
+  EXPECT_EQ(out, expected(pt));
+
+  auto header = uzel::MsgHeader::fromPtree(uzel::MsgHeader::ptree(pt));
+  std::vector<char> hout;
+  EXPECT_TRUE(uzel::jsonwriter::writeHeader(hout, header));
+  EXPECT_EQ(std::string(hout.begin(), hout.end()), expected(header.toPtree()));
+
+    // received json lines are forwarded as they are, serialized once after a change
+  const std::string line = std::string(hout.begin(), hout.end()) + "\n{\"serial\":\"1\"}\n";
+  const uzel::ByteSlice wire(std::vector<char>(line.begin(), line.end()));
+  uzel::Msg msg(std::move(header), wire.sub(hout.size() + 1, line.size() - hout.size() - 2), {});
+  msg.setWire(wire, uzel::Framing::json);
+  EXPECT_EQ(msg.encoded(uzel::Framing::json).front().data(), wire.data());
+  EXPECT_EQ(msg.encoded(uzel::Framing::json).front().view(), line);
+  msg.setCname("pong");
+  const auto *serialized = msg.encoded(uzel::Framing::json).front().data();
+  EXPECT_NE(serialized, wire.data());
+  EXPECT_EQ(msg.encoded(uzel::Framing::json).front().data(), serialized);
+  std::string resent;
+  for(auto &&part : msg.encoded(uzel::Framing::json)) resent += part.view();
+  EXPECT_NE(resent.find(R"("cname":"pong")"), std::string::npos);
+  EXPECT_NE(resent.find(R"({"serial":"1"})"), std::string::npos);
+}
+
+TEST(uzel, compress) {
+  std::string body;
+  for(int ii = 0; ii < 100; ++ii) {
+    body += R"({"serial":")" + std::to_string(ii) + R"(","payload":"the same text again"})";
+  }
+  auto packed = uzel::compress::deflate(uzel::Compression::zlib, body);
+  EXPECT_LT(packed.size(), body.size() / 4);
+  auto raw = uzel::compress::inflate(uzel::Compression::zlib, {packed.data(), packed.size()});
+  EXPECT_EQ(std::string(raw.begin(), raw.end()), body);
+  EXPECT_THROW((void)uzel::compress::inflate(uzel::Compression::zlib, {packed.data(), packed.size()}, body.size() - 1), std::runtime_error);
+  EXPECT_THROW((void)uzel::compress::inflate(uzel::Compression::zlib, "not compressed"), std::runtime_error);
+
+  uzel::MsgHeader header;
+  header.cname = uzel::Atom("ping");
+  header.flags = uzel::Compression::zlib;
+  std::vector<char> out;
+  uzel::frame::encode(header, {packed.data(), packed.size()}, out);
+  auto prefix = uzel::frame::parsePrefix({out.data(), out.size()});
+  ASSERT_TRUE(prefix);
+  EXPECT_EQ(uzel::frame::compression(prefix->flags), +uzel::Compression::zlib);
+  out[2] = 3; // unknown codec
+  EXPECT_THROW((void)uzel::frame::parsePrefix({out.data(), out.size()}), std::runtime_error);
+}
+
+struct Point
+{
+  std::int32_t x{0};
+  double y{0};
+
+  template<typename Self, typename Visitor>
+  static void fields(Self &self, Visitor &&visit)
+  {
+    visit("x", self.x);
+    visit("y", self.y);
+  }
+};
+
+struct Track
+{
+  static constexpr std::string_view cname{"track"};
+  std::uint64_t serial{0};
+  bool closed{false};
+  std::string name;
+  std::optional<std::string> note;
+  std::vector<Point> points;
+
+  template<typename Self, typename Visitor>
+  static void fields(Self &self, Visitor &&visit)
+  {
+    visit("serial", self.serial);
+    visit("closed", self.closed);
+    visit("name", self.name);
+    visit("note", self.note);
+    visit("points", self.points);
+  }
+};
+
+TEST(uzel, typedBody) {
+  static_assert(uzel::typed::Body<Track>);
+  static_assert(!uzel::typed::Body<Point>);
+  Track track{42, true, "a \"b\"", {}, {{1, 0.5}, {-2, 3}}};
+  std::string json;
+  uzel::typed::encode(json, track);
+  EXPECT_EQ(json, R"({"serial":42,"closed":true,"name":"a \"b\"","points":[{"x":1,"y":0.5},{"x":-2,"y":3}]})");
+
+  auto decoded = uzel::typed::decode<Track>(json);
+  EXPECT_EQ(decoded.serial, 42U);
+  EXPECT_TRUE(decoded.closed);
+  EXPECT_EQ(decoded.name, track.name);
+  EXPECT_FALSE(decoded.note);
+  ASSERT_EQ(decoded.points.size(), 2U);
+  EXPECT_EQ(decoded.points[1].x, -2);
+  EXPECT_EQ(decoded.points[0].y, 0.5);
+
+    // as written from ptree: numbers are strings, unknown fields are skipped
+  decoded = uzel::typed::decode<Track>(R"({"extra":{"a":[1,2]},"serial":"7","note":"n","closed":"false"})");
+  EXPECT_EQ(decoded.serial, 7U);
+  EXPECT_FALSE(decoded.closed);
+  EXPECT_EQ(decoded.note.value_or(""), "n");
+  EXPECT_TRUE(decoded.points.empty());
+
+    // json has no nan or infinity
+  track.points = {{1, std::numeric_limits<double>::infinity()}, {2, std::numeric_limits<double>::quiet_NaN()}};
+  json.clear();
+  uzel::typed::encode(json, track);
+  EXPECT_NE(json.find(R"("points":[{"x":1,"y":null},{"x":2,"y":null}])"), std::string::npos);
+  EXPECT_NO_THROW((void)uzel::JDoc::parse(json));
+  decoded = uzel::typed::decode<Track>(json);
+  ASSERT_EQ(decoded.points.size(), 2U);
+  EXPECT_TRUE(std::isnan(decoded.points[0].y));
+
+  EXPECT_THROW((void)uzel::typed::decode<Track>(R"({"serial":"x"})"), std::runtime_error);
+  EXPECT_THROW((void)uzel::typed::decode<Track>(R"({"serial":1} 2)"), std::runtime_error);
+}
+
+TEST(uzel, binaryBody) {
+  auto doc = uzel::JDoc::parse(R"({"id":"s1","neg":-200,"big":5000000000,"ok":true,"nil":null,"samples":[0.5,1.1,-3,1e300]})");
+  for(auto ct : {uzel::ContentType::msgpack, uzel::ContentType::cbor}) {
+    std::vector<char> out;
+    uzel::binbody::write(ct, doc->root(), out);
+    EXPECT_LT(out.size(), doc->root().str().size());
+    auto parsed = uzel::binbody::parse(ct, {out.data(), out.size()});
+    EXPECT_EQ(parsed->root().str(), doc->root().str());
+    EXPECT_THROW((void)uzel::binbody::parse(ct, {out.data(), out.size() - 1}), std::runtime_error);
+  }
+
+    // samples from the specifications
+  using namespace std::string_literals;
+  EXPECT_EQ(uzel::binbody::parse(uzel::ContentType::msgpack, "\x82\xa7" "compact\xc3\xa6" "schema\x00"s)->root().str(), R"({"compact":true,"schema":0})");
+  EXPECT_EQ(uzel::binbody::parse(uzel::ContentType::cbor, "\xbf\x61\x61\x01\x61\x62\x9f\x02\x03\xff\xff"s)->root().str(), R"({"a":1,"b":[2,3]})");
+  EXPECT_EQ(uzel::binbody::parse(uzel::ContentType::cbor, "\xf9\x3e\x00"s)->root().asDouble(), 1.5);
+  EXPECT_EQ(uzel::binbody::parse(uzel::ContentType::cbor, "\xc1\x1a\x51\x4b\x67\xb0"s)->root().asInt(), 1363896240);
+
+  EXPECT_EQ(uzel::frame::contentType(uzel::frame::withContentType(uzel::Compression::zlib, uzel::ContentType::cbor)), +uzel::ContentType::cbor);
+}
+
+TEST(uzel, attachment) {
+  auto size = uzel::frame::encodeAttachedSize(0x123456789AULL);
+  ASSERT_EQ(size.size(), uzel::frame::AttachedSizeLen);
+  EXPECT_EQ(uzel::frame::attachedSize({size.data(), size.size()}), 0x123456789AULL);
+
+  const auto dir = testing::TempDir() + "uzel-spool-test";
+  std::string spooled;
+  {
+      // the sender can not choose the directory
+    auto file = uzel::Attachment::spool(dir, "../../etc/passwd", 3);
+    EXPECT_EQ(file->name(), "passwd");
+    EXPECT_EQ(file->path().rfind(dir, 0), 0U);
+    EXPECT_EQ(::write(file->fd(), "abc", 3), 3);
+    spooled = file->path();
+    auto sent = uzel::Attachment::open(spooled);
+    EXPECT_EQ(sent->size(), 3U);
+  }
+  EXPECT_THROW((void)uzel::Attachment::open(spooled), std::runtime_error);
+  {
+    auto file = uzel::Attachment::spool(dir, "kept", 0);
+    file->moveTo(dir + "/kept");
+  }
+  EXPECT_EQ(uzel::Attachment::open(dir + "/kept")->size(), 0U);
+  ::unlink((dir + "/kept").c_str());
+
+    // the size announced by the peer is checked before the file is spooled
+  TestSession test;
+  auto attached = [&](std::uint64_t fileSize) {
+    uzel::MsgHeader header;
+    header.from = uzel::Addr("userver", test.node);
+    header.to = uzel::Addr(uzel::UConfig::appName(), test.node);
+    header.cname = uzel::Atom::intern("file");
+    header.flags = uzel::frame::Attached;
+    header.ext.put("file", "f");
+    std::vector<char> out;
+    uzel::frame::encode(header, "{}", out);
+    const auto len = uzel::frame::encodeAttachedSize(fileSize);
+    out.insert(out.end(), len.begin(), len.end());
+    return out;
+  };
+  {
+    uzel::InputProcessor proc(1024, 1024);
+    test.authenticate(proc);
+    auto input = attached(3);
+    input.insert(input.end(), {'a', 'b', 'c'});
+    EXPECT_EQ(proc.processNewInput(uzel::ByteSlice(std::vector<char>(input)), *test.ss), std::make_optional(input.size()));
+    EXPECT_EQ(proc.attachmentRemaining(), 0U);
+  }
+  {
+    uzel::InputProcessor proc(1024, 1024);
+    test.authenticate(proc);
+    EXPECT_FALSE(proc.processNewInput(uzel::ByteSlice(attached(1025)), *test.ss));
+    EXPECT_EQ(proc.attachmentRemaining(), 0U);
+  }
+  {
+      // no limit, but no room in the spool directory either
+    uzel::InputProcessor proc;
+    test.authenticate(proc);
+    EXPECT_FALSE(proc.processNewInput(uzel::ByteSlice(attached(1ULL << 62U)), *test.ss));
+    EXPECT_EQ(proc.attachmentRemaining(), 0U);
+  }
+}
+
+TEST(uzel, recvQuota) {
+  auto total = std::make_shared<uzel::RecvQuota>(1000);
+  auto quota = std::make_shared<uzel::RecvQuota>(100, total);
+  quota->acquire(100);
+  EXPECT_TRUE(quota->exceeded());
+  EXPECT_EQ(total->used(), 100U);
+  int resumed{0};
+  quota->whenDrained([&resumed]() { ++resumed; });
+  quota->release(20);
+  EXPECT_EQ(resumed, 0);
+  quota->release(10); // 75% of the limit
+  EXPECT_EQ(resumed, 1);
+  quota->whenDrained([&resumed]() { ++resumed; });
+  EXPECT_EQ(resumed, 2);
+  quota->release(70);
+  EXPECT_EQ(total->used(), 0U);
+
+    // received slices keep the segment charged
+  uzel::ByteSlice held;
+  {
+    uzel::RecvBuffer recv(64);
+    recv.setQuota(quota);
+    auto buf = recv.prepare();
+    std::memset(buf.data(), 'x', 10);
+    recv.commit(10);
+    held = recv.data().sub(0, 4);
+    recv.consume(10);
+    EXPECT_EQ(quota->used(), 64U);
+      // grown segment is let go when consumed
+    (void)recv.prepare(200);
+    recv.commit(200);
+    recv.consume(200);
+    EXPECT_EQ(quota->used(), 64U);
+  }
+  EXPECT_EQ(total->used(), 64U);
+  held = uzel::ByteSlice();
+  EXPECT_EQ(total->used(), 0U);
+}
+
+TEST(uzel, bufferPool) {
+  EXPECT_EQ(uzel::BufferPool::classSize(1), uzel::BufferPool::MinClass);
+  EXPECT_EQ(uzel::BufferPool::classSize(5000), 8192U);
+
+  auto pool = std::make_shared<uzel::BufferPool>(16*1024);
+  {
+    uzel::RecvBuffer recv(64*1024, 4*1024);
+    recv.setPool(pool);
+    auto buf = recv.prepare();
+    EXPECT_EQ(buf.size(), 4096U);
+      // full reads grow the segment
+    recv.commit(buf.size());
+    recv.consume(buf.size());
+    EXPECT_EQ(recv.prepare().size(), 8192U);
+    recv.commit(10);
+    recv.consume(10);
+    recv.release();
+    EXPECT_EQ(recv.segmentSize(), 4096U);
+    EXPECT_EQ(pool->cached(), 8192U + 4096U);
+    EXPECT_EQ(recv.prepare().size(), 4096U);
+    EXPECT_EQ(pool->cached(), 8192U);
+  }
+  EXPECT_EQ(pool->cached(), 8192U + 4096U);
+    // over the limit
+  pool->give(std::make_unique<std::vector<char>>(8192));
+  EXPECT_EQ(pool->cached(), 8192U + 4096U);
+}
+
+TEST(uzel, msgQueue) {
+  auto qmsg = [](std::size_t size, uzel::Priority prio = uzel::Priority::undefined) {
+    return uzel::QueuedMsg({uzel::ByteSlice(std::vector<char>(size, 'x'))}, uzel::Msg::DestType::remote, prio);
+  };
+  uzel::QueueLimits limits{.maxBytes = 1000, .maxMessages = 10, .highPercent = 80, .lowPercent = 50, .policy = uzel::OverflowPolicy::dropOldest};
+  uzel::MsgQueue oldest(limits);
+  int highs{0};
+  int lows{0};
+  oldest.s_highWatermark.connect([&]() { ++highs; });
+  oldest.s_lowWatermark.connect([&]() { ++lows; });
+  for(int i = 0; i < 4; ++i) EXPECT_TRUE(oldest.push(qmsg(200)));
+  EXPECT_EQ(highs, 1);
+    // the first message is being written, the second one makes room
+  oldest.setBusy(1);
+  EXPECT_TRUE(oldest.push(qmsg(300)));
+  EXPECT_EQ(oldest.size(), 4U);
+  EXPECT_EQ(oldest.bytes(), 900U);
+  EXPECT_EQ(oldest.dropped(), 1U);
+  oldest.erase_front(3);
+  EXPECT_EQ(lows, 1);
+  EXPECT_FALSE(oldest.high());
+
+  limits.policy = uzel::OverflowPolicy::dropNewest;
+  uzel::MsgQueue newest(limits);
+  EXPECT_TRUE(newest.push(qmsg(900)));
+  EXPECT_FALSE(newest.push(qmsg(200)));
+  EXPECT_EQ(newest.size(), 1U);
+
+  limits.policy = uzel::OverflowPolicy::dropLowPriority;
+  uzel::MsgQueue prio(limits);
+  EXPECT_TRUE(prio.push(qmsg(400, uzel::Priority::high)));
+  EXPECT_TRUE(prio.push(qmsg(400, uzel::Priority::low)));
+  EXPECT_TRUE(prio.push(qmsg(400, uzel::Priority::high)));
+  EXPECT_EQ(prio.at(1).priority(), +uzel::Priority::high);
+  EXPECT_FALSE(prio.push(qmsg(400, uzel::Priority::low)));
+  EXPECT_EQ(prio.dropped(), 2U);
+
+  limits.policy = uzel::OverflowPolicy::block;
+  uzel::MsgQueue block(limits);
+  EXPECT_TRUE(block.push(qmsg(900)));
+  EXPECT_TRUE(block.push(qmsg(900)));
+  EXPECT_TRUE(block.full());
+  block.pop_front();
+  EXPECT_FALSE(block.full());
+
+    // takeover leaves the messages being written to the writer
+  limits.policy = uzel::OverflowPolicy::dropOldest;
+  uzel::MsgQueue busy(limits);
+  for(std::size_t size = 10; size <= 40; size += 10) EXPECT_TRUE(busy.push(qmsg(size)));
+  busy.setBusy(2);
+  auto taken = busy.take_all();
+  ASSERT_EQ(taken.size(), 2U);
+  EXPECT_EQ(taken.front().bytes(), 30U);
+  EXPECT_EQ(busy.size(), 2U);
+  EXPECT_EQ(busy.bytes(), 30U);
+  EXPECT_EQ(busy.at(1).bytes(), 20U);
+  EXPECT_TRUE(busy.take_all().empty());
+  busy.erase_front(2);
+  EXPECT_TRUE(busy.empty());
+}
+
+TEST(uzel, timerWheel) {
+  using namespace std::chrono_literals;
+  boost::asio::io_context ioc;
+  auto wheel = std::make_shared<uzel::TimerWheel>(ioc.get_executor(), 10ms);
+  const auto start = uzel::TimerWheel::clock::now();
+  std::vector<int> fired;
+  auto near = wheel->schedule(start + 50ms, [&]() { fired.push_back(1); });
+    // several levels away, cascaded down
+  std::ignore = wheel->schedule(start + 1min, [&]() { fired.push_back(2); });
+  auto cancelled = wheel->schedule(start + 30s, [&]() { fired.push_back(3); });
+  EXPECT_EQ(wheel->size(), 3U);
+  wheel->cancel(cancelled);
+  EXPECT_FALSE(cancelled);
+  wheel->advance(start + 40ms);
+  EXPECT_TRUE(fired.empty());
+  wheel->advance(start + 70ms);
+  EXPECT_EQ(fired, std::vector<int>{1});
+    // stale handle of the fired timer
+  wheel->cancel(near);
+  wheel->advance(start + 59s);
+  EXPECT_EQ(fired.size(), 1U);
+  wheel->advance(start + 61s);
+  EXPECT_EQ(fired, (std::vector<int>{1, 2}));
+  EXPECT_EQ(wheel->size(), 0U);
+
+    // beyond the 2^24 ticks the wheel covers: fires at its time, not at the horizon
+  wheel = std::make_shared<uzel::TimerWheel>(ioc.get_executor(), 1s);
+  std::ignore = wheel->schedule(start + std::chrono::hours(24 * 400), [&]() { fired.push_back(4); });
+  wheel->advance(start + std::chrono::hours(24 * 200));
+  EXPECT_EQ(fired.size(), 2U);
+  EXPECT_EQ(wheel->size(), 1U);
+  wheel->advance(start + std::chrono::hours(24 * 400) - 1min);
+  EXPECT_EQ(fired.size(), 2U);
+  wheel->advance(start + std::chrono::hours(24 * 400) + 1s);
+  EXPECT_EQ(fired, (std::vector<int>{1, 2, 4}));
+  EXPECT_EQ(wheel->size(), 0U);
+
+    // queued messages expire without writing, busy ones stay
+  uzel::QueueLimits limits;
+  limits.ttl = 1s;
+  wheel = std::make_shared<uzel::TimerWheel>(ioc.get_executor(), 10ms);
+  uzel::MsgQueue queue(limits, std::make_shared<uzel::StrandTimers>(wheel, ioc.get_executor()));
+  std::size_t expired{0};
+  queue.s_expired.connect([&](const uzel::Addr &) { ++expired; });
+  for(int i = 0; i < 3; ++i) {
+    queue.push(uzel::QueuedMsg({uzel::ByteSlice(std::vector<char>(10, 'x'))}, uzel::Msg::DestType::remote, uzel::Priority::undefined));
+  }
+  queue.setBusy(1);
+  wheel->advance(uzel::TimerWheel::clock::now() + 2s);
+  EXPECT_EQ(expired, 2U);
+  EXPECT_EQ(queue.size(), 1U);
+  EXPECT_EQ(queue.bytes(), 10U);
+  queue.erase_front(1);
+  EXPECT_EQ(wheel->size(), 0U);
+
+    // with several threads the queues share one wheel on its own strand
+  wheel = std::make_shared<uzel::TimerWheel>(boost::asio::make_strand(ioc), 10ms);
+  uzel::MsgQueue shared(limits, std::make_shared<uzel::StrandTimers>(wheel, boost::asio::make_strand(ioc)));
+  std::size_t sharedExpired{0};
+  shared.s_expired.connect([&](const uzel::Addr &) { ++sharedExpired; });
+  for(int i = 0; i < 2; ++i) {
+    shared.push(uzel::QueuedMsg({uzel::ByteSlice(std::vector<char>(10, 'x'))}, uzel::Msg::DestType::remote, uzel::Priority::undefined));
+  }
+  EXPECT_EQ(wheel->size(), 0U);
+  ioc.poll();
+  EXPECT_EQ(wheel->size(), 2U);
+  shared.erase_front(1);
+  ioc.poll();
+  EXPECT_EQ(wheel->size(), 1U);
+  wheel->advance(uzel::TimerWheel::clock::now() + 2s);
+  EXPECT_EQ(wheel->size(), 0U);
+    // the queue expires it on its own strand
+  EXPECT_EQ(sharedExpired, 0U);
+  ioc.poll();
+  EXPECT_EQ(sharedExpired, 1U);
+  EXPECT_TRUE(shared.empty());
+}
+
+TEST(uzel, msgDeadline) {
+  using namespace std::chrono_literals;
+  auto qmsg = [](char tag, uzel::Priority prio, std::optional<std::chrono::steady_clock::duration> left = {}) {
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    if(left) deadline = std::chrono::steady_clock::now() + *left;
+    return uzel::QueuedMsg({uzel::ByteSlice(std::vector<char>(1, tag))}, uzel::Msg::DestType::remote, prio, {}, deadline);
+  };
+  auto order = [](const uzel::MsgQueue &queue) {
+    std::string tags;
+    for(auto &&msg : queue) tags += msg.wire().front().view();
+    return tags;
+  };
+  uzel::QueueLimits limits;
+  limits.ttl = 60s;
+  uzel::MsgQueue queue(limits);
+  std::size_t expired{0};
+  queue.s_expired.connect([&](const uzel::Addr &) { ++expired; });
+  EXPECT_TRUE(queue.push(qmsg('a', uzel::Priority::high)));
+  EXPECT_TRUE(queue.push(qmsg('b', uzel::Priority::low, 10s)));
+  EXPECT_TRUE(queue.push(qmsg('c', uzel::Priority::low)));
+  EXPECT_TRUE(queue.push(qmsg('d', uzel::Priority::low, 5s)));
+    // earliest deadline first, but only among the same priority
+  EXPECT_EQ(order(queue), "adbc");
+  queue.setBusy(2);
+  EXPECT_TRUE(queue.push(qmsg('e', uzel::Priority::low, 1s)));
+  EXPECT_EQ(order(queue), "adebc");
+    // stale messages are not queued
+  EXPECT_FALSE(queue.push(qmsg('f', uzel::Priority::low, -1s)));
+  EXPECT_EQ(expired, 1U);
+  EXPECT_EQ(queue.dropped(), 0U);
+
+  queue.erase_front(2);
+  EXPECT_TRUE(queue.push(qmsg('g', uzel::Priority::low, 1ms)));
+  std::this_thread::sleep_for(5ms);
+  queue.dropExpired();
+  EXPECT_EQ(order(queue), "ebc");
+  EXPECT_EQ(queue.expired(), 2U);
+
+    // a short deadline overtakes its priority past the other priorities in between
+  uzel::MsgQueue mixed(limits);
+  EXPECT_TRUE(mixed.push(qmsg('h', uzel::Priority::high, 10s)));
+  EXPECT_TRUE(mixed.push(qmsg('i', uzel::Priority::low)));
+  EXPECT_TRUE(mixed.push(qmsg('j', uzel::Priority::high, 1s)));
+  EXPECT_EQ(order(mixed), "jhi");
+  EXPECT_TRUE(mixed.push(qmsg('k', uzel::Priority::high, 5s)));
+  EXPECT_EQ(order(mixed), "jkhi");
+  EXPECT_TRUE(mixed.push(qmsg('l', uzel::Priority::low, 1ms)));
+  EXPECT_EQ(order(mixed), "jkhli");
+    // expired behind unexpired ones: removed when within the window to write
+  std::this_thread::sleep_for(5ms);
+  mixed.dropExpired(3);
+  EXPECT_EQ(order(mixed), "jkhli");
+  mixed.dropExpired(4);
+  EXPECT_EQ(order(mixed), "jkhi");
+  EXPECT_EQ(mixed.expired(), 1U);
+}
+
+  /** session writing to a socket connected to peer */
+struct WriteSession
+{
+  boost::asio::io_context ioc;
+  uzel::NetAppContextPtr netctx{std::make_shared<uzel::NetAppContext>(ioc)};
+  boost::asio::ip::tcp::socket peer{ioc};
+  uzel::session::shr_t ss;
+  std::string node{uzel::UConfigS::getUConfig().nodeName()};
+
+  explicit WriteSession(const uzel::WriteBatch &batch)
+  {
+    boost::asio::ip::tcp::acceptor acceptor(ioc, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    peer.connect(acceptor.local_endpoint());
+    ss = std::make_shared<uzel::session>(netctx, acceptor.accept(), uzel::Direction::incoming, boost::asio::ip::address());
+    ss->setWriteBatch(batch);
+  }
+
+  [[nodiscard]] uzel::Msg::shr_t msg(int n) const
+  {
+    uzel::Msg::ptree body;
+    body.put("n", n);
+    return std::make_shared<uzel::Msg>(uzel::Addr("app", node), "batch", std::move(body));
+  }
+
+    /** run until the queue is written */
+  void flush()
+  {
+    ioc.restart();
+    while(!ss->outQueueEmpty() && ioc.run_one_for(std::chrono::seconds(1)) > 0) {}
+    ioc.poll();
+  }
+
+    /** everything the peer got so far */
+  [[nodiscard]] std::string received()
+  {
+    std::string data(peer.available(), '\0');
+    boost::asio::read(peer, boost::asio::buffer(data));
+    return data;
+  }
+};
+
+TEST(uzel, writeBatch) {
+  using namespace std::chrono_literals;
+    // json messages have a header and a body line
+  auto lines = [](const std::string &data) { return static_cast<std::size_t>(std::ranges::count(data, '\n')); };
+  {
+      // the first message goes right away, the ones queued meanwhile follow maxFrames at once
+    uzel::WriteBatch batch;
+    batch.maxFrames = 3;
+    WriteSession test(batch);
+    for(int i = 0; i < 7; ++i) test.ss->putOutQueue(test.msg(i));
+    test.flush();
+    EXPECT_TRUE(test.ss->outQueueEmpty());
+    EXPECT_EQ(test.ss->writes(), 3U);
+    EXPECT_EQ(lines(test.received()), 14U);
+  }
+  {
+      // at most maxBytes, but at least one message
+    uzel::WriteBatch batch;
+    WriteSession test(batch);
+    const auto bytes = uzel::QueuedMsg(test.msg(0)).bytes();
+    batch.maxBytes = bytes + bytes / 2;
+    test.ss->setWriteBatch(batch);
+    for(int i = 0; i < 7; ++i) test.ss->putOutQueue(test.msg(i));
+    test.flush();
+    EXPECT_EQ(test.ss->writes(), 4U);
+    EXPECT_EQ(lines(test.received()), 14U);
+  }
+  {
+      // nothing is added after an attached file, it is sent by itself
+    const auto path = testing::TempDir() + "uzel-batch-file";
+    {
+      auto file = uzel::Attachment::spool(testing::TempDir(), "uzel-batch-file", 3);
+      EXPECT_EQ(::write(file->fd(), "abc", 3), 3);
+      file->moveTo(path);
+    }
+    uzel::WriteBatch batch;
+    WriteSession test(batch);
+    auto attached = test.msg(2);
+    attached->attach(uzel::Attachment::open(path));
+    test.ss->putOutQueue(test.msg(0));
+    test.ss->putOutQueue(test.msg(1));
+    test.ss->putOutQueue(attached);
+    test.ss->putOutQueue(test.msg(3));
+    test.ss->putOutQueue(test.msg(4));
+    test.flush();
+    EXPECT_TRUE(test.ss->outQueueEmpty());
+    EXPECT_EQ(test.ss->writes(), 3U);
+    const auto data = test.received();
+    const auto file = data.find("abc");
+    ASSERT_NE(file, std::string::npos);
+      // the messages behind the file follow it
+    EXPECT_EQ(lines(data.substr(file)), 4U);
+    ::unlink(path.c_str());
+  }
+  {
+      // with a delay the first message waits for the others
+    uzel::WriteBatch batch;
+    batch.delay = 20ms;
+    WriteSession test(batch);
+    for(int i = 0; i < 5; ++i) test.ss->putOutQueue(test.msg(i));
+    test.ioc.poll();
+    EXPECT_EQ(test.ss->writes(), 0U);
+    test.flush();
+    EXPECT_EQ(test.ss->writes(), 1U);
+    EXPECT_EQ(lines(test.received()), 10U);
+  }
+  {
+      // a full batch does not wait for the delay
+    uzel::WriteBatch batch;
+    batch.maxFrames = 3;
+    batch.delay = 1h;
+    WriteSession test(batch);
+    for(int i = 0; i < 3; ++i) test.ss->putOutQueue(test.msg(i));
+    test.ioc.poll();
+    EXPECT_EQ(test.ss->writes(), 1U);
+    test.flush();
+    EXPECT_TRUE(test.ss->outQueueEmpty());
+    EXPECT_EQ(lines(test.received()), 6U);
+  }
+}
+
+
+TEST(uzel, atom)
+{
+    // names from peers are not interned, they keep their own copy
+  const uzel::Atom peer("atomtest-node");
+  EXPECT_FALSE(peer.interned());
+  EXPECT_FALSE(uzel::Atom("atomtest-node").interned());
+  EXPECT_EQ(peer.str(), "atomtest-node");
+
+  const auto known = uzel::Atom::intern("atomtest-node");
+  EXPECT_TRUE(known.interned());
+  EXPECT_TRUE(uzel::Atom("atomtest-node").interned());
+    // an own copy made before interning still equals and hashes the same
+  EXPECT_EQ(peer, known);
+  EXPECT_EQ(std::hash<uzel::Atom>()(peer), std::hash<uzel::Atom>()(known));
+  EXPECT_NE(peer, uzel::Atom("atomtest-other"));
+  EXPECT_NE(known, uzel::Atom::intern("atomtest-other"));
+
+  EXPECT_TRUE(uzel::Atom("").empty());
+  EXPECT_TRUE(uzel::Atom::intern("").interned());
+  EXPECT_EQ(uzel::Atom(""), uzel::Atom());
+
+    // str() of interned atoms is read while others intern
+  std::vector<std::thread> threads;
+  for(int i = 0; i < 4; ++i) {
+    threads.emplace_back([i]() {
+      for(int n = 0; n < 500; ++n) {
+        const auto name = "atomtest-" + std::to_string(i) + "-" + std::to_string(n);
+        EXPECT_EQ(uzel::Atom::intern(name).str(), name);
+        EXPECT_EQ(uzel::Atom(name).str(), name);
+      }
+    });
+  }
+  for(auto &&thread : threads) {
+    thread.join();
+  }
+}
+
+TEST(uzel, lanes)
+{
+  using Lane = std::shared_ptr<std::string>;
+  boost::asio::io_context ioc;
+  uzel::Lanes<Lane> lanes({}, std::make_shared<uzel::StrandTimers>(std::make_shared<uzel::TimerWheel>(ioc.get_executor()), ioc.get_executor()));
+  EXPECT_FALSE(lanes.lane(uzel::Priority::high));
+  const auto high = std::make_shared<std::string>("H");
+  const auto low = std::make_shared<std::string>("L");
+  const auto control = std::make_shared<std::string>("C");
+  lanes.slot(uzel::Priority::high) = high;
+  EXPECT_FALSE(lanes.connected());
+  lanes.slot(uzel::Priority::low) = low;
+  lanes.slot(uzel::Priority::control) = control;
+  EXPECT_TRUE(lanes.connected());
+  EXPECT_EQ(lanes.lane(uzel::Priority::high), high);
+  EXPECT_EQ(lanes.lane(uzel::Priority::low), low);
+  EXPECT_EQ(lanes.lane(uzel::Priority::control), control);
+  EXPECT_EQ(lanes.lane(uzel::Priority::undefined), high);
+
+    // control -> C -> H -> L, low -> L -> H -> C, the rest -> H -> L -> C
+  auto order = [&](uzel::Priority prio) {
+    std::string lanesTried;
+    auto saved = std::vector<Lane>{lanes.slot(uzel::Priority::high), lanes.slot(uzel::Priority::low), lanes.slot(uzel::Priority::control)};
+    while(auto lane = lanes.lane(prio)) {
+      lanesTried += *lane;
+      EXPECT_EQ(lanes.close(lane, {}), 0U);
+    }
+    lanes.slot(uzel::Priority::high) = saved[0];
+    lanes.slot(uzel::Priority::low) = saved[1];
+    lanes.slot(uzel::Priority::control) = saved[2];
+    return lanesTried;
+  };
+  EXPECT_EQ(order(uzel::Priority::control), "CHL");
+  EXPECT_EQ(order(uzel::Priority::low), "LHC");
+  EXPECT_EQ(order(uzel::Priority::high), "HLC");
+
+    // unsent messages of the closed lane are queued by priority, service ones are dropped
+  auto qmsg = [](uzel::Priority prio, uzel::Msg::DestType dt = uzel::Msg::DestType::remote) {
+    return uzel::QueuedMsg({uzel::ByteSlice(std::vector<char>(10, 'x'))}, dt, prio);
+  };
+  std::vector<uzel::QueuedMsg> unsent;
+  unsent.push_back(qmsg(uzel::Priority::high));
+  unsent.push_back(qmsg(uzel::Priority::low));
+  unsent.push_back(qmsg(uzel::Priority::control));
+  unsent.push_back(qmsg(uzel::Priority::high, uzel::Msg::DestType::service));
+  EXPECT_EQ(lanes.close(high, std::move(unsent)), 3U);
+  EXPECT_FALSE(lanes.slot(uzel::Priority::high));
+  EXPECT_FALSE(lanes.connected());
+  EXPECT_EQ(lanes.queue(uzel::Priority::high).size(), 2U);
+  EXPECT_EQ(lanes.queue(uzel::Priority::control).size(), 2U);
+  EXPECT_EQ(lanes.queue(uzel::Priority::low).size(), 1U);
+    // and fail over to the lanes left
+  EXPECT_EQ(lanes.lane(uzel::Priority::high), low);
+  EXPECT_EQ(lanes.lane(uzel::Priority::control), control);
+  EXPECT_EQ(lanes.queue(uzel::Priority::high).take_all().size(), 2U);
+}
+
+TEST(uzel, registry)
+{
+  uzel::Registry<std::string, int> reg;
+  EXPECT_FALSE(reg.find("a"));
+  EXPECT_FALSE(reg.exchange("a", 1));
+  EXPECT_EQ(reg.exchange("a", 2), 1);
+  int made{0};
+  EXPECT_EQ(reg.findOrAdd("a", [&]() { ++made; return 3; }), 2);
+  EXPECT_EQ(reg.findOrAdd("b", [&]() { ++made; return 3; }), 3);
+  EXPECT_EQ(made, 1);
+  EXPECT_EQ(reg.read("c", [](const int *value) { return value == nullptr; }), true);
+  EXPECT_EQ(reg.values().size(), 2U);
+
+    // concurrent updates of one value are not lost
+  const int perThread = 1000;
+  std::vector<std::thread> threads;
+  for(int i = 0; i < 4; ++i) {
+    threads.emplace_back([&]() {
+      for(int n = 0; n < perThread; ++n) {
+        reg.update("c", [](int &value) { ++value; });
+        EXPECT_TRUE(reg.find("a"));
+      }
+    });
+  }
+  for(auto &&thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(reg.find("c"), 4 * perThread);
+}
+
+
+TEST(uzel, spscQueue)
+{
+  uzel::SpscQueue<std::unique_ptr<int>> queue(3);
+  EXPECT_EQ(queue.capacity(), 4U);
+  EXPECT_FALSE(queue.pop());
+  for(int i = 0; i < 4; ++i) {
+    auto value = std::make_unique<int>(i);
+    EXPECT_TRUE(queue.push(value));
+    EXPECT_FALSE(value);
+  }
+  auto extra = std::make_unique<int>(4);
+  EXPECT_FALSE(queue.push(extra));
+  EXPECT_TRUE(extra); // not moved when full
+  EXPECT_EQ(**queue.pop(), 0);
+  EXPECT_TRUE(queue.push(extra));
+
+    // the consumer gets everything in order
+  uzel::SpscQueue<int> ring(64);
+  const int count = 20000;
+  std::thread producer([&]() {
+    for(int i = 0; i < count; ++i) {
+      while(!ring.push(i)) std::this_thread::yield();
+    }
+  });
+  int expected{0};
+  while(expected < count) {
+    if(auto value = ring.pop()) {
+      ASSERT_EQ(*value, expected);
+      ++expected;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  EXPECT_FALSE(ring.pop());
+}
+
 // NOLINTEND(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
 } // namespace